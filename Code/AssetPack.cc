@@ -0,0 +1,520 @@
+// Asset pack.
+//
+// assets.pack bundles the asset folders into one file that is memory-mapped
+// once at startup, instead of opening and reading every file on its own.
+//
+// Layout: a header, then the entry table sorted by path hash, then the file
+// data. Every file starts on a 4 KB boundary and is followed by a zero byte,
+// like the buffers from fileContentsAscii. Paths are keyed relative to the
+// folder that holds the pack, lowercase with forward slashes.
+//
+// Files are stored as is and read in place, or compressed with LZ4 when that
+// saves at least a quarter, in which case reading decompresses them into a
+// new allocation. Cooked meshes are always stored as is; the mesh cache points
+// into them.
+//
+// Build it with the "Build asset pack" command while no pack is open. Files
+// missing from the pack are read from disk, but an edited file keeps its
+// packed version until the pack is rebuilt, so delete assets.pack while
+// working on assets.
+
+#define AssetPackMagic 0x4B434150  // 'PACK'
+#define AssetPackVersion 1
+#define AssetPackAlignment Kilobytes(4)
+
+enum AssetPackCompression
+{
+   AssetPackCompression_None,
+   AssetPackCompression_LZ4,
+};
+
+struct AssetPackHeader
+{
+   u32 magic;
+   u32 version;
+   u64 numEntries;
+   u64 entriesOffset;  // From the start of the file
+   u64 totalBytes;
+};
+
+struct AssetPackEntry
+{
+   u64 pathHash[2];  // MeowHash of the key.
+   u64 offset;
+   u64 numBytes;  // Uncompressed
+   u64 storedBytes;
+   u32 compression;  // AssetPackCompression
+   u32 pad;
+};
+
+static struct AssetPack
+{
+   u8* data;  // Null when there is no pack.
+   u64 numBytes;
+   AssetPackEntry* entries;
+   u64 numEntries;
+   char root[MaxPath];  // Normalized folder of the pack, ending in a slash.
+   u64 rootLen;
+} *gAssetPack;
+
+u64
+assetPackGlobalSize()
+{
+   return sizeof(*gAssetPack);
+}
+
+void
+assetPackGlobalSet(u8* ptr)
+{
+   gAssetPack = (AssetPack*)ptr;
+}
+
+// ================================
+// LZ4 block format
+// ================================
+
+#define Lz4MinMatch 4
+#define Lz4HashBits 12
+#define Lz4LastLiterals 5  // The format wants the last bytes as literals...
+#define Lz4MatchMargin 12  // ... and no match starting this close to the end.
+
+static u64
+lz4CompressBound(u64 numBytes)
+{
+   return numBytes + numBytes / 255 + 16;
+}
+
+static u8*
+lz4WriteLength(u8* out, u64 len)
+{
+   while (len >= 255) {
+      *out++ = 255;
+      len -= 255;
+   }
+   *out++ = (u8)len;
+   return out;
+}
+
+// Greedy, with a single hash table of the last position of each 4 byte sequence.
+// dst needs lz4CompressBound(srcBytes) bytes.
+static u64
+lz4Compress(const u8* src, u64 srcBytes, u8* dst)
+{
+   u32 table[1 << Lz4HashBits] = {};
+
+   u8* out = dst;
+   u64 anchor = 0;
+   u64 i = 0;
+   u64 matchLimit = srcBytes > Lz4MatchMargin ? srcBytes - Lz4MatchMargin : 0;
+
+   while (i < matchLimit) {
+      u32 seq = 0;
+      memcpy(&seq, src + i, sizeof(seq));
+      u32 h = (seq * 2654435761u) >> (32 - Lz4HashBits);
+      u64 candidate = table[h];
+      table[h] = (u32)i;
+
+      u32 candidateSeq = 0;
+      memcpy(&candidateSeq, src + candidate, sizeof(candidateSeq));
+
+      if (candidate < i && i - candidate <= 0xFFFF && candidateSeq == seq) {
+         u64 matchLen = Lz4MinMatch;
+         while (i + matchLen < srcBytes - Lz4LastLiterals && src[candidate + matchLen] == src[i + matchLen]) {
+            ++matchLen;
+         }
+
+         u64 litLen = i - anchor;
+         u8* token = out++;
+         *token = (u8)((Min(litLen, 15) << 4) | Min(matchLen - Lz4MinMatch, 15));
+         if (litLen >= 15) {
+            out = lz4WriteLength(out, litLen - 15);
+         }
+         memcpy(out, src + anchor, litLen);
+         out += litLen;
+
+         u64 offset = i - candidate;
+         *out++ = (u8)(offset & 0xFF);
+         *out++ = (u8)(offset >> 8);
+         if (matchLen - Lz4MinMatch >= 15) {
+            out = lz4WriteLength(out, matchLen - Lz4MinMatch - 15);
+         }
+
+         i += matchLen;
+         anchor = i;
+      }
+      else {
+         ++i;
+      }
+   }
+
+   u64 litLen = srcBytes - anchor;
+   *out++ = (u8)(Min(litLen, 15) << 4);
+   if (litLen >= 15) {
+      out = lz4WriteLength(out, litLen - 15);
+   }
+   memcpy(out, src + anchor, litLen);
+   out += litLen;
+
+   return out - dst;
+}
+
+static bool
+lz4ReadLength(const u8*& in, const u8* inEnd, u64* len)
+{
+   u8 b = 0;
+   do {
+      if (in >= inEnd) {
+         return false;
+      }
+      b = *in++;
+      *len += b;
+   } while (b == 255);
+   return true;
+}
+
+// False on corrupt input. Never writes past dst + dstBytes.
+static bool
+lz4Decompress(const u8* src, u64 srcBytes, u8* dst, u64 dstBytes)
+{
+   const u8* in = src;
+   const u8* inEnd = src + srcBytes;
+   u8* out = dst;
+   u8* outEnd = dst + dstBytes;
+
+   while (in < inEnd) {
+      u8 token = *in++;
+
+      u64 litLen = token >> 4;
+      if (litLen == 15 && !lz4ReadLength(in, inEnd, &litLen)) {
+         return false;
+      }
+      if (litLen > (u64)(inEnd - in) || litLen > (u64)(outEnd - out)) {
+         return false;
+      }
+      memcpy(out, in, litLen);
+      in += litLen;
+      out += litLen;
+
+      if (in == inEnd) {
+         break;  // The last sequence has no match.
+      }
+
+      if (inEnd - in < 2) {
+         return false;
+      }
+      u64 offset = in[0] | (in[1] << 8);
+      in += 2;
+      if (offset == 0 || offset > (u64)(out - dst)) {
+         return false;
+      }
+
+      u64 matchLen = token & 15;
+      if (matchLen == 15 && !lz4ReadLength(in, inEnd, &matchLen)) {
+         return false;
+      }
+      matchLen += Lz4MinMatch;
+      if (matchLen > (u64)(outEnd - out)) {
+         return false;
+      }
+
+      // Byte by byte; the match may overlap what it writes.
+      u8* match = out - offset;
+      for (u64 mi = 0; mi < matchLen; ++mi) {
+         out[mi] = match[mi];
+      }
+      out += matchLen;
+   }
+
+   return out == outEnd;
+}
+
+// ================================
+// Lookup
+// ================================
+
+static void
+assetPackNormalizePath(char* path, char* out, u64 outSize)
+{
+   u64 i = 0;
+   for (; path[i] && i < outSize - 1; ++i) {
+      char c = path[i];
+      out[i] = (c == '\\') ? '/' : (char)tolower(c);
+   }
+   out[i] = '\0';
+}
+
+static int
+compareAssetPackEntries(const void* va, const void* vb)
+{
+   AssetPackEntry* a = (AssetPackEntry*)va;
+   AssetPackEntry* b = (AssetPackEntry*)vb;
+   int res = 0;
+   if (a->pathHash[0] != b->pathHash[0]) {
+      res = a->pathHash[0] < b->pathHash[0] ? -1 : 1;
+   }
+   else if (a->pathHash[1] != b->pathHash[1]) {
+      res = a->pathHash[1] < b->pathHash[1] ? -1 : 1;
+   }
+   return res;
+}
+
+static AssetPackEntry
+assetPackEntryForKey(char* key)
+{
+   meow_u128 hash = MeowHash(MeowDefaultSeed, strlen(key), key);
+
+   AssetPackEntry e = {};
+   e.pathHash[0] = MeowU64From(hash, 0);
+   e.pathHash[1] = MeowU64From(hash, 1);
+   return e;
+}
+
+static AssetPackEntry*
+assetPackFind(char* path)
+{
+   AssetPackEntry* found = nullptr;
+
+   if (gAssetPack->data) {
+      char key[MaxPath] = {};
+      assetPackNormalizePath(path, key, ArrayCount(key));
+
+      if (!strncmp(key, gAssetPack->root, gAssetPack->rootLen)) {
+         AssetPackEntry e = assetPackEntryForKey(key + gAssetPack->rootLen);
+         found = (AssetPackEntry*)bsearch(&e, gAssetPack->entries, gAssetPack->numEntries, sizeof(AssetPackEntry), compareAssetPackEntries);
+      }
+   }
+
+   return found;
+}
+
+bool
+assetPackOpen(Platform* plat, char* packPath)
+{
+   // Closing would pull the data from under meshes that point into the pack.
+   Assert(!gAssetPack->data);
+
+   u64 numBytes = 0;
+   u8* data = plat->mapFileAscii(packPath, &numBytes);
+
+   AssetPackHeader* h = (AssetPackHeader*)data;
+   bool valid = data && numBytes >= sizeof(AssetPackHeader) &&
+                h->magic == AssetPackMagic &&
+                h->version == AssetPackVersion &&
+                h->totalBytes == numBytes &&
+                h->entriesOffset + h->numEntries * sizeof(AssetPackEntry) <= numBytes;
+
+   if (valid) {
+      AssetPackEntry* entries = (AssetPackEntry*)(data + h->entriesOffset);
+      for (u64 i = 0; valid && i < h->numEntries; ++i) {
+         valid = entries[i].offset + entries[i].storedBytes <= numBytes;
+      }
+   }
+
+   if (valid) {
+      gAssetPack->data = data;
+      gAssetPack->numBytes = numBytes;
+      gAssetPack->entries = (AssetPackEntry*)(data + h->entriesOffset);
+      gAssetPack->numEntries = h->numEntries;
+
+      assetPackNormalizePath(packPath, gAssetPack->root, ArrayCount(gAssetPack->root));
+      char* slash = strrchr(gAssetPack->root, '/');
+      if (slash) {
+         slash[1] = '\0';
+      }
+      else {
+         gAssetPack->root[0] = '\0';
+      }
+      gAssetPack->rootLen = strlen(gAssetPack->root);
+
+      logMsg("Opened asset pack %s with %lld files\n", packPath, gAssetPack->numEntries);
+   }
+   else if (data) {
+      logMsg("Ignoring invalid asset pack %s\n", packPath);
+      plat->unmapFile(data);
+   }
+
+   return valid;
+}
+
+bool
+assetPackIsOpen()
+{
+   return gAssetPack->data != nullptr;
+}
+
+void
+assetPackClose(Platform* plat)
+{
+   if (gAssetPack->data) {
+      plat->unmapFile(gAssetPack->data);
+   }
+   *gAssetPack = {};
+}
+
+u8*
+assetPackView(char* path, u64* outBytes)
+{
+   u8* view = nullptr;
+   *outBytes = 0;
+
+   AssetPackEntry* e = assetPackFind(path);
+   if (e && e->compression == AssetPackCompression_None) {
+      view = gAssetPack->data + e->offset;
+      *outBytes = e->numBytes;
+   }
+   return view;
+}
+
+u64
+assetFileContents(Platform* plat, char* path, u8*& data, Lifetime life)
+{
+   u64 numBytes = 0;
+
+   AssetPackEntry* e = assetPackFind(path);
+   if (e && e->compression == AssetPackCompression_None) {
+      data = gAssetPack->data + e->offset;
+      numBytes = e->numBytes;
+   }
+   else if (e && e->compression == AssetPackCompression_LZ4) {
+      u8* bytes = allocateBytes(e->numBytes + 1, life);  // Zero terminated
+      if (lz4Decompress(gAssetPack->data + e->offset, e->storedBytes, bytes, e->numBytes)) {
+         data = bytes;
+         numBytes = e->numBytes;
+      }
+      else {
+         logMsg("Corrupt entry for %s in the asset pack\n", path);
+      }
+   }
+
+   if (!numBytes) {
+      numBytes = plat->fileContentsAscii(path, data, life);
+   }
+
+   return numBytes;
+}
+
+// ================================
+// Building
+// ================================
+
+static bool
+assetPackSkipFile(char* name)
+{
+   // Authoring files the game never loads.
+   char* skipExtensions[] = { ".blend", ".blend1", ".sfs", ".wav" };
+
+   bool skip = false;
+   char* ext = strrchr(name, '.');
+   for (int i = 0; ext && !skip && i < ArrayCount(skipExtensions); ++i) {
+      skip = !strcmp(ext, skipExtensions[i]);
+   }
+   return skip;
+}
+
+bool
+assetPackBuild(Platform* plat, char* packPath, char** dirs, u64 numDirs)
+{
+   struct PackFile
+   {
+      AssetPackEntry entry;
+      u8* data;
+   };
+   PackFile* sFiles = nullptr;
+
+   char packDir[MaxPath] = {};
+   snprintf(packDir, ArrayCount(packDir), "%s", packPath);
+   {
+      char* slash = Max(strrchr(packDir, '/'), strrchr(packDir, '\\'));
+      if (slash) {
+         slash[1] = '\0';
+      }
+      else {
+         packDir[0] = '\0';
+      }
+   }
+
+   u64 totalFileBytes = 0;
+
+   for (u64 di = 0; di < numDirs; ++di) {
+      char dirPath[MaxPath] = {};
+      snprintf(dirPath, ArrayCount(dirPath), "%s%s", packDir, dirs[di]);
+
+      u64 maxNames = 1024;
+      char (*names)[MaxPath] = (char (*)[MaxPath])allocateBytes(maxNames * MaxPath, Lifetime_Frame);
+      u64 numNames = plat->listFilesAscii(dirPath, names, maxNames);
+      if (numNames > maxNames) {
+         logMsg("Asset pack: only packing %lld of the %lld files in %s\n", maxNames, numNames, dirPath);
+         numNames = maxNames;
+      }
+
+      for (u64 ni = 0; ni < numNames; ++ni) {
+         if (assetPackSkipFile(names[ni])) {
+            continue;
+         }
+
+         char key[MaxPath] = {};
+         char relPath[MaxPath] = {};
+         snprintf(relPath, ArrayCount(relPath), "%s/%s", dirs[di], names[ni]);
+         assetPackNormalizePath(relPath, key, ArrayCount(key));
+
+         char filePath[MaxPath] = {};
+         snprintf(filePath, ArrayCount(filePath), "%s/%s", dirPath, names[ni]);
+
+         PackFile f = {};
+         f.entry = assetPackEntryForKey(key);
+         f.entry.numBytes = plat->fileContentsAscii(filePath, f.data, Lifetime_Frame);
+         f.entry.storedBytes = f.entry.numBytes;
+
+         char* ext = strrchr(names[ni], '.');
+         bool inPlace = ext && !strcmp(ext, ".cooked");
+         if (gKnobs.compressAssetPack && !inPlace && f.entry.numBytes) {
+            u8* compressed = allocateBytes(lz4CompressBound(f.entry.numBytes), Lifetime_Frame);
+            u64 compressedBytes = lz4Compress(f.data, f.entry.numBytes, compressed);
+            if (compressedBytes < f.entry.numBytes - f.entry.numBytes / 4) {
+               f.data = compressed;
+               f.entry.storedBytes = compressedBytes;
+               f.entry.compression = AssetPackCompression_LZ4;
+            }
+         }
+
+         totalFileBytes += f.entry.numBytes;
+         SBPush(sFiles, f, Lifetime_Frame);
+      }
+   }
+
+   u64 numFiles = SBCount(sFiles);
+   qsort(sFiles, numFiles, sizeof(PackFile), compareAssetPackEntries);  // The entry is the first member.
+
+   AssetPackHeader h = {};
+   h.magic = AssetPackMagic;
+   h.version = AssetPackVersion;
+   h.numEntries = numFiles;
+   h.entriesOffset = AlignPow2(sizeof(AssetPackHeader), 16);
+
+   u64 offset = h.entriesOffset + numFiles * sizeof(AssetPackEntry);
+   for (u64 fi = 0; fi < numFiles; ++fi) {
+      offset = AlignPow2(offset, AssetPackAlignment);
+      sFiles[fi].entry.offset = offset;
+      offset += sFiles[fi].entry.storedBytes + 1;  // Zero terminated
+   }
+   h.totalBytes = AlignPow2(offset, AssetPackAlignment);
+
+   u8* bytes = allocateBytes(h.totalBytes, Lifetime_Frame);
+   memset(bytes, 0, h.totalBytes);
+
+   memcpy(bytes, &h, sizeof(h));
+   AssetPackEntry* entries = (AssetPackEntry*)(bytes + h.entriesOffset);
+   for (u64 fi = 0; fi < numFiles; ++fi) {
+      entries[fi] = sFiles[fi].entry;
+      memcpy(bytes + sFiles[fi].entry.offset, sFiles[fi].data, sFiles[fi].entry.storedBytes);
+   }
+
+   bool ok = plat->writeFileAscii(packPath, bytes, h.totalBytes);
+   if (ok) {
+      logMsg("Wrote asset pack %s: %lld files, %.2f MB -> %.2f MB\n", packPath, numFiles, totalFileBytes / (1024.0 * 1024.0), h.totalBytes / (1024.0 * 1024.0));
+   }
+   else {
+      logMsg("Could not write asset pack %s\n", packPath);
+   }
+   return ok;
+}
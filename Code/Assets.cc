@@ -0,0 +1,438 @@
+// Asset registry.
+//
+// Meshes are loaded once per world and shared by every object that uses
+// them. An asset is found by the hash of its path; on a miss the file is read
+// and looked up by the MeowHash of its contents, so copies of a file under
+// another name share too. The registry uploads the buffers, BLAS, LODs and
+// meshlets once. addMeshAssetToWorld gives each object its own material,
+// transform and shadow constants on top of them.
+//
+// CPU data lives in Lifetime_World. Releasing the last reference frees the GPU
+// buffers once the objects that draw them are gone; the CPU memory goes with
+// the world.
+//
+// Meshes, sounds and fonts can also load in the background. assetLoadAsync
+// queues a job that reads, parses and decodes on a worker thread, allocating
+// from its own job memory. Finished jobs are picked up on the main thread at
+// the start of the next frame, by assetsUpdate, or right away by assetWait.
+// That is where the job memory joins the main heaps and the GPU uploads
+// happen. Don't reload the code while loads are in flight.
+
+struct MeshAsset
+{
+   Mesh mesh;
+   MeshRenderHandle renderHandle;  // Holds one reference to the shared buffers.
+   AABB bounds;
+   meow_u128 contentHash;
+   u32 refCount;  // 0 once released.
+};
+
+enum AssetLoadState
+{
+   AssetLoad_Free,
+   AssetLoad_Queued,
+   AssetLoad_Loaded,  // The worker is done. Waiting for the main thread.
+   AssetLoad_Ready,
+};
+
+struct AssetLoad
+{
+   volatile u32 state;  // AssetLoadState
+   AssetType type;
+   Platform* plat;
+   char path[MaxPath];
+   JobMemory* mem;
+
+   // Filled in by the worker.
+   meow_u128 contentHash;
+   Mesh mesh;
+   LoadedSound sound;
+   Font* font;
+   float fontSizes[FontSize_Count];
+   bool customFontSizes;
+
+   // Filled in on the main thread.
+   MeshAssetHandle meshAsset;
+};
+
+static struct AssetRegistry
+{
+   MeshAsset* sMeshes;  // Index 0 is the invalid handle.
+
+   struct MeshAssetHM
+   {
+      meow_u128 key;
+      u64 value;
+   } *hmMeshesByPath, *hmMeshesByContent;
+
+   Platform* plat;
+   AssetLoad loads[MaxAssetLoads];
+} *gAssets;
+
+u64
+assetsGlobalSize()
+{
+   return sizeof(*gAssets);
+}
+
+void
+assetsGlobalSet(u8* ptr)
+{
+   gAssets = (AssetRegistry*)ptr;
+}
+
+static MeshAsset*
+meshAssetFromHandle(MeshAssetHandle h)
+{
+   Assert(h.idx > 0 && h.idx < SBCount(gAssets->sMeshes));
+   MeshAsset* a = gAssets->sMeshes + h.idx;
+   Assert(a->refCount > 0);
+   return a;
+}
+
+static meow_u128
+assetPathHash(char* path)
+{
+   return MeowHash(MeowDefaultSeed, strlen(path), path);
+}
+
+// 0 when not found.
+static u64
+findMeshAsset(AssetRegistry::MeshAssetHM* hm, meow_u128 key)
+{
+   i64 i = hmgeti(hm, key);
+   return (i != -1) ? hm[i].value : 0;
+}
+
+// Uploads the mesh and registers its contents. The caller registers the path.
+// The mesh no longer points into its cooked file afterwards.
+static u64
+addMeshAsset(Platform* plat, Mesh* mesh, meow_u128 contentHash)
+{
+   if (!gAssets->sMeshes) {
+      SBPush(gAssets->sMeshes, MeshAsset{}, Lifetime_World);
+   }
+
+   MeshAsset a = {};
+   a.renderHandle = uploadSharedMeshToGPU(*mesh);
+   a.bounds = mesh->cookedVerts ? mesh->cookedBounds : computeBoundingBox(*mesh);
+   a.contentHash = contentHash;
+   meshUnmapCooked(plat, mesh);
+   a.mesh = *mesh;
+
+   u64 idx = SBCount(gAssets->sMeshes);
+   SBPush(gAssets->sMeshes, a, Lifetime_World);
+
+   pushApiLifetime(Lifetime_World);
+   hmput(gAssets->hmMeshesByContent, contentHash, idx);
+   popApiLifetime();
+
+   return idx;
+}
+
+static void
+registerMeshAssetPath(meow_u128 pathHash, u64 idx)
+{
+   pushApiLifetime(Lifetime_World);
+   hmput(gAssets->hmMeshesByPath, pathHash, idx);
+   popApiLifetime();
+}
+
+MeshAssetHandle
+acquireMeshAsset(Platform* plat, char* path)
+{
+   meow_u128 pathHash = assetPathHash(path);
+
+   MeshAssetHandle h = { findMeshAsset(gAssets->hmMeshesByPath, pathHash) };
+   if (!h.idx) {
+      u8* source = nullptr;
+      u64 sourceBytes = assetFileContents(plat, path, source, Lifetime_Frame);
+      meow_u128 contentHash = MeowHash(MeowDefaultSeed, sourceBytes, source);
+
+      h.idx = findMeshAsset(gAssets->hmMeshesByContent, contentHash);
+      if (!h.idx) {
+         Mesh mesh = objLoadCachedFromSource(plat, path, source, sourceBytes, contentHash, Lifetime_World, plat->numWorkerThreads + 1);
+         h.idx = addMeshAsset(plat, &mesh, contentHash);
+      }
+      registerMeshAssetPath(pathHash, h.idx);
+   }
+
+   gAssets->sMeshes[h.idx].refCount++;
+
+   return h;
+}
+
+void
+releaseMeshAsset(MeshAssetHandle h)
+{
+   MeshAsset* a = meshAssetFromHandle(h);
+   if (--a->refCount == 0) {
+      gpuMarkFreeRenderMesh(&a->renderHandle, gpu()->frameCount);
+
+      hmdel(gAssets->hmMeshesByContent, a->contentHash);
+
+      // Every path that led to this asset.
+      for (i64 i = hmlen(gAssets->hmMeshesByPath) - 1; i >= 0; --i) {
+         if (gAssets->hmMeshesByPath[i].value == h.idx) {
+            hmdel(gAssets->hmMeshesByPath, gAssets->hmMeshesByPath[i].key);
+         }
+      }
+   }
+}
+
+MeshAssetHandle
+meshAssetForPath(char* path)
+{
+   MeshAssetHandle h = { findMeshAsset(gAssets->hmMeshesByPath, assetPathHash(path)) };
+   return h;
+}
+
+const Mesh*
+meshAsset(MeshAssetHandle h)
+{
+   return &meshAssetFromHandle(h)->mesh;
+}
+
+MeshRenderHandle
+meshAssetRenderHandle(MeshAssetHandle h)
+{
+   return meshAssetFromHandle(h)->renderHandle;
+}
+
+AABB
+meshAssetBounds(MeshAssetHandle h)
+{
+   return meshAssetFromHandle(h)->bounds;
+}
+
+// ================================
+// Async loading
+// ================================
+
+// Worker side. Everything here allocates from the job memory.
+PlatformWorkProcDef(assetLoadProc)
+{
+   AssetLoad* l = (AssetLoad*)data;
+
+   l->mem = jobMemoryBegin();
+
+   switch (l->type) {
+      case AssetType_Mesh: {
+         u8* source = nullptr;
+         u64 sourceBytes = assetFileContents(l->plat, l->path, source, Lifetime_Frame);
+         l->contentHash = MeowHash(MeowDefaultSeed, sourceBytes, source);
+         // One thread per file. Only the main thread can add work.
+         l->mesh = objLoadCachedFromSource(l->plat, l->path, source, sourceBytes, l->contentHash, Lifetime_World, 1);
+      } break;
+      case AssetType_Sound: {
+         l->sound = mp3Load(l->plat, l->path, Lifetime_World);
+      } break;
+      case AssetType_Font: {
+         // One thread per file. Only the main thread can add work.
+         fontLoad(l->plat, l->font, l->path, l->customFontSizes ? l->fontSizes : NULL, 1);
+      } break;
+      default: {
+         Assert(false);
+      }
+   }
+
+   jobMemoryEnd();
+
+   MemoryBarrier();  // Results must be visible before the state changes.
+   l->state = AssetLoad_Loaded;
+}
+
+// Main thread side: memory and GPU uploads.
+static void
+assetLoadFinish(AssetLoad* l)
+{
+   Assert(l->state == AssetLoad_Loaded);
+   MemoryBarrier();
+
+   jobMemoryAdopt(l->mem);
+   l->mem = nullptr;
+
+   switch (l->type) {
+      case AssetType_Mesh: {
+         // The same file may have been loaded since the request, under this path or another.
+         meow_u128 pathHash = assetPathHash(l->path);
+         u64 idx = findMeshAsset(gAssets->hmMeshesByPath, pathHash);
+         if (!idx) {
+            idx = findMeshAsset(gAssets->hmMeshesByContent, l->contentHash);
+         }
+         if (!idx) {
+            idx = addMeshAsset(l->plat, &l->mesh, l->contentHash);
+         }
+         meshUnmapCooked(l->plat, &l->mesh);
+         registerMeshAssetPath(pathHash, idx);
+         gAssets->sMeshes[idx].refCount++;
+         l->meshAsset = MeshAssetHandle{ idx };
+      } break;
+      case AssetType_Font: {
+         fontUploadAtlas(l->font);
+      } break;
+      default: break;
+   }
+
+   l->state = AssetLoad_Ready;
+}
+
+static AssetLoad*
+assetLoadFromHandle(AssetLoadHandle h)
+{
+   Assert(h.idx > 0 && h.idx <= MaxAssetLoads);
+   AssetLoad* l = gAssets->loads + h.idx - 1;
+   Assert(l->state != AssetLoad_Free);
+   return l;
+}
+
+static AssetLoadHandle
+assetLoadBegin(Platform* plat, char* path, AssetType type, Font* font, float* customFontSizes)
+{
+   gAssets->plat = plat;
+
+   AssetLoadHandle h = {};
+   for (u64 i = 0; !h.idx && i < MaxAssetLoads; ++i) {
+      if (gAssets->loads[i].state == AssetLoad_Free) {
+         h.idx = i + 1;
+      }
+   }
+   Assert(h.idx);  // Too many loads in flight. See MaxAssetLoads.
+
+   AssetLoad* l = gAssets->loads + h.idx - 1;
+   *l = {};
+   l->type = type;
+   l->plat = plat;
+   snprintf(l->path, ArrayCount(l->path), "%s", path);
+   l->font = font;
+   if (customFontSizes) {
+      l->customFontSizes = true;
+      memcpy(l->fontSizes, customFontSizes, sizeof(l->fontSizes));
+   }
+
+   // Meshes that are already in the registry are ready now.
+   u64 loaded = (type == AssetType_Mesh) ? findMeshAsset(gAssets->hmMeshesByPath, assetPathHash(path)) : 0;
+   if (loaded) {
+      gAssets->sMeshes[loaded].refCount++;
+      l->meshAsset = MeshAssetHandle{ loaded };
+      l->state = AssetLoad_Ready;
+   }
+   else {
+      l->state = AssetLoad_Queued;
+      if (gKnobs.loadAssetsAsync) {
+         plat->addWork(assetLoadProc, l);
+      }
+      else {
+         assetLoadProc(l);
+      }
+   }
+
+   return h;
+}
+
+AssetLoadHandle
+assetLoadAsync(Platform* plat, char* path, AssetType type)
+{
+   Assert(type != AssetType_Font);  // Needs a Font. See assetLoadFontAsync.
+   return assetLoadBegin(plat, path, type, NULL, NULL);
+}
+
+AssetLoadHandle
+assetLoadFontAsync(Platform* plat, Font* font, char* path, float* customSizes)
+{
+   // Loaded before. fontLoad starts the font over on a worker, so its texture goes here.
+   if (font->atlasTexture.resourceHandle.idx) {
+      gpuMarkFreeResource(font->atlasTexture.resourceHandle, gpu()->frameCount);
+   }
+   return assetLoadBegin(plat, path, AssetType_Font, font, customSizes);
+}
+
+bool
+assetPoll(AssetLoadHandle h)
+{
+   return assetLoadFromHandle(h)->state == AssetLoad_Ready;
+}
+
+void
+assetWait(AssetLoadHandle h)
+{
+   AssetLoad* l = assetLoadFromHandle(h);
+   // Help with the queue until this load is done, not the whole queue.
+   while (l->state == AssetLoad_Queued) {
+      if (!l->plat->helpWithWork()) {
+         YieldProcessor();
+      }
+   }
+   if (l->state == AssetLoad_Loaded) {
+      assetLoadFinish(l);
+   }
+   Assert(l->state == AssetLoad_Ready);
+}
+
+MeshAssetHandle
+assetTakeMesh(AssetLoadHandle h)
+{
+   assetWait(h);
+   AssetLoad* l = assetLoadFromHandle(h);
+   Assert(l->type == AssetType_Mesh);
+   l->state = AssetLoad_Free;
+   return l->meshAsset;
+}
+
+LoadedSound
+assetTakeSound(AssetLoadHandle h)
+{
+   assetWait(h);
+   AssetLoad* l = assetLoadFromHandle(h);
+   Assert(l->type == AssetType_Sound);
+   l->state = AssetLoad_Free;
+   return l->sound;
+}
+
+Font*
+assetTakeFont(AssetLoadHandle h)
+{
+   assetWait(h);
+   AssetLoad* l = assetLoadFromHandle(h);
+   Assert(l->type == AssetType_Font);
+   l->state = AssetLoad_Free;
+   return l->font;
+}
+
+void
+assetsUpdate()
+{
+   for (u64 i = 0; i < MaxAssetLoads; ++i) {
+      AssetLoad* l = gAssets->loads + i;
+      if (l->state == AssetLoad_Loaded) {
+         assetLoadFinish(l);
+      }
+   }
+}
+
+void
+disposeMeshAssets()
+{
+   // Loads in flight still write to their slots.
+   if (gAssets->plat) {
+      gAssets->plat->completeAllWork();
+   }
+   for (u64 i = 0; i < MaxAssetLoads; ++i) {
+      AssetLoad* l = gAssets->loads + i;
+      if (l->state == AssetLoad_Loaded) {
+         jobMemoryAdopt(l->mem);
+         if (l->type == AssetType_Mesh) {
+            meshUnmapCooked(l->plat, &l->mesh);
+         }
+      }
+   }
+
+   for (u64 i = 1; i < SBCount(gAssets->sMeshes); ++i) {
+      MeshAsset* a = gAssets->sMeshes + i;
+      if (a->refCount) {
+         gpuMarkFreeRenderMesh(&a->renderHandle, gpu()->frameCount);
+      }
+   }
+   // The arrays are in Lifetime_World.
+   *gAssets = {};
+}
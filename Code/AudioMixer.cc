@@ -0,0 +1,793 @@
+// Software mixer.
+//
+// Every sound plays on one of a fixed pool of channels. Channels are
+// resampled to gKnobs.mixerRate with a cubic (Catmull-Rom) interpolator and
+// mixed with SSE into a single stereo stream.
+//
+// Two threads use a mixer. The game thread sends play, stop, parameter and
+// listener commands through a single producer, single consumer queue. The
+// mixing thread applies them at the start of each block and owns the
+// channels. Neither one ever waits: the game drops commands when the queue is
+// full and the mixer drops sounds when every channel is busy with a louder
+// one. The XAudio2 backend mixes into an AudioRing from its own thread and the
+// device callback reads the ring; tests and the WAV writer call
+// audioMixerRender directly.
+//
+// Positional sounds get their gain and pan from the listener at every block.
+// Only the gKnobs.mixerMaxAudible loudest channels are mixed. The others keep
+// their place in the sound without being heard.
+
+#define MixerMaxBlockFrames 4096
+#define MixerDecodeSamples 2304  // Two mp3 frames of one channel, or one frame of two.
+#define MixerMaxStep 4  // Source frames per output frame. Sounds at most 4x the mixer rate.
+#define MixerHistoryFrames (MixerMaxStep + 2)  // Kept across decoded blocks for the interpolator.
+
+enum AudioCommandType
+{
+   AudioCommand_Play,
+   AudioCommand_Stop,
+   AudioCommand_SetParams,
+   AudioCommand_SetListener,
+   AudioCommand_StopAll,
+};
+
+struct AudioCommand
+{
+   AudioCommandType type;
+   SoundId id;
+   LoadedSound snd;  // Play. A copy: the game may reassign its own while the command waits.
+   float gain;  // Play and SetParams
+   float pan;
+   bool positional;  // Play. pan is ignored.
+   vec3 pos;  // Play and SetListener
+   vec3 right;  // SetListener
+};
+
+struct AudioCommandQueue
+{
+   AudioCommand entries[gKnobs.audioCommandQueueSize];
+   volatile u32 writeCursor;  // Wrapping at 2^32. Written by the game thread only.
+   volatile u32 readCursor;  // Written by the mixing thread only.
+};
+
+struct MixerChannel
+{
+   SoundId id;  // 0 when the channel is free.
+
+   i16* samples;  // Interleaved
+   u64 numFrames;
+   u64 position;  // In source frames from samples, 32.32 fixed point.
+   u64 step;  // Source frames per output frame, 32.32 fixed point.
+   int channels;
+
+   float gain;
+   float pan;
+   bool positional;
+   vec3 pos;
+
+   // For the current block.
+   float gainL;
+   float gainR;
+
+   // Streamed sounds decode a block at a time on the mixing thread.
+   bool streamed;
+   bool decodeDone;
+   mp3dec_ex_t decoder;
+   i16 decoded[MixerHistoryFrames * 2 + MixerDecodeSamples];
+};
+
+struct AudioMixer
+{
+   // Game thread
+   AudioCommandQueue commands;
+   SoundId nextId;
+   u32 numDroppedCommands;
+   u32 numStopAllsSent;
+
+   // Mixing thread
+   MixerChannel channels[gKnobs.mixerChannels];
+   float mix[MixerMaxBlockFrames * 2];
+   float resampled[MixerMaxBlockFrames * 2];
+   vec3 listenerPos;
+   vec3 listenerRight;
+   u32 numDroppedSounds;
+
+   // Published by the mixing thread after every block.
+   volatile u32 numPlaying;
+   volatile u32 numAudible;
+   volatile u32 numStopAllsDone;  // Right after the channels are freed.
+};
+
+AudioMixer*
+audioMixerCreate(Lifetime life)
+{
+   AudioMixer* m = AllocateElem(AudioMixer, life);
+   m->listenerRight = { 1, 0, 0 };
+   return m;
+}
+
+static bool
+audioCommandPush(AudioCommandQueue* q, AudioCommand* cmd)
+{
+   u32 write = q->writeCursor;
+   if (write - loadAcquire(&q->readCursor) == ArrayCount(q->entries)) {
+      return false;
+   }
+   q->entries[write % ArrayCount(q->entries)] = *cmd;
+   storeRelease(&q->writeCursor, write + 1);  // Publish the entry.
+   return true;
+}
+
+static bool
+audioCommandPop(AudioCommandQueue* q, AudioCommand* cmd)
+{
+   u32 read = q->readCursor;
+   if (read == loadAcquire(&q->writeCursor)) {
+      return false;
+   }
+   *cmd = q->entries[read % ArrayCount(q->entries)];
+   storeRelease(&q->readCursor, read + 1);  // The producer can reuse the entry.
+   return true;
+}
+
+static bool
+mixerPush(AudioMixer* m, AudioCommand* cmd)
+{
+   bool pushed = audioCommandPush(&m->commands, cmd);
+   if (!pushed) {
+      m->numDroppedCommands++;
+   }
+   return pushed;
+}
+
+static SoundId
+mixerPushPlay(AudioMixer* m, AudioCommand* cmd)
+{
+   LoadedSound* snd = &cmd->snd;
+   if (snd->hz <= 0 || snd->hz > MixerMaxStep * gKnobs.mixerRate || snd->channels < 1 || snd->channels > 2) {
+      logMsg("Can't mix a sound at %d Hz with %d channels\n", snd->hz, snd->channels);
+      return 0;
+   }
+   if (!snd->samples && !snd->mp3) {
+      return 0;
+   }
+
+   if (++m->nextId == 0) {
+      ++m->nextId;
+   }
+   cmd->type = AudioCommand_Play;
+   cmd->id = m->nextId;
+
+   return mixerPush(m, cmd) ? cmd->id : 0;
+}
+
+SoundId
+audioMixerPlay(AudioMixer* m, LoadedSound* snd, float gain, float pan)
+{
+   AudioCommand cmd = {};
+   cmd.snd = *snd;
+   cmd.gain = gain;
+   cmd.pan = pan;
+   return mixerPushPlay(m, &cmd);
+}
+
+SoundId
+audioMixerPlayAt(AudioMixer* m, LoadedSound* snd, vec3 pos, float gain)
+{
+   AudioCommand cmd = {};
+   cmd.snd = *snd;
+   cmd.gain = gain;
+   cmd.positional = true;
+   cmd.pos = pos;
+   return mixerPushPlay(m, &cmd);
+}
+
+bool
+audioMixerStop(AudioMixer* m, SoundId id)
+{
+   AudioCommand cmd = {};
+   cmd.type = AudioCommand_Stop;
+   cmd.id = id;
+   return mixerPush(m, &cmd);
+}
+
+bool
+audioMixerStopAll(AudioMixer* m)
+{
+   AudioCommand cmd = {};
+   cmd.type = AudioCommand_StopAll;
+   bool pushed = mixerPush(m, &cmd);
+   if (pushed) {
+      m->numStopAllsSent++;
+   }
+   return pushed;
+}
+
+bool
+audioMixerStoppedAll(AudioMixer* m)
+{
+   return loadAcquire(&m->numStopAllsDone) == m->numStopAllsSent;
+}
+
+bool
+audioMixerSetParams(AudioMixer* m, SoundId id, float gain, float pan)
+{
+   AudioCommand cmd = {};
+   cmd.type = AudioCommand_SetParams;
+   cmd.id = id;
+   cmd.gain = gain;
+   cmd.pan = pan;
+   return mixerPush(m, &cmd);
+}
+
+bool
+audioMixerSetListener(AudioMixer* m, Camera* cam)
+{
+   AudioCommand cmd = {};
+   cmd.type = AudioCommand_SetListener;
+   cmd.pos = cam->eye;
+   // Same axes as mat4Lookat.
+   cmd.right = normalizedOrZero(cross(cam->up, cam->lookat - cam->eye));
+   return mixerPush(m, &cmd);
+}
+
+u32
+audioMixerNumPlaying(AudioMixer* m)
+{
+   return loadAcquire(&m->numPlaying);
+}
+
+u32
+audioMixerNumAudible(AudioMixer* m)
+{
+   return loadAcquire(&m->numAudible);
+}
+
+// Constant power panning. pan goes from -1 (left) to 1 (right).
+static void
+mixerGainsForPan(float gain, float pan, float* gainL, float* gainR)
+{
+   float angle = (clamp(pan, -1.0f, 1.0f) + 1.0f) * (Pi / 4.0f);
+   *gainL = gain * cosf(angle);
+   *gainR = gain * sinf(angle);
+}
+
+// Inverse distance attenuation past gKnobs.audioRefDistance, panned by the
+// direction to the sound.
+static void
+mixerUpdateGains(AudioMixer* m, MixerChannel* ch)
+{
+   float gain = ch->gain;
+   float pan = ch->pan;
+   if (ch->positional) {
+      vec3 toSound = ch->pos - m->listenerPos;
+      float dist = length(toSound);
+      gain *= gKnobs.audioRefDistance / Max(dist, gKnobs.audioRefDistance);
+      pan = dist > 0 ? dot(toSound, m->listenerRight) / dist : 0;
+   }
+   mixerGainsForPan(gain, pan, &ch->gainL, &ch->gainR);
+}
+
+static float
+mixerLoudness(MixerChannel* ch)
+{
+   return Max(ch->gainL, ch->gainR);
+}
+
+static MixerChannel*
+mixerFindChannel(AudioMixer* m, SoundId id)
+{
+   for (u32 i = 0; i < gKnobs.mixerChannels; ++i) {
+      if (m->channels[i].id == id) {
+         return m->channels + i;
+      }
+   }
+   return nullptr;
+}
+
+static void
+mixerFreeChannel(MixerChannel* ch)
+{
+   if (ch->streamed) {
+      mp3dec_ex_close(&ch->decoder);
+   }
+   ch->id = 0;
+}
+
+static void
+mixerStart(AudioMixer* m, AudioCommand* cmd)
+{
+   MixerChannel started = {};
+   started.gain = cmd->gain;
+   started.pan = cmd->pan;
+   started.positional = cmd->positional;
+   started.pos = cmd->pos;
+   mixerUpdateGains(m, &started);
+
+   MixerChannel* ch = mixerFindChannel(m, 0);
+   if (!ch) {
+      // Take over the quietest channel if the new sound is louder.
+      MixerChannel* quietest = m->channels;
+      for (u32 i = 1; i < gKnobs.mixerChannels; ++i) {
+         if (mixerLoudness(m->channels + i) < mixerLoudness(quietest)) {
+            quietest = m->channels + i;
+         }
+      }
+      if (mixerLoudness(quietest) >= mixerLoudness(&started)) {
+         m->numDroppedSounds++;
+         return;
+      }
+      mixerFreeChannel(quietest);
+      ch = quietest;
+   }
+
+   LoadedSound* snd = &cmd->snd;
+   ch->channels = snd->channels;
+   ch->position = 0;
+   ch->step = ((u64)snd->hz << 32) / gKnobs.mixerRate;
+   ch->gain = started.gain;
+   ch->pan = started.pan;
+   ch->positional = started.positional;
+   ch->pos = started.pos;
+   ch->gainL = started.gainL;
+   ch->gainR = started.gainR;
+
+   ch->streamed = snd->samples == nullptr;
+   if (ch->streamed) {
+      if (mp3dec_ex_open_buf(&ch->decoder, snd->mp3, snd->mp3Bytes, MP3D_SEEK_TO_SAMPLE)) {
+         logMsg("Could not open streamed mp3\n");
+         return;
+      }
+      mp3dec_ex_seek(&ch->decoder, 0);
+      // Decoded when the mixer gets to it.
+      ch->samples = ch->decoded;
+      ch->numFrames = 0;
+      ch->decodeDone = false;
+   }
+   else {
+      ch->samples = snd->samples;
+      ch->numFrames = snd->numBytes / (sizeof(i16) * snd->channels);
+   }
+
+   ch->id = cmd->id;
+}
+
+static void
+mixerApplyCommands(AudioMixer* m)
+{
+   AudioCommand cmd = {};
+   while (audioCommandPop(&m->commands, &cmd)) {
+      if (cmd.type == AudioCommand_Play) {
+         mixerStart(m, &cmd);
+         continue;
+      }
+      if (cmd.type == AudioCommand_SetListener) {
+         m->listenerPos = cmd.pos;
+         m->listenerRight = cmd.right;
+         continue;
+      }
+      if (cmd.type == AudioCommand_StopAll) {
+         for (u32 i = 0; i < gKnobs.mixerChannels; ++i) {
+            if (m->channels[i].id) {
+               mixerFreeChannel(m->channels + i);
+            }
+         }
+         storeRelease(&m->numStopAllsDone, m->numStopAllsDone + 1);
+         continue;
+      }
+      // The sound may have ended already.
+      MixerChannel* ch = cmd.id ? mixerFindChannel(m, cmd.id) : nullptr;
+      if (!ch) {
+         continue;
+      }
+      if (cmd.type == AudioCommand_Stop) {
+         mixerFreeChannel(ch);
+      }
+      else if (cmd.type == AudioCommand_SetParams) {
+         ch->gain = cmd.gain;
+         ch->pan = cmd.pan;
+      }
+   }
+}
+
+// Adds numFrames of src, scaled by the gains, to the stereo mix.
+static void
+mixerAccumulate(float* mix, const i16* src, u64 numFrames, int channels, float gainL, float gainR)
+{
+   u64 fi = 0;
+   if (channels == 1) {
+      __m128 gl = _mm_set1_ps(gainL);
+      __m128 gr = _mm_set1_ps(gainR);
+      for (; fi + 8 <= numFrames; fi += 8) {
+         // Sign extend by putting each sample in the high half and shifting it back down.
+         __m128i s = _mm_loadu_si128((__m128i*)(src + fi));
+         __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+         __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+
+         float* out = mix + fi * 2;
+         __m128 l = _mm_mul_ps(lo, gl);
+         __m128 r = _mm_mul_ps(lo, gr);
+         _mm_storeu_ps(out + 0, _mm_add_ps(_mm_loadu_ps(out + 0), _mm_unpacklo_ps(l, r)));
+         _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_unpackhi_ps(l, r)));
+         l = _mm_mul_ps(hi, gl);
+         r = _mm_mul_ps(hi, gr);
+         _mm_storeu_ps(out + 8, _mm_add_ps(_mm_loadu_ps(out + 8), _mm_unpacklo_ps(l, r)));
+         _mm_storeu_ps(out + 12, _mm_add_ps(_mm_loadu_ps(out + 12), _mm_unpackhi_ps(l, r)));
+      }
+      for (; fi < numFrames; ++fi) {
+         mix[fi * 2 + 0] += src[fi] * gainL;
+         mix[fi * 2 + 1] += src[fi] * gainR;
+      }
+   }
+   else {
+      __m128 g = _mm_setr_ps(gainL, gainR, gainL, gainR);
+      for (; fi + 4 <= numFrames; fi += 4) {
+         __m128i s = _mm_loadu_si128((__m128i*)(src + fi * 2));
+         __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+         __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+
+         float* out = mix + fi * 2;
+         _mm_storeu_ps(out + 0, _mm_add_ps(_mm_loadu_ps(out + 0), _mm_mul_ps(lo, g)));
+         _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(hi, g)));
+      }
+      for (; fi < numFrames; ++fi) {
+         mix[fi * 2 + 0] += src[fi * 2 + 0] * gainL;
+         mix[fi * 2 + 1] += src[fi * 2 + 1] * gainR;
+      }
+   }
+}
+
+// Clips to 16 bits.
+static void
+mixerToPcm(const float* mix, i16* out, u64 numSamples)
+{
+   __m128 maxV = _mm_set1_ps(32767.0f);
+   __m128 minV = _mm_set1_ps(-32768.0f);
+
+   u64 si = 0;
+   for (; si + 8 <= numSamples; si += 8) {
+      __m128i a = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(mix + si), maxV), minV));
+      __m128i b = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(mix + si + 4), maxV), minV));
+      _mm_storeu_si128((__m128i*)(out + si), _mm_packs_epi32(a, b));
+   }
+   for (; si < numSamples; ++si) {
+      out[si] = (i16)lrintf(clamp(mix[si], -32768.0f, 32767.0f));
+   }
+}
+
+// Adds numFrames of resampled src, scaled by the gains, to the stereo mix.
+static void
+mixerAccumulateFloat(float* mix, const float* src, u64 numFrames, int channels, float gainL, float gainR)
+{
+   u64 fi = 0;
+   if (channels == 1) {
+      __m128 gl = _mm_set1_ps(gainL);
+      __m128 gr = _mm_set1_ps(gainR);
+      for (; fi + 4 <= numFrames; fi += 4) {
+         __m128 s = _mm_loadu_ps(src + fi);
+         __m128 l = _mm_mul_ps(s, gl);
+         __m128 r = _mm_mul_ps(s, gr);
+         float* out = mix + fi * 2;
+         _mm_storeu_ps(out + 0, _mm_add_ps(_mm_loadu_ps(out + 0), _mm_unpacklo_ps(l, r)));
+         _mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_unpackhi_ps(l, r)));
+      }
+      for (; fi < numFrames; ++fi) {
+         mix[fi * 2 + 0] += src[fi] * gainL;
+         mix[fi * 2 + 1] += src[fi] * gainR;
+      }
+   }
+   else {
+      __m128 g = _mm_setr_ps(gainL, gainR, gainL, gainR);
+      for (; fi + 2 <= numFrames; fi += 2) {
+         float* out = mix + fi * 2;
+         _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(_mm_loadu_ps(src + fi * 2), g)));
+      }
+      for (; fi < numFrames; ++fi) {
+         mix[fi * 2 + 0] += src[fi * 2 + 0] * gainL;
+         mix[fi * 2 + 1] += src[fi * 2 + 1] * gainR;
+      }
+   }
+}
+
+// Zero outside the decoded frames.
+static float
+mixerSample(MixerChannel* ch, i64 frame, int c)
+{
+   return (frame >= 0 && frame < (i64)ch->numFrames) ? ch->samples[frame * ch->channels + c] : 0.0f;
+}
+
+// Catmull-Rom through p1 and p2, at t in [0, 1).
+static float
+mixerCubic(float p0, float p1, float p2, float p3, float t)
+{
+   float a = -0.5f * p0 + 1.5f * p1 - 1.5f * p2 + 0.5f * p3;
+   float b = p0 - 2.5f * p1 + 2.0f * p2 - 0.5f * p3;
+   float c = 0.5f * (p2 - p0);
+   return ((a * t + b) * t + c) * t + p1;
+}
+
+// numOut interleaved frames of ch, starting at its position.
+static void
+mixerResample(MixerChannel* ch, float* out, u64 numOut)
+{
+   const float fracScale = 1.0f / 4294967296.0f;
+   int channels = ch->channels;
+   for (u64 oi = 0; oi < numOut; ) {
+      u64 pos = ch->position + oi * ch->step;
+      i64 first = (i64)(pos >> 32);
+      i64 last = (i64)((pos + 3 * ch->step) >> 32);
+
+      if (oi + 4 <= numOut && first >= 1 && last + 2 < (i64)ch->numFrames) {
+         // Four frames at a time, away from the edges.
+         i64 idx[4];
+         float frac[4];
+         for (int k = 0; k < 4; ++k) {
+            u64 p = pos + k * ch->step;
+            idx[k] = (i64)(p >> 32) * channels;
+            frac[k] = (float)(p & 0xffffffff) * fracScale;
+         }
+         __m128 t = _mm_loadu_ps(frac);
+         for (int c = 0; c < channels; ++c) {
+            const i16* s = ch->samples + c;
+            #define MixerTap(o) _mm_setr_ps(s[idx[0] + (o)], s[idx[1] + (o)], s[idx[2] + (o)], s[idx[3] + (o)])
+            __m128 p0 = MixerTap(-channels);
+            __m128 p1 = MixerTap(0);
+            __m128 p2 = MixerTap(channels);
+            __m128 p3 = MixerTap(2 * channels);
+            #undef MixerTap
+
+            __m128 half = _mm_set1_ps(0.5f);
+            __m128 a = _mm_mul_ps(half, _mm_add_ps(_mm_sub_ps(p3, p0), _mm_mul_ps(_mm_set1_ps(3.0f), _mm_sub_ps(p1, p2))));
+            __m128 b = _mm_sub_ps(_mm_add_ps(p0, _mm_mul_ps(_mm_set1_ps(2.0f), p2)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.5f), p1), _mm_mul_ps(half, p3)));
+            __m128 cc = _mm_mul_ps(half, _mm_sub_ps(p2, p0));
+            __m128 y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(a, t), b), t), cc), t), p1);
+
+            float ys[4];
+            _mm_storeu_ps(ys, y);
+            for (int k = 0; k < 4; ++k) {
+               out[(oi + k) * channels + c] = ys[k];
+            }
+         }
+         oi += 4;
+      }
+      else {
+         float t = (float)(pos & 0xffffffff) * fracScale;
+         for (int c = 0; c < channels; ++c) {
+            out[oi * channels + c] = mixerCubic(mixerSample(ch, first - 1, c), mixerSample(ch, first, c),
+                                                 mixerSample(ch, first + 1, c), mixerSample(ch, first + 2, c), t);
+         }
+         oi += 1;
+      }
+   }
+}
+
+// Decodes the next block of a streamed sound after the frames the
+// interpolator still needs.
+static void
+mixerDecodeBlock(MixerChannel* ch)
+{
+   u64 frame = ch->position >> 32;
+   u64 keepFrom = Min(frame ? frame - 1 : 0, ch->numFrames);
+   u64 keep = ch->numFrames - keepFrom;
+   Assert(keep <= MixerHistoryFrames);
+
+   memmove(ch->decoded, ch->decoded + keepFrom * ch->channels, keep * ch->channels * sizeof(i16));
+   ch->position -= keepFrom << 32;
+
+   u64 maxSamples = MixerDecodeSamples - MixerDecodeSamples % ch->channels;
+   size_t read = mp3dec_ex_read(&ch->decoder, ch->decoded + keep * ch->channels, maxSamples);
+   ch->numFrames = keep + read / ch->channels;
+   ch->decodeDone = read == 0;
+}
+
+// Mixes the next numFrames of the channel, or only moves through them when it
+// can't be heard.
+static void
+mixerRenderChannel(AudioMixer* m, MixerChannel* ch, u32 numFrames, bool audible)
+{
+   const u64 unitStep = 1ull << 32;
+
+   u64 written = 0;
+   while (written < numFrames) {
+      u64 frame = ch->position >> 32;
+      bool needsDecode = ch->streamed && !ch->decodeDone;
+      if (needsDecode && frame + 2 >= ch->numFrames) {
+         mixerDecodeBlock(ch);
+         continue;
+      }
+      if (frame >= ch->numFrames) {
+         mixerFreeChannel(ch);
+         break;
+      }
+
+      // Up to where the interpolator would need frames that aren't decoded yet.
+      u64 limit = needsDecode ? ch->numFrames - 2 : ch->numFrames;
+      u64 n = ((limit << 32) - ch->position + ch->step - 1) / ch->step;
+      n = Min(n, numFrames - written);
+
+      if (audible) {
+         if (ch->step == unitStep && (ch->position & (unitStep - 1)) == 0) {
+            mixerAccumulate(m->mix + written * 2, ch->samples + frame * ch->channels, n, ch->channels, ch->gainL, ch->gainR);
+         }
+         else {
+            mixerResample(ch, m->resampled, n);
+            mixerAccumulateFloat(m->mix + written * 2, m->resampled, n, ch->channels, ch->gainL, ch->gainR);
+         }
+      }
+      ch->position += n * ch->step;
+      written += n;
+   }
+}
+
+void
+audioMixerRender(AudioMixer* m, i16* out, u32 numFrames)
+{
+   Assert(numFrames <= MixerMaxBlockFrames);
+
+   mixerApplyCommands(m);
+
+   memset(m->mix, 0, numFrames * 2 * sizeof(float));
+
+   // Pick the loudest channels.
+   bool audible[gKnobs.mixerChannels] = {};
+   for (u32 i = 0; i < gKnobs.mixerChannels; ++i) {
+      if (m->channels[i].id) {
+         mixerUpdateGains(m, m->channels + i);
+      }
+   }
+   u32 numAudible = 0;
+   for (; numAudible < gKnobs.mixerMaxAudible; ++numAudible) {
+      MixerChannel* loudest = nullptr;
+      for (u32 i = 0; i < gKnobs.mixerChannels; ++i) {
+         MixerChannel* ch = m->channels + i;
+         if (ch->id && !audible[i] && mixerLoudness(ch) >= gKnobs.audioMinGain &&
+             (!loudest || mixerLoudness(ch) > mixerLoudness(loudest))) {
+            loudest = ch;
+         }
+      }
+      if (!loudest) {
+         break;
+      }
+      audible[loudest - m->channels] = true;
+   }
+
+   u32 numPlaying = 0;
+   for (u32 i = 0; i < gKnobs.mixerChannels; ++i) {
+      MixerChannel* ch = m->channels + i;
+      if (ch->id) {
+         mixerRenderChannel(m, ch, numFrames, audible[i]);
+         numPlaying += ch->id != 0;
+      }
+   }
+
+   mixerToPcm(m->mix, out, numFrames * 2);
+
+   storeRelease(&m->numAudible, numAudible);
+   storeRelease(&m->numPlaying, numPlaying);
+}
+
+AudioRing
+audioRingCreate(u32 numFrames, Lifetime life)
+{
+   Assert(numFrames && (numFrames & (numFrames - 1)) == 0);
+
+   AudioRing r = {};
+   r.frames = AllocateArray(i16, numFrames * 2, life);
+   r.numFrames = numFrames;
+   return r;
+}
+
+// Producer. Up to numFrames contiguous frames at the write cursor; free space
+// past the end of the buffer comes back on the next call.
+static i16*
+audioRingWriteSpan(AudioRing* r, u32* numFrames)
+{
+   u32 write = r->writeCursor;
+   u32 space = r->numFrames - (write - loadAcquire(&r->readCursor));
+   u32 offset = write & (r->numFrames - 1);
+   *numFrames = Min(space, r->numFrames - offset);
+   return r->frames + offset * 2;
+}
+
+u32
+audioRingWrite(AudioRing* r, i16* frames, u32 numFrames)
+{
+   u32 written = 0;
+   while (written < numFrames) {
+      u32 span = 0;
+      i16* dst = audioRingWriteSpan(r, &span);
+      u32 n = Min(span, numFrames - written);
+      if (!n) {
+         break;
+      }
+      memcpy(dst, frames + written * 2, n * 2 * sizeof(i16));
+      written += n;
+      storeRelease(&r->writeCursor, r->writeCursor + n);
+   }
+   return written;
+}
+
+u32
+audioRingRead(AudioRing* r, i16* out, u32 numFrames)
+{
+   u32 read = 0;
+   while (read < numFrames) {
+      u32 cursor = r->readCursor;
+      u32 available = loadAcquire(&r->writeCursor) - cursor;
+      u32 offset = cursor & (r->numFrames - 1);
+      u32 n = Min(Min(available, r->numFrames - offset), numFrames - read);
+      if (!n) {
+         break;
+      }
+      memcpy(out + read * 2, r->frames + offset * 2, n * 2 * sizeof(i16));
+      read += n;
+      storeRelease(&r->readCursor, cursor + n);
+   }
+   return read;
+}
+
+void
+audioMixerFillRing(AudioMixer* m, AudioRing* r)
+{
+   // Mixed straight into the ring, a span at a time.
+   while (true) {
+      u32 span = 0;
+      i16* dst = audioRingWriteSpan(r, &span);
+      if (!span) {
+         break;
+      }
+      u32 n = Min(span, (u32)MixerMaxBlockFrames);
+      audioMixerRender(m, dst, n);
+      storeRelease(&r->writeCursor, r->writeCursor + n);
+   }
+}
+
+// WAV sink, for listening to the mixer without an audio device.
+bool
+audioMixerWriteWav(Platform* plat, AudioMixer* m, char* path, u32 numFrames)
+{
+#pragma pack(push, 1)
+   struct WavHeader
+   {
+      char riff[4];
+      u32 riffBytes;
+      char wave[4];
+      char fmt[4];
+      u32 fmtBytes;
+      u16 format;
+      u16 channels;
+      u32 hz;
+      u32 bytesPerSecond;
+      u16 blockAlign;
+      u16 bitsPerSample;
+      char data[4];
+      u32 dataBytes;
+   };
+#pragma pack(pop)
+
+   u32 dataBytes = numFrames * 2 * sizeof(i16);
+   u8* bytes = allocateBytes(sizeof(WavHeader) + dataBytes, Lifetime_Frame);
+
+   WavHeader* h = (WavHeader*)bytes;
+   memcpy(h->riff, "RIFF", 4);
+   h->riffBytes = sizeof(WavHeader) - 8 + dataBytes;
+   memcpy(h->wave, "WAVE", 4);
+   memcpy(h->fmt, "fmt ", 4);
+   h->fmtBytes = 16;
+   h->format = 1;  // PCM
+   h->channels = 2;
+   h->hz = gKnobs.mixerRate;
+   h->blockAlign = 2 * sizeof(i16);
+   h->bytesPerSecond = h->hz * h->blockAlign;
+   h->bitsPerSample = 16;
+   memcpy(h->data, "data", 4);
+   h->dataBytes = dataBytes;
+
+   i16* out = (i16*)(bytes + sizeof(WavHeader));
+   for (u32 rendered = 0; rendered < numFrames; rendered += gKnobs.mixerBlockFrames) {
+      u32 n = Min(gKnobs.mixerBlockFrames, numFrames - rendered);
+      audioMixerRender(m, out + rendered * 2, n);
+   }
+
+   return plat->writeFileAscii(path, bytes, sizeof(WavHeader) + dataBytes);
+}
@@ -1,17 +1,63 @@
 
+// XAudio2 output for the mixer.
+//
+// A mixer thread keeps gAudio->ring full. One source voice plays a ring of
+// blocks; each time XAudio is done with a block, its callback copies the next
+// one out of the ring, submits it again and wakes the mixer thread. When the
+// mixer falls behind, the block is padded with silence.
+
+struct AudioCallback;
+
 static struct
 {
   IXAudio2* xaudio;
-  AudioStream** sTransientStreams;
+  IXAudio2SourceVoice* voice;
+  AudioCallback* callback;
+  i16* blocks;  // gKnobs.mixerNumBlocks * gKnobs.mixerBlockFrames stereo frames
+  AudioMixer* mixer;
+  AudioRing ring;
+
+  HANDLE mixerThread;
+  HANDLE mixerWake;
+  volatile u32 mixerGeneration;  // The mixer thread exits when this changes.
+  u32 numUnderruns;  // XAudio thread only.
 } * gAudio;
 
-struct AudioStream
+static void audioSubmitBlock(u64 blockIdx);
+
+struct AudioCallback : IXAudio2VoiceCallback
 {
-   Lifetime life;
-   i32 numBuffersInFlight;
-   IXAudio2SourceVoice* voice;
+   void OnVoiceProcessingPassStart(UINT32 BytesRequired) final {}
+   void OnVoiceProcessingPassEnd() final {}
+   void OnStreamEnd() final {}
+   void OnBufferStart(void* pBufferContext) final {}
+   void OnBufferEnd(void* pBufferContext) final
+   {
+      audioSubmitBlock((u64)pBufferContext);
+      SetEvent(gAudio->mixerWake);
+   }
+   void OnLoopEnd(void* pBufferContext) final {}
+   void OnVoiceError(void* pBufferContext, HRESULT Error) final {}
 };
 
+DWORD WINAPI
+audioMixerThreadProc(LPVOID param)
+{
+   u32 generation = (u32)(u64)param;
+   while (loadAcquire(&gAudio->mixerGeneration) == generation) {
+      audioMixerFillRing(gAudio->mixer, &gAudio->ring);
+      WaitForSingleObject(gAudio->mixerWake, INFINITE);
+   }
+   return 0;
+}
+
+static void
+audioStartMixerThread()
+{
+   u32 generation = gAudio->mixerGeneration;
+   gAudio->mixerThread = CreateThread(0, 0, audioMixerThreadProc, (LPVOID)(u64)generation, 0, 0);
+}
+
 u64
 audioGlobalSize()
 {
@@ -23,11 +69,49 @@ void
 audioGlobalSet(u8* ptr)
 {
    gAudio = (decltype(gAudio))ptr;
+
+   // The vtable moves with the code.
+   if (gAudio->callback) {
+      new(gAudio->callback) AudioCallback;
+   }
+
+   // Old code stays loaded, but the mixer thread should run the new code.
+   if (gAudio->mixerThread) {
+      storeRelease(&gAudio->mixerGeneration, gAudio->mixerGeneration + 1);
+      SetEvent(gAudio->mixerWake);
+      WaitForSingleObject(gAudio->mixerThread, INFINITE);
+      CloseHandle(gAudio->mixerThread);
+      audioStartMixerThread();
+   }
+}
+
+static void
+audioSubmitBlock(u64 blockIdx)
+{
+   i16* block = gAudio->blocks + blockIdx * gKnobs.mixerBlockFrames * 2;
+   u32 numRead = audioRingRead(&gAudio->ring, block, gKnobs.mixerBlockFrames);
+   if (numRead < gKnobs.mixerBlockFrames) {
+      memset(block + numRead * 2, 0, (gKnobs.mixerBlockFrames - numRead) * 2 * sizeof(i16));
+      gAudio->numUnderruns++;
+   }
+
+   XAUDIO2_BUFFER buf = {};
+   buf.AudioBytes = gKnobs.mixerBlockFrames * 2 * sizeof(i16);
+   buf.pAudioData = (BYTE*)block;
+   buf.pContext = (void*)blockIdx;
+
+   gAudio->voice->SubmitSourceBuffer(&buf);
 }
 
 void
 audioInit()
 {
+   gAudio->mixer = audioMixerCreate(Lifetime_App);
+
+   if (gKnobs.audioOutput == AudioOutput_None) {
+      return;
+   }
+
    gAudio->xaudio = {};
    HRESULT res = XAudio2Create(
      &gAudio->xaudio,
@@ -44,114 +128,89 @@ audioInit()
        OutputDebugStringA("Could not create mastering voice");
        exit(-1);
    }
-}
-
-void audioStreamEnd(AudioStream* stream);
-
-struct AudioCallback : IXAudio2VoiceCallback
-{
-   AudioStream* stream;
-
-   void OnVoiceProcessingPassStart(UINT32 BytesRequired) final {}
-   void OnVoiceProcessingPassEnd() final {}
-   void OnStreamEnd() final {}
-   void OnBufferStart(void* pBufferContext) final {}
-   void OnBufferEnd(void* pBufferContext) final
-   {
-      stream->numBuffersInFlight--;
-   }
-   void OnLoopEnd(void* pBufferContext) final {}
-   void OnVoiceError(void* pBufferContext, HRESULT Error) final {}
-};
-
-AudioStream*
-audioStreamBegin(int hz, int channels)
-{
-   Lifetime life = lifetimeBegin();
-   auto* stream = AllocateElem(AudioStream, life);
-
-   stream->life = life;
 
    WAVEFORMATEX wfx = {};
 
    wfx.wFormatTag = WAVE_FORMAT_PCM;
-   wfx.nChannels = channels;
-   wfx.nSamplesPerSec = hz;
+   wfx.nChannels = 2;
+   wfx.nSamplesPerSec = gKnobs.mixerRate;
    wfx.wBitsPerSample = 16;
    wfx.nBlockAlign = wfx.wBitsPerSample * wfx.nChannels / 8;
    wfx.nAvgBytesPerSec = wfx.nBlockAlign * wfx.nSamplesPerSec;
    wfx.cbSize = 0;
 
-   AudioCallback* callback = AllocateElem(AudioCallback, stream->life);
+   gAudio->callback = AllocateElem(AudioCallback, Lifetime_App);
 
    // Construct the callback...
-   AudioCallback* toConstruct = new(callback) AudioCallback;
-
-   callback->stream = stream;
+   new(gAudio->callback) AudioCallback;
 
-
-   HRESULT hr;
-   if( FAILED(hr = gAudio->xaudio->CreateSourceVoice(
-                              &stream->voice,
+   if( FAILED(res = gAudio->xaudio->CreateSourceVoice(
+                              &gAudio->voice,
                               (WAVEFORMATEX*)&wfx,
                               0,  // flags
                               XAUDIO2_DEFAULT_FREQ_RATIO,
-                              callback ) ) ) {
+                              gAudio->callback ) ) ) {
       OutputDebugStringA("Could not create voice");
       exit(-1);
    }
 
-   return stream;
-}
+   // Mix the first blocks before the voice starts asking for them.
+   gAudio->ring = audioRingCreate(gKnobs.mixerRingFrames, Lifetime_App);
+   audioMixerFillRing(gAudio->mixer, &gAudio->ring);
 
-AudioStream*
-transientAudioStream(int hz, int channels)
-{
-   AudioStream* stream = audioStreamBegin(hz, channels);
+   gAudio->blocks = AllocateArray(i16, gKnobs.mixerNumBlocks * gKnobs.mixerBlockFrames * 2, Lifetime_App);
+   for (u64 blockIdx = 0; blockIdx < gKnobs.mixerNumBlocks; ++blockIdx) {
+      audioSubmitBlock(blockIdx);
+   }
 
-   arrpush(gAudio->sTransientStreams, stream);
+   gAudio->mixerWake = CreateEventA(0, FALSE, FALSE, 0);
+   audioStartMixerThread();
 
-   return stream;
+   gAudio->voice->Start(0);
 }
 
-void
-audioStreamEnd(AudioStream* stream)
+SoundId
+playSound(LoadedSound* snd, float gain, float pan)
 {
-   stream->voice->DestroyVoice();
+   return audioMixerPlay(gAudio->mixer, snd, gain, pan);
+}
 
-   lifetimeEnd(stream->life);
+SoundId
+playSoundAt(LoadedSound* snd, vec3 pos, float gain)
+{
+   return audioMixerPlayAt(gAudio->mixer, snd, pos, gain);
 }
 
 void
-submitAudioToStream(AudioStream* stream, i16* samples, int numBytes, bool endStream)
+setAudioListener(Camera* cam)
 {
-   stream->numBuffersInFlight++;
-
-   XAUDIO2_BUFFER buf = {};
-   buf.Flags = endStream ? XAUDIO2_END_OF_STREAM : 0;
-   buf.AudioBytes = numBytes;
-   buf.pAudioData = (BYTE*)samples;
-
-   stream->voice->SubmitSourceBuffer(&buf);
+   audioMixerSetListener(gAudio->mixer, cam);
+}
 
-   stream->voice->Start(0);
+void
+stopSound(SoundId id)
+{
+   audioMixerStop(gAudio->mixer, id);
 }
 
 void
-playAudio(i16* samples, int hz, int channels, int numBytes)
+setSoundParams(SoundId id, float gain, float pan)
 {
-   AudioStream* stream = transientAudioStream(hz, channels);
-   submitAudioToStream(stream, samples, numBytes, true);
+   audioMixerSetParams(gAudio->mixer, id, gain, pan);
 }
 
-void audioFrameEnd()
+void
+stopAllSounds()
 {
-   // Free up audio streams.
-   for (int i = 0; i < arrlen(gAudio->sTransientStreams); ++i) {
-      AudioStream* s = gAudio->sTransientStreams[i];
-      if (s->numBuffersInFlight == 0) {
-         audioStreamEnd(s);
-         arrdelswap(gAudio->sTransientStreams, i--);
-      }
+   // Without a mixer thread nothing reads the sounds.
+   if (!gAudio->mixerThread) {
+      return;
+   }
+   // The mixer thread takes commands every block, so a full queue empties soon.
+   while (!audioMixerStopAll(gAudio->mixer)) {
+      Sleep(1);
    }
-}
\ No newline at end of file
+   while (!audioMixerStoppedAll(gAudio->mixer)) {
+      Sleep(1);
+   }
+}
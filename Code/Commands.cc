@@ -42,6 +42,31 @@ commandPerform(Platform* plat, CommandsEnum cmd)
          gKnobs.useRaytracedShadows = !gKnobs.useRaytracedShadows;
       } break;
 
+      case Command_BuildAssetPack: {
+         // Loaded meshes may point into the open pack, and Windows won't overwrite a mapped file.
+         if (assetPackIsOpen()) {
+            logMsg("An asset pack is open. Delete " AssetPackName " and restart to build a new one.\n");
+         }
+         else {
+            char* dirs[] = { "JamAssets", "Assets" };
+            assetPackBuild(plat, assetPathForFrame(plat, "../" AssetPackName), dirs, ArrayCount(dirs));
+         }
+      } break;
+
+      case Command_Profiler: {
+         profileToggleSummary();
+      } break;
+
+      case Command_ExportProfile: {
+         char* path = assetPathForFrame(plat, "../profile.json");
+         if (profileExportChromeTrace(plat, path)) {
+            logMsg("Wrote %s. Open it in chrome://tracing or ui.perfetto.dev.\n", path);
+         }
+         else {
+            logMsg("Could not write %s\n", path);
+         }
+      } break;
+
       case Command_Quit: {
          plat->engineQuit();
       } break;
@@ -156,12 +181,13 @@ modeTick(Platform* plat)
       Finder* f = &gEditor->finder;
       immTextInput(plat, &f->sSearchString);
 
-      CommandsEnum selectedCmd = {};
-      char** sSortedCommands = finderComputeResults(f, Lifetime_Frame, &selectedCmd);
-      immList(sSortedCommands, arrlen(sSortedCommands), f->selectionIdx);
+      finderUpdateIndex(plat, f);
+      u64 selectedId = 0;
+      char** sResults = finderComputeResults(f, Lifetime_Frame, &selectedId);
+      immList(sResults, arrlen(sResults), f->selectionIdx);
 
-      if (keyJustPressed(plat, Key_Enter)) {
-         commandPerform(plat, selectedCmd);
+      if (keyJustPressed(plat, Key_Enter) && arrlen(sResults)) {
+         finderPerform(plat, selectedId);
       }
 
       if (keyJustPressed(plat, Key_Up)) {
@@ -172,10 +198,12 @@ modeTick(Platform* plat)
          f->selectionIdx += 1;
       }
 
-      while (f->selectionIdx < 0) {
-         f->selectionIdx += arrlen(sSortedCommands);
+      if (arrlen(sResults)) {
+         while (f->selectionIdx < 0) {
+            f->selectionIdx += arrlen(sResults);
+         }
+         f->selectionIdx %= arrlen(sResults);
       }
-      f->selectionIdx %= arrlen(sSortedCommands);
    }
    else if (modeIs(Mode_Fly)) {
       float delta = 0.1f;
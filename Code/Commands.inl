@@ -3,4 +3,7 @@ Command(Play, "Play")
 Command(Fly, "Fly")
 Command(Restart, "Restart")
 Command(RaytracedShadows, "Toggle raytraced shadows")
+Command(BuildAssetPack, "Build asset pack")
+Command(Profiler, "Toggle profiler")
+Command(ExportProfile, "Export profile trace")
 Command(Quit, "Quit")
@@ -80,6 +80,17 @@ typedef float f32;
 
 #define Export extern "C" __declspec(dllexport)
 
+// Handing data to another thread: write it, then storeRelease a flag or cursor.
+// The thread that sees the new value through loadAcquire also sees the data.
+#if defined(_MSC_VER)
+   // volatile accesses are acquires and releases with /volatile:ms, the x86/x64 default.
+   inline u32 loadAcquire(volatile u32* p) { return *p; }
+   inline void storeRelease(volatile u32* p, u32 v) { *p = v; }
+#else
+   inline u32 loadAcquire(volatile u32* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+   inline void storeRelease(volatile u32* p, u32 v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+#endif
+
 // Warning suppression
 #if defined(_MSC_VER)
 #pragma warning(push)
@@ -104,6 +115,12 @@ enum RunMode
    RunMode_Tests,
 };
 
+enum AudioOutput
+{
+   AudioOutput_XAudio2,
+   AudioOutput_None,  // No device and no mixer thread. Sounds queue up until the queue is full.
+};
+
 extern bool gGameJamBlackScreen;
 
 // Engine knobs
@@ -116,6 +133,8 @@ static struct EngineKnobs
    bool useRaytracedShadows = false;
    bool withRtx = false;
    int syncInterval = 1;
+   float lodPixelError = 1.0f;  // Coarsest mesh LOD whose projected error stays under this many pixels.
+   bool useMeshletCulling = true;  // Frustum and backface cone culling of meshlets in renderWorld.
 
    // Per-instance
    #if BuildMode(Debug)
@@ -141,18 +160,56 @@ static struct EngineKnobs
    static const int numRTVDescriptors = 512;
    static const int numDSVDescriptors = 512;
    static const int maxMaterials = 256;
+   static const u32 uiMaxQuads = 16384;  // Imm UI rects, glyphs and images per frame. u16 indices allow no more.
+   static const u32 uiMaxDraws = 64;  // Imm UI draw calls per frame. Commands that need another are dropped.
 
    // CPU constants
    static const u64 pageSize = Kilobytes(64);
    static const u64 apiLifetimeStackSize = 64;
    static const u64 maxExplicitLifetimes = 64;
+   static const u32 maxWorkerThreads = 8;
+   static const u32 workQueueSize = 256;
+   static const u32 uiTextCacheSize = 256;  // Imm UI strings whose layout is kept. The least recently used make way.
+   static const u32 uiTextCacheGlyphs = 64;  // Longer strings are laid out every time they are drawn.
+   static const u32 finderMaxResults = 32;  // Best finder matches that get sorted and shown.
+   static const u32 profilerRingEvents = 8192;  // Zones kept per thread. Power of two.
+   static const u32 profilerMaxThreads = 16;  // Threads that record zones. Later ones are not profiled.
+   static const u32 profilerMaxNodes = 256;  // Distinct zones per frame, all threads' trees together. Others are dropped.
 
    // Assets
    static const u32 maxLights = 32;
-   static const u32 fontOversampling = 4;  // 1 for no oversampling
+   static const int fontAtlasSize = 1024;  // Glyphs that don't fit are drawn empty.
+   static const u32 fontSdfPx = 32;  // Glyph size in the atlas. Other sizes scale it.
+   static const u32 fontSdfPadding = 4;  // Pixels of distance field around each glyph.
    static const u32 maxEdits = 100;
    static const u32 shadowResolution = 1024;
    static const u32 maxObjects = 256;
+   static const bool useMeshCache = true;  // Cook .obj files to a binary format next to the source.
+   static const bool optimizeMeshes = true;  // Reorder triangles and vertices when cooking.
+   static const u32 vertexCacheSize = 16;  // Post-transform cache size assumed by the mesh optimizer.
+   static const bool buildMeshLods = true;  // Simplify cooked meshes into a LOD chain.
+   static constexpr float lodReduction = 0.5f;  // Triangle ratio between LODs.
+   static constexpr float lodMaxError = 0.2f;  // Relative to the mesh extent. The chain stops there.
+   static const bool buildMeshlets = true;  // Group cooked triangles into meshlets for culling.
+   static const u32 meshletMaxVerts = 64;
+   static const u32 meshletMaxTris = 124;
+   static const bool loadAssetsAsync = true;  // Load on worker threads. Otherwise assetLoadAsync loads right away.
+   static const bool useAssetPack = true;  // Read assets from assets.pack when it exists.
+   static const bool compressAssetPack = true;  // LZ4 for the files that shrink enough when building the pack.
+   static const int streamSoundsAboveBytes = Kilobytes(16);  // Longer sounds are decoded while they play.
+   static const u32 mp3SegmentSamples = 16384;  // Shortest mp3 segment worth a job. Each one decodes two extra frames to start.
+
+   // Audio
+   static const AudioOutput audioOutput = AudioOutput_XAudio2;
+   static const u32 mixerChannels = 32;  // Sounds playing at once. The quietest make way for louder ones.
+   static const u32 mixerMaxAudible = 16;  // Only the loudest channels are mixed.
+   static constexpr float audioMinGain = 0.001f;  // Quieter channels aren't mixed.
+   static constexpr float audioRefDistance = 6.0f;  // Full gain up to this far from the camera, then 1/distance. The game camera is about 6 m from the player.
+   static const int mixerRate = 44100;
+   static const u32 mixerBlockFrames = 1024;  // About 23 ms per block.
+   static const u32 mixerNumBlocks = 2;  // Queued on the voice.
+   static const u32 mixerRingFrames = 2048;  // Mixed ahead of the voice. Power of two.
+   static const u32 audioCommandQueueSize = 256;  // Power of two. Commands past this are dropped.
 } gKnobs;
 
 // ================================
@@ -189,6 +246,20 @@ void freePages(const Lifetime life);
 Lifetime lifetimeBegin();
 void lifetimeEnd(Lifetime life);
 
+// Allocations from worker threads. Between jobMemoryBegin and jobMemoryEnd
+// every allocation on the calling thread goes to a private heap. Once the job
+// is done, jobMemoryAdopt on the main thread moves the pages to the main heaps,
+// by lifetime.
+struct JobMemory;
+JobMemory* jobMemoryBegin();
+void jobMemoryEnd();
+void jobMemoryAdopt(JobMemory* job);
+
+// Runs proc on each of numJobs jobs, jobSize bytes apart, on the work queue.
+// Returns once those are done; unlike completeAllWork it doesn't wait for the
+// rest of the queue. Main thread only, like addWork.
+void runJobs(Platform* plat, PlatformWorkProc* proc, void* jobs, sz jobSize, u32 numJobs);
+
 // Globals
 u64 memoryGlobalsSize();
 void memoryGlobalsSet(u8* ptr);
@@ -259,6 +330,44 @@ typedef PlatformLogProcDef(PlatformLogProc);
 #define PlatformGetClientRectProcDef(name) void name(int* w, int* h)
 typedef PlatformGetClientRectProcDef(PlatformGetClientRectProc);
 
+// Read-only view of a whole file. Returns null if the file can't be opened.
+#define PlatformMapFileAsciiProcDef(name) u8* name(char* fname, u64* outBytes)
+typedef PlatformMapFileAsciiProcDef(PlatformMapFileAsciiProc);
+
+#define PlatformUnmapFileProcDef(name) void name(u8* data)
+typedef PlatformUnmapFileProcDef(PlatformUnmapFileProc);
+
+#define PlatformWriteFileAsciiProcDef(name) bool name(char* fname, u8* data, u64 numBytes)
+typedef PlatformWriteFileAsciiProcDef(PlatformWriteFileAsciiProc);
+
+// Drops the file's pages from the OS file cache, for cold start timings. Has
+// no effect while the file is mapped. Returns false if the file can't be opened.
+#define PlatformEvictFileCacheAsciiProcDef(name) bool name(char* fname)
+typedef PlatformEvictFileCacheAsciiProcDef(PlatformEvictFileCacheAsciiProc);
+
+// Fails while the file is open or mapped.
+#define PlatformDeleteFileAsciiProcDef(name) bool name(char* fname)
+typedef PlatformDeleteFileAsciiProcDef(PlatformDeleteFileAsciiProc);
+
+// Names of the files in a folder, not recursive. Returns the total count, which can be more than maxNames.
+#define PlatformListFilesAsciiProcDef(name) u64 name(char* dir, char (*outNames)[MaxPath], u64 maxNames)
+typedef PlatformListFilesAsciiProcDef(PlatformListFilesAsciiProc);
+
+// Work queue. Work is added from the main thread and picked up by the worker
+// threads. completeAllWork() makes the calling thread help until the queue is drained.
+// helpWithWork() runs at most one entry, returning false when there was none to take.
+#define PlatformWorkProcDef(name) void name(void* data)
+typedef PlatformWorkProcDef(PlatformWorkProc);
+
+#define PlatformAddWorkProcDef(name) void name(PlatformWorkProc* proc, void* data)
+typedef PlatformAddWorkProcDef(PlatformAddWorkProc);
+
+#define PlatformCompleteAllWorkProcDef(name) void name()
+typedef PlatformCompleteAllWorkProcDef(PlatformCompleteAllWorkProc);
+
+#define PlatformHelpWithWorkProcDef(name) bool name()
+typedef PlatformHelpWithWorkProcDef(PlatformHelpWithWorkProc);
+
 struct Platform
 {
    RunMode runMode;
@@ -266,11 +375,18 @@ struct Platform
    int windowRectR;  // TODO: GAME JAM HACK
    int windowRectT;  // TODO: GAME JAM HACK
    int windowRectB;  // TODO: GAME JAM HACK
+   int numWorkerThreads;
 
    PlatformFnameAtExeAsciiProc* fnameAtExeAscii;
    PlatformFnameAtExeProc* fnameAtExe;
    PlatformFileContentsAsciiProc* fileContentsAscii;
    PlatformFileSizeAsciiProc* fileSizeAscii;
+   PlatformMapFileAsciiProc* mapFileAscii;
+   PlatformUnmapFileProc* unmapFile;
+   PlatformWriteFileAsciiProc* writeFileAscii;
+   PlatformEvictFileCacheAsciiProc* evictFileCacheAscii;
+   PlatformDeleteFileAsciiProc* deleteFileAscii;
+   PlatformListFilesAsciiProc* listFilesAscii;
    PlatfromToPlatStrProc* toPlatStr;
    PlatformGetPlatformErrorProc* getPlatformError;
    PlatformEngineQuitProc* engineQuit;
@@ -279,6 +395,9 @@ struct Platform
    PlatformGetInputProc* getInput;
    GetMicrosecondsProc* getMicroseconds;
    PlatformLogProc* consoleLog;
+   PlatformAddWorkProc* addWork;
+   PlatformCompleteAllWorkProc* completeAllWork;
+   PlatformHelpWithWorkProc* helpWithWork;
 };
 
 // Memory for global systems
@@ -293,6 +412,9 @@ enum GlobalTable
    GlobalTable_Tests,
    GlobalTable_Editor,
    GlobalTable_Gameplay,
+   GlobalTable_Assets,
+   GlobalTable_AssetPack,
+   GlobalTable_Profiler,
 
    GlobalTable_Count
 };
@@ -310,6 +432,50 @@ void logMsg(char* msg, ...);
 
 u64 logGlobalSize();
 void logGlobalSet(u8*);
+
+// ================================
+// Profiler
+// ================================
+
+// A zone of the calling thread, from profileBegin to the matching profileEnd.
+// Zones nest. The name is kept, so it should be a string literal.
+void           profileBegin(char* name);
+void           profileEnd();
+
+// Times the rest of the enclosing scope, so that every return ends the zone.
+// The one exception to the no-RAII rule; it does nothing but call the two above.
+#define ProfileZone(name) ProfileScope ProfileScopeVar(__LINE__)(name)
+#define ProfileScopeVar(line) ProfileScopeVar2(line)
+#define ProfileScopeVar2(line) profileScope##line
+
+struct ProfileScope
+{
+   ProfileScope(char* name) { profileBegin(name); }
+   ~ProfileScope() { profileEnd(); }
+};
+
+// A zone of the last frame, with all its calls under the same parent added up.
+// The roots are the threads.
+struct ProfileNode
+{
+   char* name;
+   i32 parent;
+   i32 firstChild;
+   i32 nextSibling;
+   u32 calls;
+   u64 ticks;
+};
+
+void           profileInit(Platform* plat);  // On the main thread.
+void           profileNewFrame();  // Nests the zones that ended since the last call. Once a frame, on the main thread.
+ProfileNode*   profileFindZone(ProfileNode* parent, char* name);  // Null parent for a thread.
+double         profileZoneMs(ProfileNode* node);
+void           profileToggleSummary();
+void           profileDrawSummary();  // The last frame's zones through the imm UI, when toggled on.
+bool           profileExportChromeTrace(Platform* plat, char* path);  // The zones still in the ring buffers, for chrome://tracing or Perfetto.
+
+u64 profileGlobalSize();
+void profileGlobalSet(u8*);
 // ================================
 // Input
 // ================================
@@ -384,18 +550,53 @@ void testGlobalSet(u8* ptr);
 // Audio
 // ================================
 
-struct AudioStream;
-
 void audioInit();
-void audioFrameEnd();
 
-// Simple api. Just call this and the samples will play.
-void playAudio(i16* samples, int hz, int channels, int numBytes);
-
-// More complex api.
-AudioStream* audioStreamBegin(int hz, int channels);
-void submitAudioToStream(AudioStream* stream, i16* samples, int numBytes, bool endStream);
-void audioStreamEnd(AudioStream* stream);
+// Plays a sound from mp3Load, decoding it on the way if it's streamed.
+// pan goes from -1 (left) to 1 (right). Returns 0 if the sound can't play.
+struct LoadedSound;
+struct Camera;
+struct vec3;
+typedef u32 SoundId;
+SoundId playSound(LoadedSound* snd, float gain = 1.0f, float pan = 0.0f);
+// Gain and pan follow the listener, set once a frame from the camera.
+SoundId playSoundAt(LoadedSound* snd, vec3 pos, float gain = 1.0f);
+void setAudioListener(Camera* cam);
+void stopSound(SoundId id);
+void setSoundParams(SoundId id, float gain, float pan);
+void stopAllSounds();  // Waits until nothing plays. Before freeing the memory sounds play from.
+
+// The mixer behind playSound. Play, stop and parameter changes go through a
+// queue from one game thread to one mixing thread; neither waits on the other.
+// Play copies the LoadedSound, but not the samples or mp3 it points to.
+struct AudioMixer;
+AudioMixer* audioMixerCreate(Lifetime life);
+// Game thread. These fail when the queue is full.
+SoundId audioMixerPlay(AudioMixer* m, LoadedSound* snd, float gain, float pan);
+SoundId audioMixerPlayAt(AudioMixer* m, LoadedSound* snd, vec3 pos, float gain);
+bool audioMixerSetListener(AudioMixer* m, Camera* cam);
+bool audioMixerStop(AudioMixer* m, SoundId id);
+bool audioMixerStopAll(AudioMixer* m);
+bool audioMixerStoppedAll(AudioMixer* m);  // True once the mixing thread has applied every StopAll sent.
+bool audioMixerSetParams(AudioMixer* m, SoundId id, float gain, float pan);
+u32 audioMixerNumPlaying(AudioMixer* m);  // As of the last render.
+u32 audioMixerNumAudible(AudioMixer* m);
+// Mixing thread.
+void audioMixerRender(AudioMixer* m, i16* out, u32 numFrames);  // Interleaved stereo
+bool audioMixerWriteWav(Platform* plat, AudioMixer* m, char* path, u32 numFrames);
+
+// Mixed audio on its way to the device. One thread writes, one thread reads.
+struct AudioRing
+{
+   i16* frames;  // Interleaved stereo
+   u32 numFrames;  // Power of two
+   volatile u32 writeCursor;  // In frames, wrapping at 2^32.
+   volatile u32 readCursor;
+};
+AudioRing audioRingCreate(u32 numFrames, Lifetime life);
+u32 audioRingWrite(AudioRing* r, i16* frames, u32 numFrames);  // Returns the frames written.
+u32 audioRingRead(AudioRing* r, i16* out, u32 numFrames);  // Returns the frames read.
+void audioMixerFillRing(AudioMixer* m, AudioRing* r);  // Mixes until the ring is full.
 
 // Globals
 u64 audioGlobalSize();
@@ -483,6 +684,12 @@ struct AABB
    vec3 max;
 };
 
+// Points with dot(plane.xyz, p) + plane.w >= 0 are inside. Planes are normalized.
+struct Frustum
+{
+   vec4 planes[6];
+};
+
 
 vec4  row(const mat4& m, int j);
 float lerp(float a, float b, float interp);
@@ -514,6 +721,20 @@ mat4  mat4Inverse(const mat4& m);
 mat4  mat4Persp(const Camera* c, float aspect);
 mat4  mat4Orientation(vec3 pos, vec3 dir, vec3 up);
 float signedArea(vec2 a, vec2 b, vec2 c);
+// Planes of the clip volume of a view projection matrix, in the space the matrix transforms from.
+Frustum frustumFromMatrix(const mat4& viewProjection);
+bool  frustumTestSphere(const Frustum* f, vec3 center, float radius);
+
+// Vertex compression.
+// Octahedral normals in two snorm16: max angular error ~0.004 degrees.
+// Halves: relative error <= 2^-11, exact for integer/2048 texcoords.
+// RGBA8: error <= 1/510 per channel.
+u32   octEncodeNormal(vec3 n);
+vec3  octDecodeNormal(u32 packed);
+u16   floatToHalf(float f);
+float halfToFloat(u16 h);
+u32   packColorRGBA8(vec4 c);
+vec4  unpackColorRGBA8(u32 packed);
 float sign(float x);
 
 // ==== vec2 operators
@@ -791,13 +1012,13 @@ struct Camera
    vec3 up;
 };
 
-// How vertices are packed in the GPU
+// How vertices are packed in the GPU. 24 bytes.
 struct MeshRenderVertex
 {
-   vec4 position;
-   vec2 texcoord;
-   vec3 normal;
-   vec4 color;
+   vec3 position;  // The input assembler fills in w = 1
+   u32 normal;  // Octahedral, R16G16_SNORM. See octEncodeNormal.
+   u16 texcoord[2];  // R16G16_FLOAT
+   u32 color;  // R8G8B8A8_UNORM
 };
 
 __declspec(align(16))
@@ -887,6 +1108,12 @@ struct RenderMesh
    sz vertexBytes;
    sz indexBytes;
    u64 numIndices;
+   u32 indexSize;  // 2 or 4 bytes
+   u32 refCount;  // Render handles sharing the buffers. See instanceMeshOnGPU.
+
+   // Range in the world renderer's meshlets, covering LOD 0. See drawMeshCulled.
+   u64 firstMeshlet;
+   u64 numMeshlets;
 };
 
 enum BlobEditType
@@ -935,6 +1162,7 @@ enum CreateResourceFlags
 ResourceHandle    gpuCreateResource(size_t numBytes, char* debugName = nullptr, GPUHeapType heapType = GPUHeapType_Upload, ResourceState state = ResourceState_GenericRead, u32 alignment = 0, CreateResourceFlags flags = CreateResourceFlags_None);
 void              gpuSetResourceData(ResourceHandle resHnd, const void* data, size_t numBytes);
 void              gpuSetResourceDataAtOffset(ResourceHandle resHnd, const void* data, size_t numBytes, const sz offset);
+u8*               gpuMapResource(ResourceHandle resHnd);  // Upload heap only. Stays mapped; write, don't read.
 void              gpuUploadBufferAtOffset(ResourceHandle destResource, const u8* data, const sz size, const sz offset);
 void              gpuUploadBuffer(ResourceHandle destResource, const u8* data, const sz size);
 void              gpuBarrierForResource(ResourceHandle resource, ResourceState before, ResourceState after);
@@ -953,6 +1181,7 @@ enum CubeFace
 
 Texture2D         gpuCreateTexture2D(int width, int height, bool withUAV, TextureFormat format = TextureFormat::R8G8B8A8_UNORM, ResourceState state = ResourceState_CopyDest);
 Texture2D         gpuUploadTexture2D(const int width, const int height, const int bytesPerPixel, const u8* data);
+void              gpuUpdateTexture2D(Texture2D tex, const int x, const int y, const int width, const int height, const int bytesPerPixel, const u8* data, const sz dataRowPitch);  // Part of a gpuUploadTexture2D texture.
 Texture3D         gpuCreateTexture3D(const int width, const int height, const int depth);
 TextureCube       gpuCreateTextureCube(int width, int height, TextureFormat formatDesc, ResourceState stateDesc);
 
@@ -979,7 +1208,7 @@ struct RaytracingPSODesc
 };
 
 // Acceleration structure. BLAS live in object instances, TLAS are per-frame.
-BLASHandle        gpuMakeBLAS(ResourceHandle vertexBuffer, u64 numVerts, u64 vertexStride, ResourceHandle indexBuffer, u64 numIndices);
+BLASHandle        gpuMakeBLAS(ResourceHandle vertexBuffer, u64 numVerts, u64 vertexStride, ResourceHandle indexBuffer, u64 numIndices, u32 indexSize = sizeof(u32));
 TLAS*             gpuCreateTLAS(u64 maxNumInstances);
 void              gpuAppendToTLAS(TLAS* bvh, BLASHandle h, mat4 transform);
 void              gpuBuildTLAS(TLAS* bvh);
@@ -1024,8 +1253,8 @@ void              gpuDispatchRays();
 void              gpuSetPipelineState(PipelineStateHandle pso);
 void              gpuSetGraphicsConstantSlot(int slot, ResourceHandle resource);
 void              gpuSetComputeConstantSlot(int slot, ResourceHandle resource);
-void              gpuSetVertexAndIndexBuffers(ResourceHandle vertexBuffer, u64 vertexBytes, ResourceHandle indexBuffer, u64 indexBytes);
-void              gpuDrawIndexed(u64 numIndices);
+void              gpuSetVertexAndIndexBuffers(ResourceHandle vertexBuffer, u64 vertexBytes, ResourceHandle indexBuffer, u64 indexBytes, u32 indexSize);
+void              gpuDrawIndexed(u64 numIndices, u64 firstIndex = 0);
 
 // Debug/Profile markers
 void              gpuBeginMarker(char* label);
@@ -1076,6 +1305,35 @@ struct ShaderCode
 
 struct Mesh;
 
+#define MaxMeshLods 4
+
+// A range of the index buffer. All LODs of a mesh share its vertices.
+struct MeshLod
+{
+   u64 firstIndex;
+   u64 numIndices;
+   float error;  // Relative to the mesh extent. 0 for the full mesh.
+};
+
+// A contiguous run of LOD 0 triangles, with at most gKnobs.meshletMaxVerts
+// distinct vertices and gKnobs.meshletMaxTris triangles. Bounds are in object space.
+// See meshBuildMeshlets.
+struct Meshlet
+{
+   u64 firstIndex;
+   u32 numTris;
+   u32 numVerts;
+
+   vec3 center;  // Bounding sphere
+   float radius;
+
+   // Backface cone. All triangles face away from eyes where
+   // dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius.
+   // A cutoff of 1 never culls.
+   vec3 coneAxis;
+   float coneCutoff;
+};
+
 struct MeshRenderHandle
 {
    MaterialHandle materialHandle;
@@ -1083,6 +1341,9 @@ struct MeshRenderHandle
    u64 renderMeshIdx;
    u64 transformIdx;
    ResourceHandle* sShadowResources;
+
+   u32 numLods;
+   MeshLod lods[MaxMeshLods];
 };
 
 struct BlobRenderHandle
@@ -1121,6 +1382,7 @@ vec4 screenToWorld(Camera* cam, float x, float y);
 
 void              worldRenderInit(Platform* plat);
 void              wrDispose();
+void              wrDisposeWorld();  // Before the world's memory is freed.
 void              wrResize(int w, int h);
 
 void              setupPipelineStates(ShaderCode* shaderCode);
@@ -1131,12 +1393,18 @@ MaterialHandle    makeMaterial();
 void              renderWorld();
 
 // Upload world objects to GPU
+MeshRenderVertex* packRenderVerts(const Mesh* m, Lifetime life);
 MeshRenderHandle  uploadMeshesToGPU(const Mesh* meshes, sz nMeshes, bool withMaterial = true, bool withBLAS = true);
 MeshRenderHandle  uploadMeshToGPU(MeshRenderVertex* sVerts, u32* sIndices, bool withMaterial = true, bool withBLAS = true);
 MeshRenderHandle  uploadMeshToGPU(const Mesh& mesh, bool withMaterial = true, bool withBLAS = true);
+// Buffers only, holding one reference to them. Not drawable; see instanceMeshOnGPU.
+MeshRenderHandle  uploadSharedMeshToGPU(const Mesh& mesh, bool withBLAS = true);
+// New handle with its own material, transform and shadow constants, sharing the buffers, BLAS, LODs and meshlets of `shared`.
+MeshRenderHandle  instanceMeshOnGPU(MeshRenderHandle shared, bool withMaterial = true);
 BlobRenderHandle  uploadBlobToGPU(const Blob& b);
 
 u64               setMeshForDraw(MeshRenderHandle rh);
+MeshLod           selectMeshLod(MeshRenderHandle rh, ObjectHandle h, vec3 eye, float fov, float viewportHeight);
 
 BLASHandle        getBLAS(ObjectHandle h);
 
@@ -1167,23 +1435,141 @@ struct Mesh
    vec2* sTexcoords;
    vec4* sColors;
    u32* sIndices;
+
+   // Set for meshes loaded from the cooked cache. They point into the mapped
+   // cache file and are uploaded as they are, without repacking.
+   // Set cookedVerts to null after editing the arrays above.
+   MeshRenderVertex* cookedVerts;
+   void* cookedIndices;
+   u32 cookedIndexSize;  // 2 or 4 bytes
+   AABB cookedBounds;
+   u8* cookedMapping;  // The loose cooked file, when they point into one. See meshUnmapCooked.
+
+   // lods[0] is the full mesh. Coarser LODs follow it in sIndices, past numIndices.
+   // 0 means the mesh has no LOD chain.
+   u32 numLods;
+   MeshLod lods[MaxMeshLods];
+
+   // Partition of the first numIndices of sIndices. 0 means the mesh has no meshlets.
+   Meshlet* sMeshlets;
+   u64 numMeshlets;
 };
 
 Mesh makeQuad(f32 cx, f32 cy, f32 w, f32 h, f32 z, vec4 color, Lifetime life, WindingOrder winding = Winding_CW);
 Mesh makeQuad(float side, float z, Lifetime life, WindingOrder winding = Winding_CW);
+Mesh meshCopy(const Mesh& m, Lifetime life);
+
+struct VertexCacheStats
+{
+   float acmr;  // Vertices transformed per triangle. 3 is worst, ~0.5 is optimal for closed meshes.
+   float atvr;  // Vertices transformed per vertex. 1 is optimal.
+};
+
+// Simulates a FIFO post-transform cache with cacheSize entries.
+VertexCacheStats meshVertexCacheStats(const u32* indices, u64 numIndices, u64 numVerts, u32 cacheSize);
+// Reorders triangles for the vertex cache (Tipsify), then clusters for overdraw, then vertices by first use.
+void meshOptimize(Mesh* m);
+// Quadric error simplification by edge collapse onto existing vertices. Keeps borders and UV seams.
+// Stops at targetIndices or when the error, relative to the mesh extent, would pass targetError.
+// outIndices needs room for numIndices. Returns the number of indices written.
+u64 meshSimplify(const Mesh* m, const u32* indices, u64 numIndices, u64 targetIndices, float targetError, u32* outIndices, float* outError);
+// Appends a LOD chain to m->sIndices. Call after meshOptimize, which would reorder the vertices.
+void meshBuildLods(Mesh* m, Lifetime life);
+// Reorders the first numIndices of m->sIndices into meshlets and fills m->sMeshlets.
+// Call after meshOptimize and before meshBuildLods.
+void meshBuildMeshlets(Mesh* m, Lifetime life);
+// Recomputes the bounds and cone of ml from the current positions.
+void meshletComputeBounds(const Mesh* m, Meshlet* ml);
+// eye and frustum in object space. Backface culling is conservative: a culled meshlet has no front faces.
+bool meshletIsVisible(const Meshlet* ml, const Frustum* f, vec3 eye, bool cullBackfaces);
 Mesh objLoad(Platform* plat, char* path, Lifetime life);  // TODO: Switch to 3rd party solution.
+Mesh objLoadFromBytes(Platform* plat, u8* data, u64 numBytes, Lifetime life, u32 numThreads);
+Mesh objLoadCached(Platform* plat, char* path, Lifetime life);  // objLoad through the cooked mesh cache.
+void meshUnmapCooked(Platform* plat, Mesh* m);  // Once the cooked data is uploaded. The CPU arrays stay.
 bool rayTriangleIntersection(vec3 o, vec3 d, vec4* positions, u32* indices, size_t numIndices, float* outT = NULL);
 
 struct LoadedSound
 {
-   i16* samples;
+   i16* samples;  // Null when streamed.
    int hz;
    int channels;
-   int numBytes;
+   int numBytes;  // Decoded size
+
+   // Streamed sounds keep the mp3 and decode it while they play.
+   u8* mp3;
+   u64 mp3Bytes;
 };
 
 // TODO: Separate system for this?
 LoadedSound mp3Load(Platform* plat, char* pathToMp3, Lifetime life);
+// Decodes on every thread, splitting long sounds into segments of at least
+// segmentSamples. Same samples as mp3Load. Main thread only.
+void mp3LoadBatch(Platform* plat, char** paths, LoadedSound* outSounds, u64 numSounds, Lifetime life, u64 segmentSamples = gKnobs.mp3SegmentSamples);
+
+
+// ================================
+// Assets
+// ================================
+
+struct MeshAssetHandle { u64 idx; };  // 0 is invalid
+
+// Loads the mesh and uploads it to the GPU the first time a path or its contents are seen.
+// Release when done; disposeWorld drops whatever is left.
+MeshAssetHandle   acquireMeshAsset(Platform* plat, char* path);
+void              releaseMeshAsset(MeshAssetHandle h);
+// Shared; use meshCopy before editing.
+const Mesh*       meshAsset(MeshAssetHandle h);
+MeshRenderHandle  meshAssetRenderHandle(MeshAssetHandle h);
+AABB              meshAssetBounds(MeshAssetHandle h);
+MeshAssetHandle   meshAssetForPath(char* path);  // 0 when nothing was loaded from the path. Doesn't load or add a reference.
+// Drops every asset. Called by disposeWorld.
+void              disposeMeshAssets();
+
+// Background loading. Files are read, parsed and decoded on worker threads;
+// GPU uploads happen on the main thread in assetsUpdate, at the start of the
+// next frame, or in assetWait. Take the result once to free the handle.
+#define MaxAssetLoads 64
+
+enum AssetType
+{
+   AssetType_Mesh,
+   AssetType_Sound,
+   AssetType_Font,
+};
+
+struct AssetLoadHandle { u64 idx; };  // 0 is invalid
+
+struct Font;
+
+AssetLoadHandle   assetLoadAsync(Platform* plat, char* path, AssetType type);
+// Fills in *font. It must stay alive until the load is taken.
+AssetLoadHandle   assetLoadFontAsync(Platform* plat, Font* font, char* path, float* customSizes = NULL);
+bool              assetPoll(AssetLoadHandle h);  // True once the asset can be taken without waiting.
+void              assetWait(AssetLoadHandle h);
+MeshAssetHandle   assetTakeMesh(AssetLoadHandle h);  // Waits if needed. Release the mesh when done.
+LoadedSound       assetTakeSound(AssetLoadHandle h);
+Font*             assetTakeFont(AssetLoadHandle h);
+void              assetsUpdate();  // Finishes the loads that are done. Called once per frame.
+
+u64 assetsGlobalSize();
+void assetsGlobalSet(u8* ptr);
+
+// Asset pack: one mapped file with the asset folders in it.
+#define AssetPackName "assets.pack"
+
+bool  assetPackOpen(Platform* plat, char* packPath);
+bool  assetPackIsOpen();
+void  assetPackClose(Platform* plat);  // Meshes loaded from the pack may still point into it.
+// Packs the folders next to packPath. dirs are relative to it.
+bool  assetPackBuild(Platform* plat, char* packPath, char** dirs, u64 numDirs);
+// In-place view of a packed file. Null if it isn't packed, or compressed.
+u8*   assetPackView(char* path, u64* outBytes);
+// Replaces plat->fileContentsAscii for assets. Reads from the pack, or from
+// disk for files that aren't packed. Read-only: it may point into the pack.
+u64   assetFileContents(Platform* plat, char* path, u8*& data, Lifetime life);
+
+u64 assetPackGlobalSize();
+void assetPackGlobalSet(u8* ptr);
 
 
 // ================================
@@ -1221,12 +1607,14 @@ struct WorldObjectRenderHandle
 
 struct World
 {
+   u64 generation;  // Counts the worlds made. A new world can get an old one's memory.
    Camera cam;
 
    u64 numObjects;
    WorldObject objects[gKnobs.maxObjects];
    WorldObjectRenderHandle renderHandles[gKnobs.maxObjects];
    AABB boundingBoxes[gKnobs.maxObjects];
+   MeshAssetHandle meshAssets[gKnobs.maxObjects];  // 0 for objects with their own mesh.
 #if BuildMode(Debug)
    char* debugNames[gKnobs.maxObjects];
 #endif
@@ -1242,6 +1630,10 @@ void                       setWorld(World*);
 mat4                       transformForObject(ObjectHandle h);
 void                       setTransformForObject(ObjectHandle h, mat4 transform);
 ObjectHandle               addMeshToWorld(Mesh mesh, char* debugName = NULL);
+ObjectHandle               addMeshAssetToWorld(MeshAssetHandle asset, char* debugName = NULL);  // Shares the asset's GPU buffers.
+ObjectHandle               findObjectWithMeshAsset(MeshAssetHandle asset);  // The first one. 0 when there is none.
+void                       focusCameraOnObject(ObjectHandle h);
+AABB                       computeBoundingBox(const Mesh& m);
 ObjectHandle               newBlob();
 Blob*                      beginBlobEdit(ObjectHandle h);
 void                       endBlobEdit();
@@ -1272,20 +1664,63 @@ enum FontSize
    FontSize_Venti = FontSize_Big,
 };
 
+// Glyphs are rasterized once, as signed distance fields, and scaled to any size.
+struct FontGlyph
+{
+   u16 x, y, w, h;  // In the atlas. Empty for glyphs without a shape, like space.
+   f32 xoff, yoff;  // From the pen to the top left. In pixels at gKnobs.fontSdfPx, like the rest.
+   f32 advance;
+};
+
 struct Font
 {
-   Mesh atlasMesh;
-   MeshRenderHandle rmesh;
+   void* info;  // stbtt_fontinfo over the font file.
+   u64 fileHash[2];  // MeowHash of the font file. Keys the atlas cache on disk.
+   char cachePath[MaxPath];  // Empty for fonts without a disk cache.
+   Lifetime life;  // Of the font file, the atlas and the glyph table.
+
+   struct GlyphHM
+   {
+      u32 key;  // Code point
+      FontGlyph value;
+   } *hmGlyphs;
+   bool glyphsAdded;  // Since the cache was read or written.
+
+   // One channel. Kept on the CPU for partial uploads and the disk cache.
    int atlasSize;
+   u8* atlasPixels;
    Texture2D atlasTexture;
+   int shelfX, shelfY, shelfHeight;  // Shelf packing: left to right, then a new shelf below.
+   int dirtyX0, dirtyY0, dirtyX1, dirtyY1;  // Pixels not uploaded yet. Empty when x1 <= x0.
 
-   int numChars;
    float fontSizesPx[FontSize_Count];
-   void* packedData[FontSize_Count];
 };
 
 void           fontInit(Platform* plat, Font* t, char* fontPath, float customSizes[FontSize_Count] = NULL);
-void           fontDeinit(Font* t);
+// The two halves of fontInit. Loading is CPU only and can run on a worker; see assetLoadFontAsync.
+// Worker threads must pass numThreads = 1; only the main thread can add work.
+// Only Lifetime_App fonts read and write the atlas cache on disk.
+bool           fontLoad(Platform* plat, Font* t, char* fontPath, float customSizes[FontSize_Count], u32 numThreads, Lifetime life = Lifetime_App);
+void           fontUploadAtlas(Font* t);
+FontGlyph*     fontGlyph(Font* t, u32 codepoint);  // Rasterized into the atlas on first use.
+u32            fontPrepareGlyphs(Platform* plat, Font* t, u32* codepoints, u32 numCodepoints, u32 numThreads);  // Rasterizes the missing ones at once. Returns how many.
+void           fontFlushAtlas(Font* t);  // Uploads the glyphs rasterized since the last flush.
+void           fontDeinit(Platform* plat, Font* t);  // Writes the atlas cache when glyphs were added.
+
+struct ImmStats
+{
+   // Last frame
+   u32 numDraws;
+   u32 numQuads;
+   u32 numQuadsWritten;  // The others were already in the vertex buffer drawn from.
+   bool reusedFrame;  // Same draw list as the frame before. Nothing was written.
+
+   // Frames that drew anything, since the start
+   u64 numFrames;
+   u64 numFramesReused;
+   u64 totalQuads;
+   u64 totalQuadsWritten;
+};
 
 void           immInit(Font* t);
 void           immKeypress(char k);
@@ -1297,9 +1732,16 @@ void           immSameLine();
 void           immNewFrame();
 void           immTextInput(Platform* plat, char** sText, FontSize fsize = FontSize_Small);
 void           immList(char** texts, sz numTexts, int highlightedIdx = -1, FontSize fsize = FontSize_Medium);
-void           immText(char* text, FontSize fsize = FontSize_Small);
+void           immText(char* text, FontSize fsize = FontSize_Small, vec4 color = vec4{ 1, 1, 1, 1 });
+vec2           immMeasureText(char* text, FontSize fsize = FontSize_Small);  // Width, and the height immText advances by.
+void           immImage(Texture2D* tex, f32 width, f32 height, vec4 color = vec4{ 1, 1, 1, 1 });
+void           immPushClip(f32 x, f32 y, f32 w, f32 h);  // Until the matching immPopClip, only this rect is drawn to.
+void           immPopClip();
 ObjectHandle   immObjectPick();
 void           immRender();
+ImmStats       immStats();
+ImmStats       immFillBuffer(u64 frame);  // What immRender does before it draws, as if drawn in `frame`, into buffers of its own. For tests.
+u32            immCountDraws();  // Draw calls the commands recorded so far will take, before clipping single quads. Changes nothing.
 
 // Global
 u64 immGlobalSize();
@@ -1326,11 +1768,58 @@ void commandPerform(Platform* plat, CommandsEnum cmd);
 u64 editorGlobalSize();
 void editorGlobalSet(u8* ptr);
 
+// What the finder picks from: commands, asset files, and the objects in the
+// world and their materials. Names are copied and lowercased as they are
+// added, and each gets a mask of the characters in it, so most entries that
+// can't match are rejected without reading them.
+enum FinderKind
+{
+   FinderKind_Command,
+   FinderKind_Object,
+   FinderKind_Material,
+   FinderKind_Asset,
+};
+
+#define FinderId(kind, value) (((u64)(kind) << 32) | (u64)(value))
+#define FinderIdKind(id) ((FinderKind)((id) >> 32))
+#define FinderIdValue(id) ((u32)(id))
+
+struct FinderIndex
+{
+   u32 numEntries;
+   char* sChars;  // Each name, followed by its lowercase copy.
+   u32* sNameOffsets;
+   u32* sLengths;
+   u64* sCharMasks;
+   u64* sIds;
+};
+
 struct Finder
 {
    char* sSearchString;
 
    int selectionIdx;
+
+   FinderIndex index;
+
+   // Commands and assets come first. The world's entries follow, and are
+   // added as objects appear.
+   u32 numFixedEntries;
+   char** sAssetPaths;
+   u64 indexedWorld;  // World::generation, 0 before the first.
+   u64 numIndexedObjects;
+
+   // Entries before numFiltered that matched the last query. A query that
+   // extends it only looks at these and the entries added since.
+   u32* sMatches;
+   u32 numMatches;
+   u32 numFiltered;
+   bool topStale;  // Entries were removed.
+   char lastQuery[64];
+   i32 lastQueryLen;  // -1 when sMatches is not filtered by lastQuery.
+
+   u32 top[gKnobs.finderMaxResults];  // Best matches for lastQuery, best first.
+   u32 numTop;
 };
 
 enum MaterialEditorState
@@ -1363,8 +1852,12 @@ bool modeIs(Mode mode);
 bool modeTick(Platform* plat);
 
 // Finder
+void     finderAddCandidate(Finder* f, char* name, u64 id);
+void     finderRemoveCandidatesFrom(Finder* f, u32 firstIdx);
+void     finderUpdateIndex(Platform* plat, Finder* f);  // Adds what appeared since the last call.
+void     finderPerform(Platform* plat, u64 id);
 void     finderExit(Finder* f);
-char**   finderComputeResults(Finder* f, Lifetime life, CommandsEnum* selectedCmd = NULL);
+char**   finderComputeResults(Finder* f, Lifetime life, u64* selectedId = NULL);
 
 // Material Editor
 void materialSliders(MaterialConstantsCB* matc);
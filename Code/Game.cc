@@ -97,16 +97,16 @@ struct Dude
    ObjectHandle axe1;
    ObjectHandle axe2;
 
-   Mesh headMesh;
-   Mesh hairMesh;
+   MeshAssetHandle headMesh;
+   MeshAssetHandle hairMesh;
 
-   Mesh torsoMesh;
+   MeshAssetHandle torsoMesh;
 
-   Mesh lhandMesh;
+   MeshAssetHandle lhandMesh;
 
-   Mesh axe1Mesh;
-   Mesh axe2Mesh;
-   Mesh rhandMesh;
+   MeshAssetHandle axe1Mesh;
+   MeshAssetHandle axe2Mesh;
+   MeshAssetHandle rhandMesh;
 };
 
 enum HoundFsm
@@ -147,9 +147,11 @@ struct GameState
 
    // Meshes.
 
-   Mesh houndMesh;
-   Mesh groundTileMesh;
-   Mesh treeMesh;
+   MeshAssetHandle houndMesh;
+   MeshAssetHandle groundTileMesh;
+   MeshAssetHandle treeMesh;
+   MeshAssetHandle cubeMesh;
+   MeshAssetHandle flameMesh;
    Mesh treeCollision;
 
    // Flames
@@ -385,12 +387,20 @@ scaleToBounds(Mesh* m, vec3 bounds)
 
       *v = xform * (*v);
    }
+   // The cooked vertex stream no longer matches.
+   m->cookedVerts = nullptr;
 }
 
 void
 playLoadedSound(LoadedSound* snd)
 {
-   playAudio(snd->samples, snd->hz, snd->channels, snd->numBytes);
+   playSound(snd);
+}
+
+void
+playLoadedSoundAt(LoadedSound* snd, vec3 pos)
+{
+   playSoundAt(snd, pos);
 }
 
 void
@@ -416,18 +426,15 @@ killPlayer()
 void
 gameInit(Platform* plat)
 {
+   u64 initBeginUs = plat->getMicroseconds();
+
    float groundSize = 50;
 
    Game->plat = plat;
    Game->world = getWorld();
 
-   Game->sndPlayerHit = mp3Load(plat, AssetPath(plat, "PlayerHit.mp3"), Lifetime_World);
-   Game->sndHoundDie = mp3Load(plat, AssetPath(plat, "EnemyDying.mp3"), Lifetime_World);
-   Game->sndHoundDieAxe = mp3Load(plat, AssetPath(plat, "EnemyDyingAxe.mp3"), Lifetime_World);
-   Game->sndSwing = mp3Load(plat, AssetPath(plat, "Swing.mp3"), Lifetime_World);
-   Game->sndTreeHit = mp3Load(plat, AssetPath(plat, "TreeHit.mp3"), Lifetime_World);
-   Game->sndTreeFall = mp3Load(plat, AssetPath(plat, "TreeFall.mp3"), Lifetime_World);
-
+   // Start every load up front so the files are read and decoded in parallel.
+   // Each asset is taken right before its first use.
    float sizes[FontSize_Count] = {};
 
    sizes[FontSize_Tiny] = 18;
@@ -436,20 +443,59 @@ gameInit(Platform* plat)
    sizes[FontSize_Big] = 40;
 
    char* fontPath = AssetPath(plat, "DancingScript-VariableFont_wght.ttf");
-   fontInit(plat, &Game->font, fontPath, sizes);
+   AssetLoadHandle fontLoad = assetLoadFontAsync(plat, &Game->font, fontPath, sizes);
+
+   AssetLoadHandle cubeLoad = assetLoadAsync(plat, AssetPath(plat, "UnitCube.obj"), AssetType_Mesh);
+   AssetLoadHandle groundTileLoad = assetLoadAsync(plat, AssetPath(plat, "UnitGroundTile.obj"), AssetType_Mesh);
+   AssetLoadHandle treeLoad = assetLoadAsync(plat, AssetPath(plat, "Tree.obj"), AssetType_Mesh);
+   AssetLoadHandle axe1Load = assetLoadAsync(plat, AssetPath(plat, "Dude_Axe1.obj"), AssetType_Mesh);
+   AssetLoadHandle axe2Load = assetLoadAsync(plat, AssetPath(plat, "Dude_Axe2.obj"), AssetType_Mesh);
+   AssetLoadHandle headLoad = assetLoadAsync(plat, AssetPath(plat, "Dude_Head.obj"), AssetType_Mesh);
+   AssetLoadHandle hairLoad = assetLoadAsync(plat, AssetPath(plat, "Dude_Hair.obj"), AssetType_Mesh);
+   AssetLoadHandle lhandLoad = assetLoadAsync(plat, AssetPath(plat, "Dude_Lhand.obj"), AssetType_Mesh);
+   AssetLoadHandle rhandLoad = assetLoadAsync(plat, AssetPath(plat, "Dude_Rhand.obj"), AssetType_Mesh);
+   AssetLoadHandle torsoLoad = assetLoadAsync(plat, AssetPath(plat, "Dude_Torso.obj"), AssetType_Mesh);
+   AssetLoadHandle houndLoad = assetLoadAsync(plat, AssetPath(plat, "Hound.obj"), AssetType_Mesh);
+   AssetLoadHandle flameLoad = assetLoadAsync(plat, AssetPath(plat, "Flame.obj"), AssetType_Mesh);
+
+   // The sounds decode on every thread, next to the loads above.
+   {
+      char* paths[] = {
+         AssetPath(plat, "PlayerHit.mp3"),
+         AssetPath(plat, "EnemyDying.mp3"),
+         AssetPath(plat, "EnemyDyingAxe.mp3"),
+         AssetPath(plat, "Swing.mp3"),
+         AssetPath(plat, "TreeHit.mp3"),
+         AssetPath(plat, "TreeFall.mp3"),
+      };
+      LoadedSound sounds[ArrayCount(paths)] = {};
+      mp3LoadBatch(plat, paths, sounds, ArrayCount(paths), Lifetime_World);
+
+      Game->sndPlayerHit = sounds[0];
+      Game->sndHoundDie = sounds[1];
+      Game->sndHoundDieAxe = sounds[2];
+      Game->sndSwing = sounds[3];
+      Game->sndTreeHit = sounds[4];
+      Game->sndTreeFall = sounds[5];
+   }
 
-   Game->groundTileMesh = objLoad(plat, AssetPath(plat, "UnitGroundTile.obj"), Lifetime_World);
-   Game->groundTileHnd = addMeshToWorld(Game->groundTileMesh, "Ground tile");
+   assetTakeFont(fontLoad);
+
+   // Collision meshes are scaled copies of the cube.
+   Game->cubeMesh = assetTakeMesh(cubeLoad);
+
+   Game->groundTileMesh = assetTakeMesh(groundTileLoad);
+   Game->groundTileHnd = addMeshAssetToWorld(Game->groundTileMesh, "Ground tile");
    setupGroundMaterial(materialForObject(Game->groundTileHnd));
 
    // Trees
    {
       // Only debugging the first, as I think it's working.
-      Game->treeCollision = objLoad(plat, AssetPath(plat, "UnitCube.obj"), Lifetime_World);
+      Game->treeCollision = meshCopy(*meshAsset(Game->cubeMesh), Lifetime_World);
       Game->treeCollisionHnds[0] = addMeshToWorld(Game->treeCollision, "Tree collision");
       setMetallic(materialForObject(Game->treeCollisionHnds[0]), vec4{0,1,0,1}, 0.3);
 
-      Game->treeMesh = objLoad(plat, AssetPath(plat, "Tree.obj"), Lifetime_World);
+      Game->treeMesh = assetTakeMesh(treeLoad);
       vec3 treeBounds = vec3{0.5, 4, 0.5};
 
       scaleToBounds(&Game->treeCollision, treeBounds);
@@ -471,7 +517,7 @@ gameInit(Platform* plat)
          };
          Game->treeCols[i].pos = treePos;
          Game->treeCols[i].bounds = treeBounds;
-         Game->treeHnds[i] = addMeshToWorld(Game->treeMesh, "Tree");
+         Game->treeHnds[i] = addMeshAssetToWorld(Game->treeMesh, "Tree");
          // setTransformForObject(Game->treeCollisionHnds[i], mat4Translate(Game->treeCols[i].pos));
          setTransformForObject(Game->treeHnds[i], mat4Translate(Game->treeCols[i].pos));
          setupTreeMaterial(materialForObject(Game->treeHnds[i]));
@@ -483,24 +529,24 @@ gameInit(Platform* plat)
 
       Dude* d = &Game->dude;
 
-      d->axe1Mesh = objLoad(plat, AssetPath(plat, "Dude_Axe1.obj"), Lifetime_World);
-      d->axe2Mesh = objLoad(plat, AssetPath(plat, "Dude_Axe2.obj"), Lifetime_World);
-      d->headMesh = objLoad(plat, AssetPath(plat, "Dude_Head.obj"), Lifetime_World);
-      d->hairMesh = objLoad(plat, AssetPath(plat, "Dude_Hair.obj"), Lifetime_World);
-      d->lhandMesh = objLoad(plat, AssetPath(plat, "Dude_Lhand.obj"), Lifetime_World);
-      d->rhandMesh = objLoad(plat, AssetPath(plat, "Dude_Rhand.obj"), Lifetime_World);
-      d->torsoMesh = objLoad(plat, AssetPath(plat, "Dude_Torso.obj"), Lifetime_World);
-
-      d->axe1 = addMeshToWorld(d->axe1Mesh, "Dude mesh");
-      d->axe2 = addMeshToWorld(d->axe2Mesh, "Dude mesh");
-      d->head = addMeshToWorld(d->headMesh, "Dude mesh");
-      d->hair = addMeshToWorld(d->hairMesh, "Dude mesh");
-      d->lhand = addMeshToWorld(d->lhandMesh, "Dude mesh");
-      d->rhand = addMeshToWorld(d->rhandMesh, "Dude mesh");
-      d->torso = addMeshToWorld(d->torsoMesh, "Dude mesh");
-
-      d->collisionMesh = objLoad(plat, AssetPath(plat, "UnitCube.obj"), Lifetime_World);
-      d->axeColM = objLoad(plat, AssetPath(plat, "UnitCube.obj"), Lifetime_World);
+      d->axe1Mesh = assetTakeMesh(axe1Load);
+      d->axe2Mesh = assetTakeMesh(axe2Load);
+      d->headMesh = assetTakeMesh(headLoad);
+      d->hairMesh = assetTakeMesh(hairLoad);
+      d->lhandMesh = assetTakeMesh(lhandLoad);
+      d->rhandMesh = assetTakeMesh(rhandLoad);
+      d->torsoMesh = assetTakeMesh(torsoLoad);
+
+      d->axe1 = addMeshAssetToWorld(d->axe1Mesh, "Dude mesh");
+      d->axe2 = addMeshAssetToWorld(d->axe2Mesh, "Dude mesh");
+      d->head = addMeshAssetToWorld(d->headMesh, "Dude mesh");
+      d->hair = addMeshAssetToWorld(d->hairMesh, "Dude mesh");
+      d->lhand = addMeshAssetToWorld(d->lhandMesh, "Dude mesh");
+      d->rhand = addMeshAssetToWorld(d->rhandMesh, "Dude mesh");
+      d->torso = addMeshAssetToWorld(d->torsoMesh, "Dude mesh");
+
+      d->collisionMesh = meshCopy(*meshAsset(Game->cubeMesh), Lifetime_World);
+      d->axeColM = meshCopy(*meshAsset(Game->cubeMesh), Lifetime_World);
       // Transform the verts to cover the dude.
       d->coll.bounds = vec3{0.5,2.0,0.5};
       d->axeColl.bounds = vec3{0.7, 2.0, 0.7};
@@ -529,14 +575,14 @@ gameInit(Platform* plat)
    }
 
    // Only setting up the first for now. Assuming it won't break?
-   Mesh cm = objLoad(plat, AssetPath(plat, "UnitCube.obj"), Lifetime_Frame);
+   Mesh cm = meshCopy(*meshAsset(Game->cubeMesh), Lifetime_Frame);
    Game->houndCollisionHnds[0] = addMeshToWorld(cm, "Hound collision");
 
    // Enemies
    {
-      Game->houndMesh = objLoad(plat, AssetPath(plat, "Hound.obj"), Lifetime_World);
+      Game->houndMesh = assetTakeMesh(houndLoad);
       for (int i = 0; i < MaxEnemies; ++i) {
-         Game->houndHnds[i] = addMeshToWorld(Game->houndMesh, "Hound");
+         Game->houndHnds[i] = addMeshAssetToWorld(Game->houndMesh, "Hound");
          objectSetFlag(Game->houndHnds[i], WorldObject_Visible, false);
 
          Game->houndColl[i].bounds = vec3{0.8,0.5,0.8};
@@ -550,9 +596,9 @@ gameInit(Platform* plat)
    {
       Game->fireCol.bounds = vec3{0.5, 0.2, 0.5};
 
-      Mesh flameMesh = objLoad(plat, AssetPath(plat, "Flame.obj"), Lifetime_Frame);
+      Game->flameMesh = assetTakeMesh(flameLoad);
       for (int i = 0; i < NumFlames; ++i) {
-         Game->flames[i] = addMeshToWorld(flameMesh, "Dude mesh");
+         Game->flames[i] = addMeshAssetToWorld(Game->flameMesh, "Dude mesh");
          objectSetFlag(Game->flames[i], WorldObject_CastsShadows, false);
          setNonmetallic(materialForObject(Game->flames[i]), flameColor(), 1.0);
       }
@@ -566,6 +612,9 @@ gameInit(Platform* plat)
    gameplayInit();
 
    showMenu();
+
+   logMsg("gameInit took %.2f ms (loadAssetsAsync %d, %d worker threads)\n",
+          (plat->getMicroseconds() - initBeginUs) / 1000.0, gKnobs.loadAssetsAsync, plat->numWorkerThreads);
 }
 
 bool
@@ -720,6 +769,7 @@ increaseFire()
 void
 gameTick()
 {
+   ProfileZone("gameTick");
 
    float deltaTimeSec = Min(1/30.0, float(Game->plat->getMicroseconds() - Game->lastTickUs) / 1000000.0);
 
@@ -895,12 +945,12 @@ gameTick()
                if (Game->dude.swingTreeIdx == NumTrees &&
                   collidesWithTrees(&Game->dude.axeColl, Game->dude.axeColl.pos, &Game->dude.swingTreeIdx)) {
                   dudeHitTree = true;
-                  playLoadedSound(&Game->sndTreeHit);
+                  playLoadedSoundAt(&Game->sndTreeHit, Game->treeCols[Game->dude.swingTreeIdx].pos);
                }
                if (Game->dude.swingHoundIdx == MaxEnemies &&
                   collidesWithHounds(&Game->dude.axeColl, Game->dude.axeColl.pos, &Game->dude.swingHoundIdx)) {
                   dudeHitHound = true;
-                  playLoadedSound(&Game->sndTreeHit);
+                  playLoadedSoundAt(&Game->sndTreeHit, gp->houndPos[Game->dude.swingHoundIdx]);
                }
             }
          }
@@ -909,7 +959,7 @@ gameTick()
          {
             if (dudeHitTree) {
                if (--gp->treeHealths[Game->dude.swingTreeIdx] == 0) {
-                  playLoadedSound(&Game->sndTreeFall);
+                  playLoadedSoundAt(&Game->sndTreeFall, Game->treeCols[Game->dude.swingTreeIdx].pos);
                   gp->woodCount++;
                   gameSave();
                }
@@ -1008,10 +1058,10 @@ gameTick()
 
                   if (gp->houndHealths[i] <= 0) {
                      if (gp->houndGrudge[i] == 0) {
-                        playLoadedSound(&Game->sndHoundDie);
+                        playLoadedSoundAt(&Game->sndHoundDie, gp->houndPos[i]);
                      }
                      else {
-                        playLoadedSound(&Game->sndHoundDieAxe);
+                        playLoadedSoundAt(&Game->sndHoundDieAxe, gp->houndPos[i]);
                      }
                      gp->killCount++;
                   }
@@ -4,6 +4,11 @@ AppInitCallbackProcDef(appInit)
    memInit();
 
    logInit(plat);
+   profileInit(plat);
+
+   if (gKnobs.useAssetPack) {
+      assetPackOpen(plat, assetPathForFrame(plat, "../" AssetPackName));
+   }
 
    gpuInit(plat, width, height);
    worldRenderInit(plat);
@@ -30,9 +35,15 @@ AppInitCallbackProcDef(appInit)
 
 AppTickCallbackProcDef(appTick)
 {
+   profileNewFrame();
+   ProfileZone("appTick");
+
    // Reset command lists.
    gpuPrepareForMainLoop();
 
+   // Upload what the loaders finished since last frame.
+   assetsUpdate();
+
    // Check for resize.
    {
       int w,h;
@@ -65,7 +76,8 @@ AppTickCallbackProcDef(appTick)
    else if (plat->runMode == RunMode_Tests) {
       testsTick();
    }
-   audioFrameEnd();
+   setAudioListener(&getWorld()->cam);
+   profileDrawSummary();
    // Render
    {
       gpuBeginRenderTick();
@@ -95,6 +107,9 @@ GetGlobalSizeTableProcDef(getGlobalSizeTable)
    sizes[GlobalTable_Gameplay] = gameGlobalSize();
    sizes[GlobalTable_Tests] = testGlobalSize();
    sizes[GlobalTable_WorldRender] = worldRenderGlobalSize();
+   sizes[GlobalTable_Assets] = assetsGlobalSize();
+   sizes[GlobalTable_AssetPack] = assetPackGlobalSize();
+   sizes[GlobalTable_Profiler] = profileGlobalSize();
 }
 
 PatchGlobalTableProcDef(patchGlobalTable)
@@ -108,13 +123,20 @@ PatchGlobalTableProcDef(patchGlobalTable)
    worldRenderGloalSet(pointers[GlobalTable_WorldRender]);
    testGlobalSet(pointers[GlobalTable_Tests]);
    logGlobalSet(pointers[GlobalTable_Logging]);
+   assetsGlobalSet(pointers[GlobalTable_Assets]);
+   assetPackGlobalSet(pointers[GlobalTable_AssetPack]);
+   profileGlobalSet(pointers[GlobalTable_Profiler]);
 }
 
 AppDisposeProcDef(appDispose)
 {
-   fontDeinit(&editor()->defaultFont);
+   fontDeinit(plat, &editor()->defaultFont);
+   if (plat->runMode == RunMode_Game) {
+      fontDeinit(plat, &Game->font);
+   }
    disposeWorld();
    wrDispose();
    gpuDispose();
+   assetPackClose(plat);
    freePages(Lifetime_App); // TODO: Not really necessary. Disable for release?
 }
\ No newline at end of file
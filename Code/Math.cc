@@ -472,3 +472,165 @@ Vec2(f32 x, f32 y)
 {
    return vec2{x,y};
 }
+
+// ==== Vertex compression
+
+static float
+signNotZero(float x)
+{
+   return (x >= 0.0f) ? 1.0f : -1.0f;
+}
+
+static i16
+toSnorm16(float v)
+{
+   v = clamp(v, -1.0f, 1.0f);
+   return (i16)(v >= 0.0f ? v * 32767.0f + 0.5f : v * 32767.0f - 0.5f);
+}
+
+u32
+octEncodeNormal(vec3 n)
+{
+   float l1 = Abs(n.x) + Abs(n.y) + Abs(n.z);
+   vec2 p = {};
+   if (l1 > 0.0f) {
+      p = vec2{ n.x / l1, n.y / l1 };
+   }
+   if (n.z < 0.0f) {
+      vec2 folded = {
+         (1.0f - Abs(p.y)) * signNotZero(p.x),
+         (1.0f - Abs(p.x)) * signNotZero(p.y),
+      };
+      p = folded;
+   }
+   u32 packed = (u32)(u16)toSnorm16(p.x) | ((u32)(u16)toSnorm16(p.y) << 16);
+   return packed;
+}
+
+vec3
+octDecodeNormal(u32 packed)
+{
+   // Same as DXGI_FORMAT_R16G16_SNORM followed by octDecode() in Common.hlsl
+   float x = Max((i16)(packed & 0xffff) / 32767.0f, -1.0f);
+   float y = Max((i16)(packed >> 16) / 32767.0f, -1.0f);
+
+   vec3 n = { x, y, 1.0f - Abs(x) - Abs(y) };
+   float t = clamp(-n.z, 0.0f, 1.0f);
+   n.x += (n.x >= 0.0f) ? -t : t;
+   n.y += (n.y >= 0.0f) ? -t : t;
+
+   return normalizedOrZero(n);
+}
+
+// Round to nearest even. Overflow goes to infinity.
+// From Fabian Giesen's float_to_half_fast3_rtne.
+u16
+floatToHalf(float f)
+{
+   union { u32 u; float f; } fi, denormMagic;
+   denormMagic.u = ((127 - 15) + (23 - 10) + 1) << 23;
+
+   fi.f = f;
+   u32 sign = fi.u & 0x80000000u;
+   fi.u ^= sign;
+
+   u16 h = 0;
+   if (fi.u >= (127u + 16u) << 23) {
+      h = (fi.u > 0x7f800000u) ? 0x7e00 : 0x7c00;  // NaN or Inf
+   }
+   else if (fi.u < (113u << 23)) {
+      // Denormal. Let the FPU do the rounding.
+      fi.f += denormMagic.f;
+      h = (u16)(fi.u - denormMagic.u);
+   }
+   else {
+      u32 mantissaOdd = (fi.u >> 13) & 1;
+      fi.u -= 112u << 23;  // Rebias exponent.
+      fi.u += 0xfff + mantissaOdd;
+      h = (u16)(fi.u >> 13);
+   }
+   h |= (u16)(sign >> 16);
+   return h;
+}
+
+float
+halfToFloat(u16 h)
+{
+   union { u32 u; float f; } o, magic;
+   magic.u = 113u << 23;
+   const u32 shiftedExp = 0x7c00u << 13;
+
+   o.u = (h & 0x7fffu) << 13;
+   u32 exp = shiftedExp & o.u;
+   o.u += (127u - 15u) << 23;
+
+   if (exp == shiftedExp) {
+      o.u += (128u - 16u) << 23;  // NaN or Inf
+   }
+   else if (exp == 0) {
+      o.u += 1u << 23;  // Zero or denormal
+      o.f -= magic.f;
+   }
+   o.u |= (h & 0x8000u) << 16;
+   return o.f;
+}
+
+u32
+packColorRGBA8(vec4 c)
+{
+   u32 packed = 0;
+   for (int i = 0; i < 4; ++i) {
+      u32 v = (u32)(clamp(c[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+      packed |= v << (8 * i);
+   }
+   return packed;
+}
+
+vec4
+unpackColorRGBA8(u32 packed)
+{
+   vec4 c = {};
+   for (int i = 0; i < 4; ++i) {
+      c[i] = ((packed >> (8 * i)) & 0xff) / 255.0f;
+   }
+   return c;
+}
+
+// ==== Frustum
+
+// Gribb, Hartmann - "Fast Extraction of Viewing Frustum Planes from the
+// World-View-Projection Matrix". Clip space z is in [0, 1].
+Frustum
+frustumFromMatrix(const mat4& m)
+{
+   vec4 r0 = row(m, 0);
+   vec4 r1 = row(m, 1);
+   vec4 r2 = row(m, 2);
+   vec4 r3 = row(m, 3);
+
+   Frustum f = {};
+   f.planes[0] = r3 + r0;  // Left
+   f.planes[1] = r3 - r0;  // Right
+   f.planes[2] = r3 + r1;  // Bottom
+   f.planes[3] = r3 - r1;  // Top
+   f.planes[4] = r2;  // Near
+   f.planes[5] = r3 - r2;  // Far
+
+   for (int i = 0; i < 6; ++i) {
+      float len = length(f.planes[i].xyz);
+      if (len > 0) {
+         f.planes[i] = f.planes[i] / len;
+      }
+   }
+   return f;
+}
+
+bool
+frustumTestSphere(const Frustum* f, vec3 center, float radius)
+{
+   bool inside = true;
+   for (int i = 0; inside && i < 6; ++i) {
+      inside = dot(f->planes[i].xyz, center) + f->planes[i].w >= -radius;
+   }
+   return inside;
+}
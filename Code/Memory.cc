@@ -27,6 +27,17 @@ static struct MemorySystem
 
 } *gMem;
 
+// The heaps in gMem belong to the main thread. A worker running a job that
+// allocates sets up its own MemorySystem with jobMemoryBegin; the main thread
+// takes over its pages with jobMemoryAdopt once the job is done.
+static thread_local MemorySystem* tJobMem;
+
+static MemorySystem*
+memForThread()
+{
+   return tJobMem ? tJobMem : gMem;
+}
+
 void
 memInit()
 {
@@ -57,7 +68,7 @@ availablePageBytes(const AllocPage& page)
 AllocPage&
 getPage(const u64 desiredBytes, const Lifetime life)
 {
-   AllocPage** page = &gMem->heapLists[life];
+   AllocPage** page = &memForThread()->heapLists[life];
 
    // TODO: If this linear walk ever becomes a problem, we can come up with something
    for (; *page; *page = (*page)->next) {
@@ -107,11 +118,12 @@ u8*
 reallocateBytesFor3rd(const u8* ptr, const sz newSize)
 {
    AllocHeader empty = {};
-   Assert(gMem->lifetimeCount);
-   empty.life = gMem->apiLifetime[gMem->lifetimeCount - 1];
+   MemorySystem* mem = memForThread();
+   Assert(mem->lifetimeCount);
+   empty.life = mem->apiLifetime[mem->lifetimeCount - 1];
    AllocHeader* h = ptr ? (AllocHeader*)ptr - 1 : &empty;
 
-   u8* bytes = allocateBytes(newSize, h->life, gMem->apiAlignment[gMem->alignmentCount - 1]);
+   u8* bytes = allocateBytes(newSize, h->life, mem->apiAlignment[mem->alignmentCount - 1]);
    if (h->size > 0) {
       memcpy(bytes, ptr, h->size);
    }
@@ -122,24 +134,28 @@ reallocateBytesFor3rd(const u8* ptr, const sz newSize)
 
 void pushApiLifetime(Lifetime life)
 {
-   gMem->apiLifetime[gMem->lifetimeCount++] = life;
+   MemorySystem* mem = memForThread();
+   mem->apiLifetime[mem->lifetimeCount++] = life;
 }
 
 void popApiLifetime()
 {
-   Assert(gMem->lifetimeCount > 1);
-   --gMem->lifetimeCount;
+   MemorySystem* mem = memForThread();
+   Assert(mem->lifetimeCount > 1);
+   --mem->lifetimeCount;
 }
 
 void pushApiAlignment(u64 byteAlign)
 {
-   gMem->apiAlignment[gMem->alignmentCount++] = byteAlign;
+   MemorySystem* mem = memForThread();
+   mem->apiAlignment[mem->alignmentCount++] = byteAlign;
 }
 
 void popApiAlignment()
 {
-   Assert(gMem->alignmentCount > 1);
-   --gMem->alignmentCount;
+   MemorySystem* mem = memForThread();
+   Assert(mem->alignmentCount > 1);
+   --mem->alignmentCount;
 }
 
 
@@ -178,4 +194,80 @@ lifetimeEnd(Lifetime life)
 
    freePages(life);
    gMem->usedExplicitLifetimes[life - Lifetime_User] = false;
-}
\ No newline at end of file
+}
+
+JobMemory*
+jobMemoryBegin()
+{
+   MemorySystem* mem = (MemorySystem*)calloc(1, sizeof(MemorySystem));
+   mem->lifetimeCount = 1;
+   mem->alignmentCount = 1;
+
+   // Not nested. Jobs may also run on the main thread, inside completeAllWork.
+   Assert(!tJobMem);
+   tJobMem = mem;
+
+   return (JobMemory*)mem;
+}
+
+void
+jobMemoryEnd()
+{
+   Assert(tJobMem);
+   tJobMem = nullptr;
+}
+
+void
+jobMemoryAdopt(JobMemory* job)
+{
+   MemorySystem* mem = (MemorySystem*)job;
+   for (sz li = 0; li < Lifetime_Count; ++li) {
+      if (mem->heapLists[li]) {
+         AllocPage* last = mem->heapLists[li];
+         while (last->next) {
+            last = last->next;
+         }
+         last->next = gMem->heapLists[li];
+         gMem->heapLists[li] = mem->heapLists[li];
+      }
+   }
+   free(mem);
+}
+
+struct BatchedJob
+{
+   PlatformWorkProc* proc;
+   void* data;
+   volatile LONG* numDone;
+};
+
+static PlatformWorkProcDef(batchedJobProc)
+{
+   BatchedJob* job = (BatchedJob*)data;
+   job->proc(job->data);
+   InterlockedIncrement(job->numDone);
+}
+
+void
+runJobs(Platform* plat, PlatformWorkProc* proc, void* jobs, sz jobSize, u32 numJobs)
+{
+   if (numJobs == 1) {
+      proc(jobs);
+   }
+   else {
+      volatile LONG numDone = 0;
+      BatchedJob* batch = AllocateArray(BatchedJob, numJobs, Lifetime_Frame);
+      for (u32 i = 0; i < numJobs; ++i) {
+         batch[i] = BatchedJob{ proc, (u8*)jobs + i * jobSize, &numDone };
+         plat->addWork(batchedJobProc, batch + i);
+      }
+
+      // Help until our jobs are done. Other entries may run here too, but one at a time.
+      while (numDone < (LONG)numJobs) {
+         if (!plat->helpWithWork()) {
+            YieldProcessor();
+         }
+      }
+      MemoryBarrier();  // The jobs' results.
+   }
+}
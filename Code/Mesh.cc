@@ -46,4 +46,1005 @@ makeQuad(float side, float z, Lifetime life, WindingOrder winding)
 {
    Mesh q = makeQuad(-side, -side, 2*side, 2*side, z, vec4{}, life, winding);
    return q;
-}
\ No newline at end of file
+}
+
+// Deep copy of the CPU arrays, for callers that edit a mesh they share. The
+// cooked pointers are kept; they stay valid as long as the copy isn't edited.
+Mesh
+meshCopy(const Mesh& m, Lifetime life)
+{
+   Mesh c = m;
+
+   c.sPositions = nullptr;
+   SBResize(c.sPositions, SBCount(m.sPositions), life);
+   memcpy(c.sPositions, m.sPositions, sizeof(*c.sPositions) * SBCount(m.sPositions));
+
+   c.sNormals = nullptr;
+   SBResize(c.sNormals, SBCount(m.sNormals), life);
+   memcpy(c.sNormals, m.sNormals, sizeof(*c.sNormals) * SBCount(m.sNormals));
+
+   c.sTexcoords = nullptr;
+   SBResize(c.sTexcoords, SBCount(m.sTexcoords), life);
+   memcpy(c.sTexcoords, m.sTexcoords, sizeof(*c.sTexcoords) * SBCount(m.sTexcoords));
+
+   c.sColors = nullptr;
+   SBResize(c.sColors, SBCount(m.sColors), life);
+   memcpy(c.sColors, m.sColors, sizeof(*c.sColors) * SBCount(m.sColors));
+
+   c.sIndices = nullptr;
+   SBResize(c.sIndices, SBCount(m.sIndices), life);
+   memcpy(c.sIndices, m.sIndices, sizeof(*c.sIndices) * SBCount(m.sIndices));
+
+   c.sMeshlets = nullptr;
+   SBResize(c.sMeshlets, SBCount(m.sMeshlets), life);
+   memcpy(c.sMeshlets, m.sMeshlets, sizeof(*c.sMeshlets) * SBCount(m.sMeshlets));
+
+   return c;
+}
+// ================================
+// Mesh optimization
+// ================================
+
+VertexCacheStats
+meshVertexCacheStats(const u32* indices, u64 numIndices, u64 numVerts, u32 cacheSize)
+{
+   VertexCacheStats stats = {};
+
+   // Simulated FIFO. Each vertex remembers when it entered the cache.
+   u64* entryTime = AllocateArray(u64, numVerts, Lifetime_Frame);
+   u64 time = cacheSize + 1;
+   u64 numTransformed = 0;
+   for (u64 i = 0; i < numIndices; ++i) {
+      u32 v = indices[i];
+      if (time - entryTime[v] > cacheSize) {
+         entryTime[v] = time++;
+         numTransformed++;
+      }
+   }
+
+   if (numIndices) {
+      stats.acmr = (float)numTransformed / (numIndices / 3);
+   }
+   if (numVerts) {
+      stats.atvr = (float)numTransformed / numVerts;
+   }
+
+   return stats;
+}
+
+struct TipsifyCluster
+{
+   u64 firstTri;
+   u64 numTris;
+   float sortKey;
+};
+
+static int
+compareClusters(const void* va, const void* vb)
+{
+   const TipsifyCluster* a = (const TipsifyCluster*)va;
+   const TipsifyCluster* b = (const TipsifyCluster*)vb;
+   // Outward-facing clusters first. Ties keep the cache order.
+   int res = (a->sortKey > b->sortKey) ? -1 : (a->sortKey < b->sortKey) ? 1 : 0;
+   if (res == 0) {
+      res = (a->firstTri < b->firstTri) ? -1 : 1;
+   }
+   return res;
+}
+
+// Tipsify: Sander, Nehab, Barczak - "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw". Fans around a vertex, picking the next fan
+// from the neighbors that will still be in the cache. When no neighbor
+// qualifies we hit a dead end and start a new cluster.
+// Writes the new triangle order to outIndices and returns the number of
+// clusters, at most one per triangle.
+static u64
+tipsify(const u32* indices, u64 numIndices, u64 numVerts, u32 cacheSize, u32* outIndices, TipsifyCluster* outClusters)
+{
+   u64 numTris = numIndices / 3;
+
+   // Vertex -> triangle adjacency.
+   u32* liveTris = AllocateArray(u32, numVerts, Lifetime_Frame);
+   u64* adjOffsets = AllocateArray(u64, numVerts + 1, Lifetime_Frame);
+   u32* adj = AllocateArray(u32, numIndices, Lifetime_Frame);
+   for (u64 i = 0; i < numIndices; ++i) {
+      liveTris[indices[i]]++;
+   }
+   for (u64 v = 0; v < numVerts; ++v) {
+      adjOffsets[v + 1] = adjOffsets[v] + liveTris[v];
+   }
+   {
+      u64* fill = AllocateArray(u64, numVerts, Lifetime_Frame);
+      memcpy(fill, adjOffsets, sizeof(u64) * numVerts);
+      for (u64 i = 0; i < numIndices; ++i) {
+         adj[fill[indices[i]]++] = i / 3;
+      }
+   }
+
+   u64* cacheTime = AllocateArray(u64, numVerts, Lifetime_Frame);
+   bool* emitted = AllocateArray(bool, numTris, Lifetime_Frame);
+   u32* deadEnds = AllocateArray(u32, numIndices, Lifetime_Frame);
+   u64 numDeadEnds = 0;
+   u32* candidates = AllocateArray(u32, numIndices, Lifetime_Frame);
+
+   u64 time = cacheSize + 1;
+   u64 cursor = 0;
+   u64 numOut = 0;
+   u64 numClusters = 0;
+
+   // Every fan starts at a vertex with triangles left, so no cluster is empty
+   // and there are at most numTris of them.
+   i64 fan = -1;
+   while (fan == -1 && cursor < numVerts) {
+      if (liveTris[cursor] > 0) {
+         fan = cursor;
+      }
+      cursor++;
+   }
+   bool newCluster = true;
+   while (fan >= 0) {
+      if (newCluster) {
+         outClusters[numClusters].firstTri = numOut / 3;
+         numClusters++;
+         newCluster = false;
+      }
+
+      u64 numCandidates = 0;
+      for (u64 ai = adjOffsets[fan]; ai < adjOffsets[fan + 1]; ++ai) {
+         u32 tri = adj[ai];
+         if (emitted[tri]) {
+            continue;
+         }
+         emitted[tri] = true;
+         for (int c = 0; c < 3; ++c) {
+            u32 v = indices[tri * 3 + c];
+            outIndices[numOut++] = v;
+            deadEnds[numDeadEnds++] = v;
+            candidates[numCandidates++] = v;
+            liveTris[v]--;
+            if (time - cacheTime[v] > cacheSize) {
+               cacheTime[v] = time++;
+            }
+         }
+      }
+
+      // Pick the candidate that will stay longest in the cache after its fan.
+      i64 next = -1;
+      i64 bestPriority = -1;
+      for (u64 ci = 0; ci < numCandidates; ++ci) {
+         u32 v = candidates[ci];
+         if (liveTris[v] > 0) {
+            i64 priority = 0;
+            if (time - cacheTime[v] + 2 * liveTris[v] <= cacheSize) {
+               priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+               bestPriority = priority;
+               next = v;
+            }
+         }
+      }
+
+      if (next == -1) {
+         // Dead end. Try recently used vertices, then anything left.
+         newCluster = true;
+         while (numDeadEnds > 0 && next == -1) {
+            u32 v = deadEnds[--numDeadEnds];
+            if (liveTris[v] > 0) {
+               next = v;
+            }
+         }
+         while (next == -1 && cursor < numVerts) {
+            if (liveTris[cursor] > 0) {
+               next = cursor;
+            }
+            cursor++;
+         }
+      }
+      fan = next;
+   }
+
+   for (u64 ci = 0; ci < numClusters; ++ci) {
+      u64 end = (ci + 1 < numClusters) ? outClusters[ci + 1].firstTri : numTris;
+      outClusters[ci].numTris = end - outClusters[ci].firstTri;
+   }
+
+   return numClusters;
+}
+
+// Sort clusters so that the ones facing away from the mesh center go first.
+// They are the ones most likely to occlude the rest.
+static void
+sortClustersForOverdraw(const Mesh* m, u32* indices, TipsifyCluster* clusters, u64 numClusters)
+{
+   vec3 meshCenter = {};
+   for (u64 vi = 0; vi < m->numVerts; ++vi) {
+      meshCenter += m->sPositions[vi].xyz;
+   }
+   meshCenter /= (float)Max(m->numVerts, 1);
+
+   for (u64 ci = 0; ci < numClusters; ++ci) {
+      TipsifyCluster* c = clusters + ci;
+      vec3 center = {};
+      vec3 normal = {};
+      float area = 0;
+      for (u64 t = c->firstTri; t < c->firstTri + c->numTris; ++t) {
+         vec3 a = m->sPositions[indices[t * 3 + 0]].xyz;
+         vec3 b = m->sPositions[indices[t * 3 + 1]].xyz;
+         vec3 d = m->sPositions[indices[t * 3 + 2]].xyz;
+         vec3 n = cross(b - a, d - a);  // Length is twice the area.
+         float triArea = norm(n);
+         center += triArea * (a + b + d) / 3.0f;
+         normal += n;
+         area += triArea;
+      }
+      if (area > 0) {
+         center /= area;
+      }
+      c->sortKey = dot(center - meshCenter, normalizedOrZero(normal));
+   }
+
+   qsort(clusters, numClusters, sizeof(TipsifyCluster), compareClusters);
+}
+
+void
+meshOptimize(Mesh* m)
+{
+   u64 numTris = m->numIndices / 3;
+   if (numTris == 0) {
+      return;
+   }
+
+   // Triangle order.
+   u32* tipsified = AllocateArray(u32, m->numIndices, Lifetime_Frame);
+   TipsifyCluster* clusters = AllocateArray(TipsifyCluster, numTris, Lifetime_Frame);
+   u64 numClusters = tipsify(m->sIndices, m->numIndices, m->numVerts, gKnobs.vertexCacheSize, tipsified, clusters);
+
+   sortClustersForOverdraw(m, tipsified, clusters, numClusters);
+
+   {
+      u64 out = 0;
+      for (u64 ci = 0; ci < numClusters; ++ci) {
+         u64 n = clusters[ci].numTris * 3;
+         memcpy(m->sIndices + out, tipsified + clusters[ci].firstTri * 3, sizeof(u32) * n);
+         out += n;
+      }
+      Assert(out == m->numIndices);
+   }
+
+   // Vertex order matches first use. Unreferenced vertices are dropped.
+   u32* remap = AllocateArray(u32, m->numVerts, Lifetime_Frame);
+   memset(remap, 0xff, sizeof(u32) * m->numVerts);
+   u64 numUsed = 0;
+   for (u64 i = 0; i < m->numIndices; ++i) {
+      u32 v = m->sIndices[i];
+      if (remap[v] == 0xffffffff) {
+         remap[v] = numUsed++;
+      }
+      m->sIndices[i] = remap[v];
+   }
+
+   vec4* positions = AllocateArray(vec4, numUsed, Lifetime_Frame);
+   vec3* normals = AllocateArray(vec3, numUsed, Lifetime_Frame);
+   vec2* texcoords = AllocateArray(vec2, numUsed, Lifetime_Frame);
+   vec4* colors = AllocateArray(vec4, numUsed, Lifetime_Frame);
+   for (u64 v = 0; v < m->numVerts; ++v) {
+      u32 r = remap[v];
+      if (r != 0xffffffff) {
+         positions[r] = m->sPositions[v];
+         normals[r] = m->sNormals[v];
+         texcoords[r] = m->sTexcoords[v];
+         colors[r] = m->sColors[v];
+      }
+   }
+   memcpy(m->sPositions, positions, sizeof(*positions) * numUsed);
+   memcpy(m->sNormals, normals, sizeof(*normals) * numUsed);
+   memcpy(m->sTexcoords, texcoords, sizeof(*texcoords) * numUsed);
+   memcpy(m->sColors, colors, sizeof(*colors) * numUsed);
+
+   arrsetlen(m->sPositions, numUsed);
+   arrsetlen(m->sNormals, numUsed);
+   arrsetlen(m->sTexcoords, numUsed);
+   arrsetlen(m->sColors, numUsed);
+   m->numVerts = numUsed;
+}
+
+// ================================
+// Mesh simplification
+// ================================
+
+// Garland, Heckbert - "Surface Simplification Using Quadric Error Metrics".
+// A quadric holds the weighted sum of squared distances to a set of planes.
+// Divided by the total weight it gives the mean squared distance, in world
+// units.
+struct Quadric
+{
+   double a00, a01, a02, a11, a12, a22;
+   double b0, b1, b2;
+   double c;
+   double w;
+};
+
+// Plane is dot(n, p) + d = 0, with n unit length.
+static void
+quadricAddPlane(Quadric* q, vec3 n, float d, float w)
+{
+   q->a00 += w * n.x * n.x;
+   q->a01 += w * n.x * n.y;
+   q->a02 += w * n.x * n.z;
+   q->a11 += w * n.y * n.y;
+   q->a12 += w * n.y * n.z;
+   q->a22 += w * n.z * n.z;
+   q->b0 += w * n.x * d;
+   q->b1 += w * n.y * d;
+   q->b2 += w * n.z * d;
+   q->c += w * d * d;
+   q->w += w;
+}
+
+static void
+quadricAdd(Quadric* q, const Quadric* o)
+{
+   q->a00 += o->a00; q->a01 += o->a01; q->a02 += o->a02;
+   q->a11 += o->a11; q->a12 += o->a12; q->a22 += o->a22;
+   q->b0 += o->b0; q->b1 += o->b1; q->b2 += o->b2;
+   q->c += o->c;
+   q->w += o->w;
+}
+
+static double
+quadricError(const Quadric* q, vec3 p)
+{
+   double x = p.x, y = p.y, z = p.z;
+   double e = q->a00*x*x + q->a11*y*y + q->a22*z*z +
+              2 * (q->a01*x*y + q->a02*x*z + q->a12*y*z) +
+              2 * (q->b0*x + q->b1*y + q->b2*z) +
+              q->c;
+   return (q->w > 0) ? Max(e, 0.0) / q->w : 0.0;
+}
+
+// The simplifier works on positions. Vertices that share a position (the
+// wedge) differ in normal or texcoord, and collapsing a position moves all of
+// them. Positions never move: a collapse snaps one position onto a neighbor,
+// so every LOD indexes into the same vertex buffer.
+struct SimplifyContext
+{
+   const Mesh* mesh;
+
+   u64 numPositions;
+   u32* posOf;  // Vertex -> position
+   u32* wedgeStart;  // Position -> first vertex in wedges. numPositions + 1 entries.
+   u32* wedges;  // Vertices grouped by position.
+
+   u32* tris;
+   u64 numTris;
+   u32* adjStart;  // Position -> first triangle in adjTris. numPositions + 1 entries.
+   u32* adjTris;
+
+   Quadric* quadrics;
+};
+
+struct Collapse
+{
+   u32 from;
+   u32 to;
+   double cost;
+};
+
+static int
+compareCollapses(const void* va, const void* vb)
+{
+   const Collapse* a = (const Collapse*)va;
+   const Collapse* b = (const Collapse*)vb;
+   return (a->cost < b->cost) ? -1 : (a->cost > b->cost) ? 1 : 0;
+}
+
+static u32
+hashPosition(vec3 p)
+{
+   // Adding zero turns -0 into +0, so that equal positions hash the same.
+   float f[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };
+   u32 u[3];
+   memcpy(u, f, sizeof(u));
+   u32 h = u[0] * 73856093u ^ u[1] * 19349663u ^ u[2] * 83492791u;
+   return h ^ (h >> 15);
+}
+
+static vec3
+simplifyPosition(const SimplifyContext* ctx, u32 pos)
+{
+   return ctx->mesh->sPositions[ctx->wedges[ctx->wedgeStart[pos]]].xyz;
+}
+
+static bool
+texcoordsEqual(vec2 a, vec2 b)
+{
+   return a.u == b.u && a.v == b.v;
+}
+
+static void
+simplifyBuildPositions(SimplifyContext* ctx)
+{
+   const Mesh* m = ctx->mesh;
+
+   u64 capacity = 1;
+   while (capacity < m->numVerts * 2) {
+      capacity *= 2;
+   }
+   u32* slots = AllocateArray(u32, capacity, Lifetime_Frame);  // Vertex index + 1
+   u32* counts = AllocateArray(u32, m->numVerts + 1, Lifetime_Frame);
+
+   ctx->posOf = AllocateArray(u32, m->numVerts, Lifetime_Frame);
+   ctx->numPositions = 0;
+   for (u64 vi = 0; vi < m->numVerts; ++vi) {
+      vec3 p = m->sPositions[vi].xyz;
+      u64 slot = hashPosition(p) & (capacity - 1);
+      while (slots[slot]) {
+         vec3 q = m->sPositions[slots[slot] - 1].xyz;
+         if (p.x == q.x && p.y == q.y && p.z == q.z) {
+            break;
+         }
+         slot = (slot + 1) & (capacity - 1);
+      }
+      if (!slots[slot]) {
+         slots[slot] = vi + 1;
+         ctx->posOf[vi] = ctx->numPositions++;
+      }
+      else {
+         ctx->posOf[vi] = ctx->posOf[slots[slot] - 1];
+      }
+      counts[ctx->posOf[vi]]++;
+   }
+
+   ctx->wedgeStart = AllocateArray(u32, ctx->numPositions + 1, Lifetime_Frame);
+   ctx->wedges = AllocateArray(u32, m->numVerts, Lifetime_Frame);
+   for (u64 p = 0; p < ctx->numPositions; ++p) {
+      ctx->wedgeStart[p + 1] = ctx->wedgeStart[p] + counts[p];
+      counts[p] = 0;
+   }
+   for (u64 vi = 0; vi < m->numVerts; ++vi) {
+      u32 p = ctx->posOf[vi];
+      ctx->wedges[ctx->wedgeStart[p] + counts[p]++] = vi;
+   }
+}
+
+static void
+simplifyBuildAdjacency(SimplifyContext* ctx)
+{
+   u32* counts = AllocateArray(u32, ctx->numPositions, Lifetime_Frame);
+   for (u64 i = 0; i < ctx->numTris * 3; ++i) {
+      counts[ctx->posOf[ctx->tris[i]]]++;
+   }
+
+   ctx->adjStart = AllocateArray(u32, ctx->numPositions + 1, Lifetime_Frame);
+   ctx->adjTris = AllocateArray(u32, ctx->numTris * 3, Lifetime_Frame);
+   for (u64 p = 0; p < ctx->numPositions; ++p) {
+      ctx->adjStart[p + 1] = ctx->adjStart[p] + counts[p];
+      counts[p] = 0;
+   }
+   for (u64 t = 0; t < ctx->numTris; ++t) {
+      for (int c = 0; c < 3; ++c) {
+         u32 p = ctx->posOf[ctx->tris[t * 3 + c]];
+         ctx->adjTris[ctx->adjStart[p] + counts[p]++] = t;
+      }
+   }
+}
+
+// Returns the corner of triangle t at position pos, or -1.
+static int
+triCorner(const SimplifyContext* ctx, u32 t, u32 pos)
+{
+   int corner = -1;
+   for (int c = 0; c < 3; ++c) {
+      if (ctx->posOf[ctx->tris[t * 3 + c]] == pos) {
+         corner = c;
+      }
+   }
+   return corner;
+}
+
+// Each triangle adds its plane to its corners. Edges with no matching
+// triangle on the other side, either mesh borders or texcoord seams, add a
+// plane perpendicular to the triangle so that they keep their shape.
+static void
+simplifyBuildQuadrics(SimplifyContext* ctx)
+{
+   const float kBorderWeight = 10.0f;
+   const Mesh* m = ctx->mesh;
+
+   ctx->quadrics = AllocateArray(Quadric, ctx->numPositions, Lifetime_Frame);
+
+   for (u64 t = 0; t < ctx->numTris; ++t) {
+      u32* v = ctx->tris + t * 3;
+      vec3 p[3] = { m->sPositions[v[0]].xyz, m->sPositions[v[1]].xyz, m->sPositions[v[2]].xyz };
+      vec3 n = cross(p[1] - p[0], p[2] - p[0]);
+      float area = 0.5f * norm(n);
+      if (area == 0) {
+         continue;
+      }
+      n = normalizedOrZero(n);
+      for (int c = 0; c < 3; ++c) {
+         quadricAddPlane(ctx->quadrics + ctx->posOf[v[c]], n, -dot(n, p[0]), area);
+      }
+
+      for (int e = 0; e < 3; ++e) {
+         u32 va = v[e];
+         u32 vb = v[(e + 1) % 3];
+         u32 pa = ctx->posOf[va];
+         u32 pb = ctx->posOf[vb];
+         vec2 ta = m->sTexcoords[va];
+         vec2 tb = m->sTexcoords[vb];
+
+         bool matched = false;
+         for (u32 ai = ctx->adjStart[pa]; !matched && ai < ctx->adjStart[pa + 1]; ++ai) {
+            u32 other = ctx->adjTris[ai];
+            int cb = triCorner(ctx, other, pb);
+            if (other != t && cb >= 0) {
+               int ca = triCorner(ctx, other, pa);
+               matched = texcoordsEqual(m->sTexcoords[ctx->tris[other * 3 + ca]], ta) &&
+                         texcoordsEqual(m->sTexcoords[ctx->tris[other * 3 + cb]], tb);
+            }
+         }
+         if (!matched) {
+            vec3 edge = p[(e + 1) % 3] - p[e];
+            vec3 bn = normalizedOrZero(cross(edge, n));
+            float w = kBorderWeight * dot(edge, edge);
+            quadricAddPlane(ctx->quadrics + pa, bn, -dot(bn, p[e]), w);
+            quadricAddPlane(ctx->quadrics + pb, bn, -dot(bn, p[e]), w);
+         }
+      }
+   }
+}
+
+// When position `from` collapses onto `to`, each corner at `from` takes a
+// vertex from the wedge at `to`. The texcoord has to come from the same UV
+// island, which we find through a triangle that has both positions and the
+// same texcoord at `from`. Among matching vertices the closest normal wins.
+// Returns false when the corner would cross a UV seam.
+static bool
+simplifyRemapCorner(const SimplifyContext* ctx, u32 vertex, u32 from, u32 to, u32* outVertex)
+{
+   const Mesh* m = ctx->mesh;
+   vec2 uv = m->sTexcoords[vertex];
+
+   bool found = false;
+   u32 expected = 0;
+   for (u32 ai = ctx->adjStart[from]; !found && ai < ctx->adjStart[from + 1]; ++ai) {
+      u32 t = ctx->adjTris[ai];
+      int ct = triCorner(ctx, t, to);
+      int cf = triCorner(ctx, t, from);
+      if (ct >= 0 && texcoordsEqual(m->sTexcoords[ctx->tris[t * 3 + cf]], uv)) {
+         expected = ctx->tris[t * 3 + ct];
+         found = true;
+      }
+   }
+
+   if (found) {
+      u32 best = expected;
+      float bestDot = dot(m->sNormals[expected], m->sNormals[vertex]);
+      for (u32 wi = ctx->wedgeStart[to]; wi < ctx->wedgeStart[to + 1]; ++wi) {
+         u32 w = ctx->wedges[wi];
+         float d = dot(m->sNormals[w], m->sNormals[vertex]);
+         if (texcoordsEqual(m->sTexcoords[w], m->sTexcoords[expected]) && d > bestDot) {
+            best = w;
+            bestDot = d;
+         }
+      }
+      *outVertex = best;
+   }
+   return found;
+}
+
+// Returns a negative cost if the collapse is not allowed.
+static double
+simplifyCollapseCost(const SimplifyContext* ctx, u32 from, u32 to)
+{
+   vec3 pFrom = simplifyPosition(ctx, from);
+   vec3 pTo = simplifyPosition(ctx, to);
+
+   for (u32 ai = ctx->adjStart[from]; ai < ctx->adjStart[from + 1]; ++ai) {
+      u32 t = ctx->adjTris[ai];
+      if (triCorner(ctx, t, to) >= 0) {
+         continue;  // Goes away with the collapse.
+      }
+
+      // Triangles that would flip.
+      vec3 p[3];
+      int cf = -1;
+      for (int c = 0; c < 3; ++c) {
+         u32 pos = ctx->posOf[ctx->tris[t * 3 + c]];
+         p[c] = simplifyPosition(ctx, pos);
+         if (pos == from) {
+            cf = c;
+         }
+      }
+      vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+      p[cf] = pTo;
+      vec3 after = cross(p[1] - p[0], p[2] - p[0]);
+      if (dot(before, after) <= 0) {
+         return -1;
+      }
+
+      u32 remapped = 0;
+      if (!simplifyRemapCorner(ctx, ctx->tris[t * 3 + cf], from, to, &remapped)) {
+         return -1;
+      }
+   }
+
+   Quadric q = ctx->quadrics[from];
+   quadricAdd(&q, ctx->quadrics + to);
+   return quadricError(&q, pTo);
+}
+
+u64
+meshSimplify(const Mesh* m, const u32* indices, u64 numIndices, u64 targetIndices, float targetError, u32* outIndices, float* outError)
+{
+   AABB bounds = computeBoundingBox(*m);
+   double extent = norm(bounds.max - bounds.min);
+   double maxCost = (targetError * extent) * (targetError * extent);
+
+   SimplifyContext ctx = {};
+   ctx.mesh = m;
+   ctx.tris = outIndices;
+
+   simplifyBuildPositions(&ctx);
+
+   // Triangles with two corners at the same position are dropped up front.
+   for (u64 t = 0; t < numIndices / 3; ++t) {
+      const u32* v = indices + t * 3;
+      u32 a = ctx.posOf[v[0]];
+      u32 b = ctx.posOf[v[1]];
+      u32 d = ctx.posOf[v[2]];
+      if (a != b && b != d && d != a) {
+         memcpy(ctx.tris + ctx.numTris * 3, v, sizeof(u32) * 3);
+         ctx.numTris++;
+      }
+   }
+
+   simplifyBuildAdjacency(&ctx);
+   simplifyBuildQuadrics(&ctx);
+
+   Collapse* collapses = AllocateArray(Collapse, ctx.numTris * 3, Lifetime_Frame);
+   u8* touched = AllocateArray(u8, ctx.numPositions, Lifetime_Frame);
+   double worstCost = 0;
+
+   // Each pass sorts all edges by cost and collapses the cheapest ones whose
+   // neighborhoods haven't changed during the pass.
+   while (ctx.numTris * 3 > targetIndices) {
+      u64 numCollapses = 0;
+      for (u64 t = 0; t < ctx.numTris; ++t) {
+         for (int e = 0; e < 3; ++e) {
+            u32 a = ctx.posOf[ctx.tris[t * 3 + e]];
+            u32 b = ctx.posOf[ctx.tris[t * 3 + (e + 1) % 3]];
+            double ab = simplifyCollapseCost(&ctx, a, b);
+            double ba = simplifyCollapseCost(&ctx, b, a);
+            if (ab >= 0 && (ba < 0 || ab <= ba)) {
+               collapses[numCollapses++] = Collapse{ a, b, ab };
+            }
+            else if (ba >= 0) {
+               collapses[numCollapses++] = Collapse{ b, a, ba };
+            }
+         }
+      }
+      qsort(collapses, numCollapses, sizeof(Collapse), compareCollapses);
+
+      // Adjacency doesn't change until the end of the pass, so one corner per
+      // triangle around the busiest position is enough for every collapse.
+      u32 maxValence = 0;
+      for (u64 p = 0; p < ctx.numPositions; ++p) {
+         maxValence = Max(maxValence, ctx.adjStart[p + 1] - ctx.adjStart[p]);
+      }
+      u32* remapped = AllocateArray(u32, maxValence, Lifetime_Frame);
+
+      memset(touched, 0, ctx.numPositions);
+      u64 numTrisLeft = ctx.numTris;
+      u64 numApplied = 0;
+      for (u64 ci = 0; ci < numCollapses && numTrisLeft * 3 > targetIndices; ++ci) {
+         Collapse c = collapses[ci];
+         if (c.cost > maxCost) {
+            break;
+         }
+         if (touched[c.from] || touched[c.to]) {
+            continue;
+         }
+
+         // Remap first, since the remap looks at the triangles that go away.
+         u64 numRemapped = 0;
+         for (u32 ai = ctx.adjStart[c.from]; ai < ctx.adjStart[c.from + 1]; ++ai) {
+            u32 t = ctx.adjTris[ai];
+            int cf = triCorner(&ctx, t, c.from);
+            if (triCorner(&ctx, t, c.to) < 0) {
+               simplifyRemapCorner(&ctx, ctx.tris[t * 3 + cf], c.from, c.to, remapped + numRemapped++);
+            }
+         }
+
+         numRemapped = 0;
+         for (u32 ai = ctx.adjStart[c.from]; ai < ctx.adjStart[c.from + 1]; ++ai) {
+            u32 t = ctx.adjTris[ai];
+            int cf = triCorner(&ctx, t, c.from);
+            for (int k = 0; k < 3; ++k) {
+               touched[ctx.posOf[ctx.tris[t * 3 + k]]] = 1;
+            }
+            int ct = triCorner(&ctx, t, c.to);
+            if (ct < 0) {
+               ctx.tris[t * 3 + cf] = remapped[numRemapped++];
+            }
+            else {
+               ctx.tris[t * 3 + cf] = ctx.tris[t * 3 + ct];  // Degenerate, dropped below.
+               numTrisLeft--;
+            }
+         }
+
+         quadricAdd(ctx.quadrics + c.to, ctx.quadrics + c.from);
+         worstCost = Max(worstCost, c.cost);
+         numApplied++;
+      }
+
+      if (numApplied == 0) {
+         break;
+      }
+
+      // Drop the triangles that collapsed.
+      u64 numKept = 0;
+      for (u64 t = 0; t < ctx.numTris; ++t) {
+         u32* v = ctx.tris + t * 3;
+         u32 a = ctx.posOf[v[0]];
+         u32 b = ctx.posOf[v[1]];
+         u32 d = ctx.posOf[v[2]];
+         if (a != b && b != d && d != a) {
+            memmove(ctx.tris + numKept * 3, v, sizeof(u32) * 3);
+            numKept++;
+         }
+      }
+      Assert(numKept == numTrisLeft);
+      ctx.numTris = numKept;
+
+      simplifyBuildAdjacency(&ctx);
+   }
+
+   if (outError) {
+      *outError = (extent > 0) ? (float)(sqrt(worstCost) / extent) : 0.0f;
+   }
+   return ctx.numTris * 3;
+}
+
+void
+meshBuildLods(Mesh* m, Lifetime life)
+{
+   m->numLods = 1;
+   m->lods[0] = MeshLod{ 0, m->numIndices, 0.0f };
+
+   u32* lodIndices = AllocateArray(u32, m->numIndices, Lifetime_Frame);
+   u32* tipsified = AllocateArray(u32, m->numIndices, Lifetime_Frame);
+   TipsifyCluster* clusters = AllocateArray(TipsifyCluster, m->numIndices / 3, Lifetime_Frame);
+
+   while (m->numLods < MaxMeshLods) {
+      MeshLod prev = m->lods[m->numLods - 1];
+      u64 target = (u64)(prev.numIndices / 3 * gKnobs.lodReduction) * 3;
+
+      // Each level is simplified from the previous one, so errors add up.
+      float error = 0;
+      float maxError = gKnobs.lodMaxError - prev.error;
+      u64 numIndices = meshSimplify(m, m->sIndices + prev.firstIndex, prev.numIndices, target, maxError, lodIndices, &error);
+
+      // Not worth another level.
+      if (numIndices == 0 || numIndices > prev.numIndices * 0.8f) {
+         break;
+      }
+
+      tipsify(lodIndices, numIndices, m->numVerts, gKnobs.vertexCacheSize, tipsified, clusters);
+
+      MeshLod lod = {};
+      lod.firstIndex = prev.firstIndex + prev.numIndices;
+      lod.numIndices = numIndices;
+      lod.error = prev.error + error;
+
+      SBResize(m->sIndices, lod.firstIndex + lod.numIndices, life);
+      memcpy(m->sIndices + lod.firstIndex, tipsified, sizeof(u32) * numIndices);
+
+      m->lods[m->numLods++] = lod;
+   }
+}
+
+// ================================
+// Meshlets
+// ================================
+
+// Face normal on the side the vertex normals point to, so the cone doesn't
+// depend on the winding convention of the file.
+static vec3
+meshletFaceNormal(const Mesh* m, const u32* tri)
+{
+   vec3 a = m->sPositions[tri[0]].xyz;
+   vec3 b = m->sPositions[tri[1]].xyz;
+   vec3 c = m->sPositions[tri[2]].xyz;
+   vec3 n = normalizedOrZero(cross(b - a, c - a));
+   vec3 vn = m->sNormals[tri[0]] + m->sNormals[tri[1]] + m->sNormals[tri[2]];
+   if (dot(n, vn) < 0) {
+      n = -n;
+   }
+   return n;
+}
+
+void
+meshletComputeBounds(const Mesh* m, Meshlet* ml)
+{
+   const u32* indices = m->sIndices + ml->firstIndex;
+   u64 numIndices = ml->numTris * 3;
+
+   AABB box = { vec3{ MaxFloat, MaxFloat, MaxFloat }, vec3{ -MaxFloat, -MaxFloat, -MaxFloat } };
+   for (u64 i = 0; i < numIndices; ++i) {
+      vec3 p = m->sPositions[indices[i]].xyz;
+      box.min = vec3{ Min(box.min.x, p.x), Min(box.min.y, p.y), Min(box.min.z, p.z) };
+      box.max = vec3{ Max(box.max.x, p.x), Max(box.max.y, p.y), Max(box.max.z, p.z) };
+   }
+   ml->center = 0.5f * (box.min + box.max);
+   ml->radius = 0;
+   for (u64 i = 0; i < numIndices; ++i) {
+      ml->radius = Max(ml->radius, norm(m->sPositions[indices[i]].xyz - ml->center));
+   }
+
+   // The cone contains every face normal. Past 90 degrees some triangle
+   // always faces the eye.
+   vec3 axis = {};
+   for (u64 t = 0; t < ml->numTris; ++t) {
+      axis += meshletFaceNormal(m, indices + t * 3);
+   }
+   axis = normalizedOrZero(axis);
+
+   float minDot = 1;
+   for (u64 t = 0; t < ml->numTris; ++t) {
+      minDot = Min(minDot, dot(axis, meshletFaceNormal(m, indices + t * 3)));
+   }
+
+   ml->coneAxis = axis;
+   ml->coneCutoff = (norm(axis) > 0 && minDot > 0) ? sqrtf(1 - minDot * minDot) : 1.0f;
+}
+
+// Meshlets grow over triangles that share a position with them, taking the
+// one that adds the fewest vertices and bends the normal cone the least.
+// Seeds follow the current triangle order, so after meshOptimize the
+// meshlets stay close to the cache-friendly order. The meshlets are then
+// sorted for overdraw like the Tipsify clusters.
+void
+meshBuildMeshlets(Mesh* m, Lifetime life)
+{
+   const float kConeWeight = 2.0f;
+
+   u64 numTris = m->numIndices / 3;
+   m->sMeshlets = nullptr;
+   m->numMeshlets = 0;
+   if (numTris == 0) {
+      return;
+   }
+
+   // Position adjacency, shared with the simplifier.
+   SimplifyContext ctx = {};
+   ctx.mesh = m;
+   ctx.tris = m->sIndices;
+   ctx.numTris = numTris;
+   simplifyBuildPositions(&ctx);
+   simplifyBuildAdjacency(&ctx);
+
+   vec3* faceNormals = AllocateArray(vec3, numTris, Lifetime_Frame);
+   for (u64 t = 0; t < numTris; ++t) {
+      faceNormals[t] = meshletFaceNormal(m, m->sIndices + t * 3);
+   }
+
+   u8* used = AllocateArray(u8, numTris, Lifetime_Frame);
+   u64* vertexStamp = AllocateArray(u64, m->numVerts, Lifetime_Frame);  // Meshlet + 1 that last took the vertex.
+   u64* candidateStamp = AllocateArray(u64, numTris, Lifetime_Frame);
+   u32* candidates = AllocateArray(u32, numTris, Lifetime_Frame);
+   u32* order = AllocateArray(u32, numTris, Lifetime_Frame);
+   TipsifyCluster* clusters = AllocateArray(TipsifyCluster, numTris, Lifetime_Frame);
+
+   u64 numOrdered = 0;
+   u64 numClusters = 0;
+   u64 seed = 0;
+   while (numOrdered < numTris) {
+      while (used[seed]) {
+         seed++;
+      }
+
+      u64 stamp = numClusters + 1;
+      TipsifyCluster* cluster = clusters + numClusters++;
+      *cluster = {};
+      cluster->firstTri = numOrdered;
+
+      u32 numVerts = 0;
+      u64 numCandidates = 0;
+      vec3 axis = {};
+
+      u32 next = seed;
+      while (true) {
+         // Take the triangle.
+         used[next] = 1;
+         order[numOrdered++] = next;
+         cluster->numTris++;
+         axis += faceNormals[next];
+         for (int c = 0; c < 3; ++c) {
+            u32 v = m->sIndices[next * 3 + c];
+            if (vertexStamp[v] != stamp) {
+               vertexStamp[v] = stamp;
+               numVerts++;
+            }
+            u32 pos = ctx.posOf[v];
+            for (u32 ai = ctx.adjStart[pos]; ai < ctx.adjStart[pos + 1]; ++ai) {
+               u32 t = ctx.adjTris[ai];
+               if (!used[t] && candidateStamp[t] != stamp) {
+                  candidateStamp[t] = stamp;
+                  candidates[numCandidates++] = t;
+               }
+            }
+         }
+
+         if (cluster->numTris == gKnobs.meshletMaxTris) {
+            break;
+         }
+
+         // Pick the next one.
+         vec3 dir = normalizedOrZero(axis);
+         float bestScore = MaxFloat;
+         for (u64 ci = 0; ci < numCandidates; ++ci) {
+            u32 t = candidates[ci];
+            if (used[t]) {
+               continue;
+            }
+            u32 newVerts = 0;
+            for (int c = 0; c < 3; ++c) {
+               newVerts += vertexStamp[m->sIndices[t * 3 + c]] != stamp;
+            }
+            float score = newVerts + kConeWeight * (1 - dot(dir, faceNormals[t]));
+            if (numVerts + newVerts <= gKnobs.meshletMaxVerts && score < bestScore) {
+               bestScore = score;
+               next = t;
+            }
+         }
+         if (bestScore == MaxFloat) {
+            break;
+         }
+      }
+   }
+
+   u32* ordered = AllocateArray(u32, m->numIndices, Lifetime_Frame);
+   for (u64 i = 0; i < numTris; ++i) {
+      memcpy(ordered + i * 3, m->sIndices + order[i] * 3, sizeof(u32) * 3);
+   }
+
+   sortClustersForOverdraw(m, ordered, clusters, numClusters);
+
+   SBResize(m->sMeshlets, numClusters, life);
+   m->numMeshlets = numClusters;
+   u64 out = 0;
+   for (u64 ci = 0; ci < numClusters; ++ci) {
+      u64 n = clusters[ci].numTris * 3;
+      memcpy(m->sIndices + out, ordered + clusters[ci].firstTri * 3, sizeof(u32) * n);
+
+      Meshlet* ml = m->sMeshlets + ci;
+      *ml = {};
+      ml->firstIndex = out;
+      ml->numTris = clusters[ci].numTris;
+      for (u64 i = 0; i < n; ++i) {
+         u32 v = m->sIndices[out + i];
+         if (vertexStamp[v] != numTris + 1 + ci) {
+            vertexStamp[v] = numTris + 1 + ci;
+            ml->numVerts++;
+         }
+      }
+      meshletComputeBounds(m, ml);
+
+      out += n;
+   }
+   Assert(out == m->numIndices);
+}
+
+bool
+meshletIsVisible(const Meshlet* ml, const Frustum* f, vec3 eye, bool cullBackfaces)
+{
+   bool visible = frustumTestSphere(f, ml->center, ml->radius);
+   if (visible && cullBackfaces) {
+      vec3 d = ml->center - eye;
+      visible = dot(d, ml->coneAxis) < ml->coneCutoff * norm(d) + ml->radius;
+   }
+   return visible;
+}
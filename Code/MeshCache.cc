@@ -0,0 +1,255 @@
+// Cooked mesh cache.
+//
+// The first time an .obj is loaded we write <path>.cooked next to it, with
+// the vertex stream already in MeshRenderVertex layout, the index buffer and
+// the bounding box. With gKnobs.optimizeMeshes the mesh goes through
+// meshOptimize before cooking, with gKnobs.buildMeshlets the triangles are
+// grouped into meshlets, and with gKnobs.buildMeshLods the LOD chain is
+// appended to the index buffer, so those costs are only paid once. Afterwards the
+// cooked file is memory-mapped, or found in the asset pack, and the GPU upload
+// reads straight from the mapping. A loose file is unmapped once the mesh is
+// uploaded, so that it can be rewritten. The header stores a MeowHash of the
+// source file; when it doesn't match, the cache is rebuilt.
+
+#define CookedMeshMagic 0x4853454D  // 'MESH'
+#define CookedMeshVersion 5
+
+struct CookedMeshHeader
+{
+   u32 magic;
+   u32 version;
+   u64 sourceHash[2];  // MeowHash of the .obj file
+
+   u64 numVerts;
+   u64 numIndices;  // All LODs
+   u32 indexSize;  // 2 or 4 bytes
+   u32 optimized;  // gKnobs.optimizeMeshes at cook time
+   u32 withLods;  // gKnobs.buildMeshLods at cook time
+   u32 withMeshlets;  // gKnobs.buildMeshlets at cook time
+   u32 numLods;
+   MeshLod lods[MaxMeshLods];
+   AABB bounds;
+
+   u64 vertexOffset;  // From the start of the file
+   u64 indexOffset;
+   u64 numMeshlets;
+   u64 meshletOffset;
+   u64 totalBytes;
+};
+
+static bool
+cookedMeshIsValid(u8* cooked, u64 cookedBytes, meow_u128 sourceHash)
+{
+   bool valid = false;
+   if (cooked && cookedBytes >= sizeof(CookedMeshHeader)) {
+      CookedMeshHeader* h = (CookedMeshHeader*)cooked;
+      valid = h->magic == CookedMeshMagic &&
+              h->version == CookedMeshVersion &&
+              h->sourceHash[0] == MeowU64From(sourceHash, 0) &&
+              h->sourceHash[1] == MeowU64From(sourceHash, 1) &&
+              h->totalBytes == cookedBytes &&
+              h->optimized == (u32)gKnobs.optimizeMeshes &&
+              h->withLods == (u32)gKnobs.buildMeshLods &&
+              h->withMeshlets == (u32)gKnobs.buildMeshlets &&
+              h->numLods >= 1 && h->numLods <= MaxMeshLods &&
+              (h->indexSize == sizeof(u16) || h->indexSize == sizeof(u32)) &&
+              h->vertexOffset + h->numVerts * sizeof(MeshRenderVertex) <= cookedBytes &&
+              h->indexOffset + h->numIndices * h->indexSize <= cookedBytes &&
+              h->meshletOffset + h->numMeshlets * sizeof(Meshlet) <= cookedBytes;
+   }
+   return valid;
+}
+
+// The world still wants the CPU arrays for picking and collision, so they are
+// unpacked from the cooked stream and outlive the mapping. The GPU upload uses
+// the mapped data.
+// Positions and indices are exact; normals, texcoords and colors come back
+// within the error bounds of their packed formats.
+static Mesh
+meshFromCooked(u8* cooked, Lifetime life)
+{
+   CookedMeshHeader* h = (CookedMeshHeader*)cooked;
+
+   Mesh mesh = {};
+   mesh.numVerts = h->numVerts;
+   mesh.numIndices = h->lods[0].numIndices;
+   mesh.numLods = h->numLods;
+   memcpy(mesh.lods, h->lods, sizeof(mesh.lods));
+   mesh.cookedVerts = (MeshRenderVertex*)(cooked + h->vertexOffset);
+   mesh.cookedIndices = cooked + h->indexOffset;
+   mesh.cookedIndexSize = h->indexSize;
+   mesh.cookedBounds = h->bounds;
+
+   SBResize(mesh.sPositions, mesh.numVerts, life);
+   SBResize(mesh.sNormals, mesh.numVerts, life);
+   SBResize(mesh.sTexcoords, mesh.numVerts, life);
+   SBResize(mesh.sColors, mesh.numVerts, life);
+   SBResize(mesh.sIndices, h->numIndices, life);
+
+   for (u64 vi = 0; vi < mesh.numVerts; ++vi) {
+      MeshRenderVertex* v = mesh.cookedVerts + vi;
+      mesh.sPositions[vi] = vec4{ v->position.x, v->position.y, v->position.z, 1.0f };
+      mesh.sNormals[vi] = octDecodeNormal(v->normal);
+      mesh.sTexcoords[vi] = vec2{ halfToFloat(v->texcoord[0]), halfToFloat(v->texcoord[1]) };
+      mesh.sColors[vi] = unpackColorRGBA8(v->color);
+   }
+
+   if (h->indexSize == sizeof(u16)) {
+      u16* indices = (u16*)mesh.cookedIndices;
+      for (u64 ii = 0; ii < h->numIndices; ++ii) {
+         mesh.sIndices[ii] = indices[ii];
+      }
+   }
+   else {
+      memcpy(mesh.sIndices, mesh.cookedIndices, h->numIndices * sizeof(u32));
+   }
+
+   if (h->numMeshlets) {
+      mesh.numMeshlets = h->numMeshlets;
+      SBResize(mesh.sMeshlets, mesh.numMeshlets, life);
+      memcpy(mesh.sMeshlets, cooked + h->meshletOffset, mesh.numMeshlets * sizeof(Meshlet));
+   }
+
+   return mesh;
+}
+
+static bool
+writeCookedMesh(Platform* plat, char* cookedPath, const Mesh& mesh, meow_u128 sourceHash)
+{
+   CookedMeshHeader h = {};
+   h.magic = CookedMeshMagic;
+   h.version = CookedMeshVersion;
+   h.sourceHash[0] = MeowU64From(sourceHash, 0);
+   h.sourceHash[1] = MeowU64From(sourceHash, 1);
+   h.numVerts = mesh.numVerts;
+   h.indexSize = (mesh.numVerts <= 0xFFFF) ? sizeof(u16) : sizeof(u32);
+   h.optimized = gKnobs.optimizeMeshes;
+   h.withLods = gKnobs.buildMeshLods;
+   h.withMeshlets = gKnobs.buildMeshlets;
+   if (mesh.numLods) {
+      h.numLods = mesh.numLods;
+      memcpy(h.lods, mesh.lods, sizeof(h.lods));
+   }
+   else {
+      h.numLods = 1;
+      h.lods[0] = MeshLod{ 0, mesh.numIndices, 0.0f };
+   }
+   h.numIndices = h.lods[h.numLods - 1].firstIndex + h.lods[h.numLods - 1].numIndices;
+   h.bounds = computeBoundingBox(mesh);
+   h.vertexOffset = AlignPow2(sizeof(CookedMeshHeader), 16);
+   h.indexOffset = AlignPow2(h.vertexOffset + h.numVerts * sizeof(MeshRenderVertex), 16);
+   h.numMeshlets = mesh.numMeshlets;
+   h.meshletOffset = AlignPow2(h.indexOffset + h.numIndices * h.indexSize, 16);
+   h.totalBytes = h.meshletOffset + h.numMeshlets * sizeof(Meshlet);
+
+   u8* bytes = allocateBytes(h.totalBytes, Lifetime_Frame);
+
+   memcpy(bytes, &h, sizeof(h));
+
+   MeshRenderVertex* verts = packRenderVerts(&mesh, Lifetime_Frame);
+   memcpy(bytes + h.vertexOffset, verts, h.numVerts * sizeof(MeshRenderVertex));
+
+   if (h.indexSize == sizeof(u16)) {
+      u16* indices = (u16*)(bytes + h.indexOffset);
+      for (u64 ii = 0; ii < h.numIndices; ++ii) {
+         indices[ii] = (u16)mesh.sIndices[ii];
+      }
+   }
+   else {
+      memcpy(bytes + h.indexOffset, mesh.sIndices, h.numIndices * sizeof(u32));
+   }
+
+   memcpy(bytes + h.meshletOffset, mesh.sMeshlets, h.numMeshlets * sizeof(Meshlet));
+
+   return plat->writeFileAscii(cookedPath, bytes, h.totalBytes);
+}
+
+// For callers that already read and hashed the source, like the asset registry.
+// Worker threads must pass numThreads = 1; only the main thread can add work.
+Mesh
+objLoadCachedFromSource(Platform* plat, char* path, u8* source, u64 sourceBytes, meow_u128 sourceHash, Lifetime life, u32 numThreads)
+{
+   if (!gKnobs.useMeshCache) {
+      return objLoadFromBytes(plat, source, sourceBytes, life, numThreads);
+   }
+
+   Mesh mesh = {};
+
+   char cookedPath[MaxPath] = {};
+   snprintf(cookedPath, ArrayCount(cookedPath), "%s.cooked", path);
+
+   // A packed cooked file is used in place. When it's stale, the loose file may still be good.
+   u64 cookedBytes = 0;
+   u8* cooked = assetPackView(cookedPath, &cookedBytes);
+   bool mapped = false;
+   if (!cookedMeshIsValid(cooked, cookedBytes, sourceHash)) {
+      cooked = plat->mapFileAscii(cookedPath, &cookedBytes);
+      mapped = true;
+   }
+
+   if (cookedMeshIsValid(cooked, cookedBytes, sourceHash)) {
+      mesh = meshFromCooked(cooked, life);
+      if (mapped) {
+         mesh.cookedMapping = cooked;
+      }
+   }
+   else {
+      if (cooked && mapped) {
+         plat->unmapFile(cooked);
+      }
+
+      mesh = objLoadFromBytes(plat, source, sourceBytes, life, numThreads);
+
+      if (gKnobs.optimizeMeshes) {
+         VertexCacheStats before = meshVertexCacheStats(mesh.sIndices, mesh.numIndices, mesh.numVerts, gKnobs.vertexCacheSize);
+         meshOptimize(&mesh);
+         VertexCacheStats after = meshVertexCacheStats(mesh.sIndices, mesh.numIndices, mesh.numVerts, gKnobs.vertexCacheSize);
+         logMsg("Optimized %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", path, before.acmr, after.acmr, before.atvr, after.atvr);
+      }
+
+      if (gKnobs.buildMeshlets) {
+         meshBuildMeshlets(&mesh, life);
+         VertexCacheStats stats = meshVertexCacheStats(mesh.sIndices, mesh.numIndices, mesh.numVerts, gKnobs.vertexCacheSize);
+         logMsg("Meshlets of %s: %lld, ACMR %.3f\n", path, mesh.numMeshlets, stats.acmr);
+      }
+
+      if (gKnobs.buildMeshLods) {
+         meshBuildLods(&mesh, life);
+         for (u32 i = 0; i < mesh.numLods; ++i) {
+            logMsg("LOD %d of %s: %lld triangles, error %.4f\n", i, path, mesh.lods[i].numIndices / 3, mesh.lods[i].error);
+         }
+      }
+
+      if (!writeCookedMesh(plat, cookedPath, mesh, sourceHash)) {
+         logMsg("Could not write cooked mesh %s\n", cookedPath);
+      }
+   }
+
+   return mesh;
+}
+
+// The asset pack stays mapped, so only a loose file is unmapped.
+void
+meshUnmapCooked(Platform* plat, Mesh* m)
+{
+   if (m->cookedMapping) {
+      plat->unmapFile(m->cookedMapping);
+      m->cookedMapping = nullptr;
+      m->cookedVerts = nullptr;
+      m->cookedIndices = nullptr;
+   }
+}
+
+Mesh
+objLoadCached(Platform* plat, char* path, Lifetime life)
+{
+   if (!gKnobs.useMeshCache) {
+      return objLoad(plat, path, life);
+   }
+
+   u8* source = nullptr;
+   u64 sourceBytes = assetFileContents(plat, path, source, Lifetime_Frame);
+   meow_u128 sourceHash = MeowHash(MeowDefaultSeed, sourceBytes, source);
+
+   return objLoadCachedFromSource(plat, path, source, sourceBytes, sourceHash, life, plat->numWorkerThreads + 1);
+}
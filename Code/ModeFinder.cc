@@ -1,65 +1,358 @@
-char** /*stretchy*/
-finderComputeResults(Finder* f, Lifetime life, CommandsEnum* selectedCmd)
+// Scores in the style of fzf: a query matches when its characters appear in
+// order. Matched characters score, more so at the start of a word or right
+// after another match, and gaps between them cost a little.
+enum FinderScores
 {
-   CommandsEnum* sCommandsEnum = {};
-   char** sCommands = listCommands(life, &sCommandsEnum);
+   FinderScore_Match = 16,
+   FinderScore_GapStart = -3,
+   FinderScore_GapExtension = -1,
+   FinderScore_WordStart = 8,
+   FinderScore_Consecutive = 4,
+   FinderScore_FirstCharMultiplier = 2,
+};
 
-   int* sDistances = {};
+static const i32 FinderNoMatch = -1;
 
-   pushApiLifetime(Lifetime_Frame);
-      arrsetlen(sDistances, arrlen(sCommands));
-   popApiLifetime();
+static u64
+finderCharBit(char c)
+{
+   u64 bit = 0;
+   if (c >= 'a' && c <= 'z') {
+      bit = 1ull << (c - 'a');
+   }
+   else if (c >= '0' && c <= '9') {
+      bit = 1ull << (26 + c - '0');
+   }
+   else {
+      bit = 1ull << (36 + (u8)c % 28);
+   }
+   return bit;
+}
 
-   for (sz i = 0; i < arrlen(sCommands); ++i) {
-      int cmdDist = 0;
-      // Compute distance for this entry
-      {
-         char* str = f->sSearchString;
+static u64
+finderCharMask(char* lower, u32 len)
+{
+   u64 mask = 0;
+   for (u32 i = 0; i < len; ++i) {
+      mask |= finderCharBit(lower[i]);
+   }
+   return mask;
+}
 
-         char* cmd = sCommands[i];
-         int cmdLen = strlen(cmd);
-         int strLen = arrlen(str);
+static bool
+finderIsWordStart(char* name, u32 i)
+{
+   bool start = i == 0;
+   if (!start) {
+      char prev = name[i - 1];
+      char c = name[i];
+      start = (!isalnum((u8)prev) && isalnum((u8)c)) ||
+              (islower((u8)prev) && isupper((u8)c)) ||
+              (isalpha((u8)prev) && isdigit((u8)c));
+   }
+   return start;
+}
 
-         for (int strIdx = 0; strIdx < strLen; ++strIdx) {
-            char c = str[strIdx];
-            int cDist = 20;
+// Returns FinderNoMatch, or the score of the shortest match that ends where
+// the first match does.
+static i32
+finderScore(char* name, char* lower, u32 len, char* query, u32 queryLen)
+{
+   u32 qi = 0;
+   u32 end = 0;
+   for (u32 i = 0; i < len && qi < queryLen; ++i) {
+      if (lower[i] == query[qi]) {
+         ++qi;
+         end = i + 1;
+      }
+   }
+   if (qi < queryLen) {
+      return FinderNoMatch;
+   }
 
-            for (int cmdIdx = 0; cmdIdx < cmdLen; ++cmdIdx) {
-               if (tolower(c) == tolower(cmd[cmdIdx])) {
-                  cDist = Min(cDist, abs(cmdIdx - strIdx));
-               }
-            }
+   u32 start = end;
+   while (qi > 0) {
+      --start;
+      if (lower[start] == query[qi - 1]) {
+         --qi;
+      }
+   }
 
-            cmdDist += cDist;
+   i32 score = 0;
+   i32 runBonus = 0;
+   bool inGap = false;
+   bool prevMatched = false;
+   for (u32 i = start; i < end; ++i) {
+      if (qi < queryLen && lower[i] == query[qi]) {
+         i32 bonus = finderIsWordStart(name, i) ? FinderScore_WordStart : 0;
+         if (prevMatched) {
+            // A run keeps the bonus of the character that started it.
+            runBonus = Max(runBonus, Max(bonus, (i32)FinderScore_Consecutive));
+            bonus = runBonus;
+         }
+         else {
+            runBonus = bonus;
+         }
+         if (qi == 0) {
+            bonus *= FinderScore_FirstCharMultiplier;
          }
+         score += FinderScore_Match + bonus;
+         inGap = false;
+         prevMatched = true;
+         ++qi;
+      }
+      else {
+         score += inGap ? FinderScore_GapExtension : FinderScore_GapStart;
+         inGap = true;
+         prevMatched = false;
       }
-      sDistances[i] = cmdDist;
    }
+   return score;
+}
 
-   // Just bubblesort for now. - 2020-01-17
-   for (sz i = 0; i < arrlen(sCommands); ++i) {
-      for (sz j = i+1; j < arrlen(sCommands); ++j) {
-         if (sDistances[i] > sDistances[j]) {
-            int dTmp = sDistances[i];
-            sDistances[i] = sDistances[j];
-            sDistances[j] = dTmp;
+void
+finderAddCandidate(Finder* f, char* name, u64 id)
+{
+   FinderIndex* index = &f->index;
+   u32 len = (u32)strlen(name);
+   u32 offset = (u32)SBCount(index->sChars);
+
+   // Names are copied so they outlive whoever listed them.
+   SBResize(index->sChars, offset + 2 * (len + 1), Lifetime_App);
+   char* copy = index->sChars + offset;
+   char* lower = copy + len + 1;
+   memcpy(copy, name, len + 1);
+   for (u32 c = 0; c <= len; ++c) {
+      lower[c] = (char)tolower((u8)copy[c]);
+   }
+
+   SBPush(index->sNameOffsets, offset, Lifetime_App);
+   SBPush(index->sLengths, len, Lifetime_App);
+   SBPush(index->sCharMasks, finderCharMask(lower, len), Lifetime_App);
+   SBPush(index->sIds, id, Lifetime_App);
+   index->numEntries++;
+
+   SBResize(f->sMatches, index->numEntries, Lifetime_App);
+}
+
+// Entries from firstIdx on go. Their memory is reused by the ones added next.
+void
+finderRemoveCandidatesFrom(Finder* f, u32 firstIdx)
+{
+   FinderIndex* index = &f->index;
+   if (firstIdx >= index->numEntries) {
+      return;
+   }
+   index->numEntries = firstIdx;
+   arrsetlen(index->sChars, index->sNameOffsets[firstIdx]);
+   arrsetlen(index->sNameOffsets, firstIdx);
+   arrsetlen(index->sLengths, firstIdx);
+   arrsetlen(index->sCharMasks, firstIdx);
+   arrsetlen(index->sIds, firstIdx);
 
-            char* cmdTmp = sCommands[i];
-            sCommands[i] = sCommands[j];
-            sCommands[j] = cmdTmp;
+   u32 numMatches = 0;
+   for (u32 m = 0; m < f->numMatches; ++m) {
+      if (f->sMatches[m] < firstIdx) {
+         f->sMatches[numMatches++] = f->sMatches[m];
+      }
+   }
+   f->numMatches = numMatches;
+   f->numFiltered = Min(f->numFiltered, firstIdx);
+   f->topStale = true;
+}
+
+static char*
+finderName(FinderIndex* index, u32 i)
+{
+   return index->sChars + index->sNameOffsets[i];
+}
+
+static char* gFinderAssetDirs[] = { "JamAssets", "Assets" };
+
+// The path asset loads use, from one relative to the asset folders' parent.
+static char*
+finderAssetPath(Platform* plat, char* relPath)
+{
+   char path[MaxPath] = {};
+   snprintf(path, ArrayCount(path), "../%s", relPath);
+   return assetPathForFrame(plat, path);
+}
 
-            CommandsEnum eTmp = sCommandsEnum[i];
-            sCommandsEnum[i] = sCommandsEnum[j];
-            sCommandsEnum[j] = eTmp;
+void
+finderUpdateIndex(Platform* plat, Finder* f)
+{
+   if (!f->numFixedEntries) {
+      CommandsEnum* sCommandsEnum = {};
+      char** sCommands = listCommands(Lifetime_Frame, &sCommandsEnum);
+      for (sz i = 0; i < arrlen(sCommands); ++i) {
+         finderAddCandidate(f, sCommands[i], FinderId(FinderKind_Command, sCommandsEnum[i]));
+      }
+
+      u64 maxNames = 1024;
+      char (*names)[MaxPath] = (char (*)[MaxPath])allocateBytes(maxNames * MaxPath, Lifetime_Frame);
+      for (u64 di = 0; di < ArrayCount(gFinderAssetDirs); ++di) {
+         u64 numNames = Min(maxNames, plat->listFilesAscii(finderAssetPath(plat, gFinderAssetDirs[di]), names, maxNames));
+         for (u64 ni = 0; ni < numNames; ++ni) {
+            char relPath[MaxPath] = {};
+            snprintf(relPath, ArrayCount(relPath), "%s/%s", gFinderAssetDirs[di], names[ni]);
+            char entry[MaxPath] = {};
+            snprintf(entry, ArrayCount(entry), "Asset: %s", relPath);
+            finderAddCandidate(f, entry, FinderId(FinderKind_Asset, arrlen(f->sAssetPaths)));
+
+            char* path = AllocateArray(char, strlen(relPath) + 1, Lifetime_App);
+            memcpy(path, relPath, strlen(relPath) + 1);
+            SBPush(f->sAssetPaths, path, Lifetime_App);
+         }
+      }
+      f->numFixedEntries = f->index.numEntries;
+   }
+
+   // Objects are only ever added, until the world is replaced. The new
+   // world may sit where the old one was, so compare generations.
+   World* w = getWorld();
+   if (f->indexedWorld != w->generation || f->numIndexedObjects > w->numObjects) {
+      finderRemoveCandidatesFrom(f, f->numFixedEntries);
+      f->indexedWorld = w->generation;
+      f->numIndexedObjects = 1;  // 0 is the sentinel.
+   }
+   for (u64 idx = f->numIndexedObjects; idx < w->numObjects; ++idx) {
+      char* name = NULL;
+#if BuildMode(Debug)
+      name = w->debugNames[idx];
+#endif
+      char entry[MaxPath] = {};
+      snprintf(entry, ArrayCount(entry), "Object: %s #%llu", name ? name : "Unnamed", idx);
+      finderAddCandidate(f, entry, FinderId(FinderKind_Object, idx));
+      if (objectTestFlag(ObjectHandle{idx}, WorldObject_Mesh)) {
+         snprintf(entry, ArrayCount(entry), "Material: %s #%llu", name ? name : "Unnamed", idx);
+         finderAddCandidate(f, entry, FinderId(FinderKind_Material, idx));
+      }
+   }
+   f->numIndexedObjects = w->numObjects;
+}
+
+void
+finderPerform(Platform* plat, u64 id)
+{
+   u32 value = FinderIdValue(id);
+   switch (FinderIdKind(id)) {
+      case FinderKind_Command: {
+         commandPerform(plat, (CommandsEnum)value);
+      } break;
+      case FinderKind_Object: {
+         // Fly mode leaves the camera where it is put.
+         modeEnable(Mode_Fly);
+         focusCameraOnObject(ObjectHandle{value});
+      } break;
+      case FinderKind_Material: {
+         modeEnable(Mode_MaterialEditor);
+         gEditor->materialEd.pickedObj = ObjectHandle{value};
+         gEditor->materialEd.state = MatEd_Edit;
+      } break;
+      case FinderKind_Asset: {
+         char* relPath = gEditor->finder.sAssetPaths[value];
+         ObjectHandle h = findObjectWithMeshAsset(meshAssetForPath(finderAssetPath(plat, relPath)));
+         if (h.idx) {
+            modeEnable(Mode_Fly);
+            focusCameraOnObject(h);
+         }
+         else {
+            logMsg("No object in the world uses %s\n", relPath);
+         }
+      } break;
+   }
+}
+
+// Keeps the best gKnobs.finderMaxResults of everything that matches, instead of sorting all of it.
+static void
+finderFilter(Finder* f, char* query, u32 queryLen)
+{
+   FinderIndex* index = &f->index;
+
+   bool extendsLast = f->lastQueryLen >= 0 &&
+                      (u32)f->lastQueryLen <= queryLen &&
+                      memcmp(f->lastQuery, query, f->lastQueryLen) == 0;
+
+   // Entries from numFiltered on were added after the last query, so nothing has ruled them out.
+   u32 numOld = extendsLast ? f->numMatches : f->numFiltered;
+   u32 numCandidates = numOld + (index->numEntries - f->numFiltered);
+   u64 queryMask = finderCharMask(query, queryLen);
+
+   i32 topScores[gKnobs.finderMaxResults] = {};
+   u32 numTop = 0;
+   u32 numMatches = 0;
+   for (u32 c = 0; c < numCandidates; ++c) {
+      u32 i = c >= numOld ? f->numFiltered + (c - numOld) :
+              extendsLast ? f->sMatches[c] : c;
+      if ((index->sCharMasks[i] & queryMask) != queryMask) {
+         continue;
+      }
+      char* name = finderName(index, i);
+      u32 len = index->sLengths[i];
+      i32 score = finderScore(name, name + len + 1, len, query, queryLen);
+      if (score == FinderNoMatch) {
+         continue;
+      }
+      // Written behind the read position, so it can filter in place.
+      f->sMatches[numMatches++] = i;
+
+      // Ties keep index order, since entries come in ascending order.
+      u32 pos = numTop;
+      while (pos > 0 && topScores[pos - 1] < score) {
+         --pos;
+      }
+      if (pos < gKnobs.finderMaxResults) {
+         u32 last = Min(numTop, gKnobs.finderMaxResults - 1);
+         for (u32 j = last; j > pos; --j) {
+            topScores[j] = topScores[j - 1];
+            f->top[j] = f->top[j - 1];
          }
+         topScores[pos] = score;
+         f->top[pos] = i;
+         numTop = Min(numTop + 1, gKnobs.finderMaxResults);
       }
    }
+   f->numMatches = numMatches;
+   f->numFiltered = index->numEntries;
+   f->numTop = numTop;
+   f->topStale = false;
 
-   if (selectedCmd) {
-      *selectedCmd = sCommandsEnum[f->selectionIdx];
+   if (queryLen <= ArrayCount(f->lastQuery)) {
+      memcpy(f->lastQuery, query, queryLen);
+      f->lastQueryLen = queryLen;
+   }
+   else {
+      f->lastQueryLen = -1;
+   }
+}
+
+char** /*stretchy*/
+finderComputeResults(Finder* f, Lifetime life, u64* selectedId)
+{
+   u32 queryLen = (u32)arrlen(f->sSearchString);
+   char* query = AllocateArray(char, queryLen + 1, Lifetime_Frame);
+   for (u32 i = 0; i < queryLen; ++i) {
+      query[i] = (char)tolower((u8)f->sSearchString[i]);
+   }
+
+   bool sameAsLast = f->lastQueryLen == (i32)queryLen && memcmp(f->lastQuery, query, queryLen) == 0;
+   if (!sameAsLast || f->topStale || f->numFiltered < f->index.numEntries) {
+      finderFilter(f, query, queryLen);
+   }
+
+   char** sResults = NULL;
+   for (u32 i = 0; i < f->numTop; ++i) {
+      SBPush(sResults, finderName(&f->index, f->top[i]), life);
+   }
+
+   if (f->numTop) {
+      f->selectionIdx = Max(0, Min(f->selectionIdx, (int)f->numTop - 1));
+      if (selectedId) {
+         *selectedId = f->index.sIds[f->top[f->selectionIdx]];
+      }
    }
 
-   return sCommands;
+   return sResults;
 }
 
 void
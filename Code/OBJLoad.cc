@@ -130,35 +130,94 @@ getNextLine(ObjParser& p, u8* origBytes)
    return old != p.line;
 }
 
-Mesh
-objLoad(Platform* plat, char* path, Lifetime life)
+enum ObjLineType
 {
-   pushApiLifetime(life);
-   Mesh mesh = {};
+   ObjLine_Other,
+   ObjLine_Position,
+   ObjLine_Normal,
+   ObjLine_Texcoord,
+   ObjLine_Face,
+};
 
-   u8* data = nullptr;
-   u64 numBytes = plat->fileContentsAscii(path, data, Lifetime_Frame);
-
-   vec4* positions = nullptr;
-   vec2* texcoords = nullptr;
-   vec3* normals = nullptr;
-
-   struct Triangle {
-      u32 av = 0, at = 0, an = 0;
-      u32 bv = 0, bt = 0, bn = 0;
-      u32 cv = 0, ct = 0, cn = 0;
-   };
-   Triangle* tris = nullptr;
-
-   ObjParser p = { nullptr, 0, data, 0, numBytes };
-   while (getNextLine(p, data)) {
-      if (p.line[0] == '#') {
-         continue;
+static ObjLineType
+lineType(ObjParser& p, u8* word)
+{
+   ObjLineType type = ObjLine_Other;
+   if (p.line[0] != '#') {
+      copyWord(p, word);
+      if (!strcmp((const char*)word, "v")) {
+         type = ObjLine_Position;
+      }
+      else if (!strcmp((const char*)word, "vn")) {
+         type = ObjLine_Normal;
+      }
+      else if (!strcmp((const char*)word, "vt")) {
+         type = ObjLine_Texcoord;
+      }
+      else if (!strcmp((const char*)word, "f")) {
+         type = ObjLine_Face;
+      }
+   }
+   return type;
+}
+
+struct ObjTriangle
+{
+   u32 av, at, an;
+   u32 bv, bt, bn;
+   u32 cv, ct, cn;
+};
+
+// A newline-aligned piece of the file. Parsed in two passes: first we count
+// what's in it, then we parse straight into the merged arrays at the offsets
+// given by the prefix sum of the counts of the previous chunks.
+struct ObjChunk
+{
+   u8* bytes;
+   u64 numBytes;
+
+   u64 numPositions;
+   u64 numNormals;
+   u64 numTexcoords;
+   u64 numTris;
+
+   vec4* positions;
+   vec3* normals;
+   vec2* texcoords;
+   ObjTriangle* tris;
+};
+
+PlatformWorkProcDef(objCountChunk)
+{
+   ObjChunk* c = (ObjChunk*)data;
+
+   ObjParser p = { nullptr, 0, c->bytes, 0, c->numBytes };
+   while (getNextLine(p, c->bytes)) {
+      u8 word[MaxWord + 1] = {};
+      switch (lineType(p, word)) {
+         case ObjLine_Position: { c->numPositions++; } break;
+         case ObjLine_Normal: { c->numNormals++; } break;
+         case ObjLine_Texcoord: { c->numTexcoords++; } break;
+         case ObjLine_Face: { c->numTris++; } break;
+         default: break;
       }
-      else {
-         u8 word[MaxWord + 1] = {};
-         copyWord(p, (u8*)(word));
-         if (!strcmp((const char*)word, "v")) {
+   }
+}
+
+PlatformWorkProcDef(objParseChunk)
+{
+   ObjChunk* c = (ObjChunk*)data;
+
+   u64 numPositions = 0;
+   u64 numNormals = 0;
+   u64 numTexcoords = 0;
+   u64 numTris = 0;
+
+   ObjParser p = { nullptr, 0, c->bytes, 0, c->numBytes };
+   while (getNextLine(p, c->bytes)) {
+      u8 word[MaxWord + 1] = {};
+      switch (lineType(p, word)) {
+         case ObjLine_Position: {
             vec4 v = {};
             skipWhitespace(p);
             v.x = readFloat(p, word);
@@ -167,9 +226,9 @@ objLoad(Platform* plat, char* path, Lifetime life)
             skipWhitespace(p);
             v.z = readFloat(p, word);
             v.w = 1.0f;
-            arrput(positions, v);
-         }
-         else if (!strcmp((const char*)word, "vn")) {
+            c->positions[numPositions++] = v;
+         } break;
+         case ObjLine_Normal: {
             vec3 v = {};
             skipWhitespace(p);
             v.x = readFloat(p, word);
@@ -177,19 +236,19 @@ objLoad(Platform* plat, char* path, Lifetime life)
             v.y = readFloat(p, word);
             skipWhitespace(p);
             v.z = readFloat(p, word);
-            arrput(normals, v);
-         }
-         else if (!strcmp((const char*)word, "vt")) {
+            c->normals[numNormals++] = v;
+         } break;
+         case ObjLine_Texcoord: {
             vec2 v = {};
             skipWhitespace(p);
             v.u = readFloat(p, word);
             skipWhitespace(p);
             v.v = readFloat(p, word);
-            arrput(texcoords, v);
-         }
-         else if (!strcmp((const char*)word, "f")) {
+            c->texcoords[numTexcoords++] = v;
+         } break;
+         case ObjLine_Face: {
             skipWhitespace(p);
-            Triangle v = {};
+            ObjTriangle v = {};
             v.av = readUint(p, word) - 1;
             ++p.i;
             v.at = readUint(p, word) - 1;
@@ -207,75 +266,173 @@ objLoad(Platform* plat, char* path, Lifetime life)
             v.ct = readUint(p, word) - 1;
             ++p.i;
             v.cn = readUint(p, word) - 1;
+            c->tris[numTris++] = v;
+         } break;
+         default: break;
+      }
+   }
+
+   Assert(numPositions == c->numPositions && numNormals == c->numNormals);
+   Assert(numTexcoords == c->numTexcoords && numTris == c->numTris);
+}
+
+// Vertex dedupe, keyed on the (v, vt, vn) index triplet of each face corner.
+// Open addressing with linear probing. The table is sized from the number of
+// corners so it never grows.
+
+struct ObjVertexSlot
+{
+   u32 v, t, n;
+   u32 vertexIdx;  // Index + 1. Zero for empty slots.
+};
+
+static u32
+objHashTriplet(u32 v, u32 t, u32 n)
+{
+   u32 h = v * 0x9E3779B1u;
+   h ^= t * 0x85EBCA77u + (h << 6) + (h >> 2);
+   h ^= n * 0xC2B2AE3Du + (h << 6) + (h >> 2);
+   h ^= h >> 15;
+   h *= 0x2C1B3C6Du;
+   h ^= h >> 12;
+   return h;
+}
 
-            arrput(tris, v);
+Mesh
+objLoadFromBytes(Platform* plat, u8* data, u64 numBytes, Lifetime life, u32 numThreads)
+{
+   ProfileZone("objLoad");
+
+   Mesh mesh = {};
+
+   numThreads = Max(1u, Min(numThreads, gKnobs.maxWorkerThreads + 1));
+
+   // Split in newline-aligned chunks. Small files get a single chunk.
+   u32 numChunks = (u32)Max(1ull, Min((u64)numThreads, numBytes / Kilobytes(32)));
+
+   ObjChunk* chunks = AllocateArray(ObjChunk, numChunks, Lifetime_Frame);
+   {
+      u32 numNonEmpty = 0;
+      u64 begin = 0;
+      for (u32 ci = 0; ci < numChunks; ++ci) {
+         u64 end = (ci == numChunks - 1) ? numBytes : Max(begin, (numBytes * (ci + 1)) / numChunks);
+         while (end > 0 && end < numBytes && data[end - 1] != '\n') {
+            end++;
+         }
+         if (end > begin) {
+            ObjChunk* c = chunks + numNonEmpty++;
+            *c = {};
+            c->bytes = data + begin;
+            c->numBytes = end - begin;
          }
+         begin = end;
+      }
+      numChunks = numNonEmpty;
+   }
+
+   runJobs(plat, objCountChunk, chunks, sizeof(ObjChunk), numChunks);
+
+   // Prefix sum the counts to place each chunk in the merged arrays.
+   u64 numPositions = 0;
+   u64 numNormals = 0;
+   u64 numTexcoords = 0;
+   u64 numTris = 0;
+   for (u32 ci = 0; ci < numChunks; ++ci) {
+      numPositions += chunks[ci].numPositions;
+      numNormals += chunks[ci].numNormals;
+      numTexcoords += chunks[ci].numTexcoords;
+      numTris += chunks[ci].numTris;
+   }
+
+   vec4* positions = AllocateArray(vec4, numPositions, Lifetime_Frame);
+   vec3* normals = AllocateArray(vec3, numNormals, Lifetime_Frame);
+   vec2* texcoords = AllocateArray(vec2, numTexcoords, Lifetime_Frame);
+   ObjTriangle* tris = AllocateArray(ObjTriangle, numTris, Lifetime_Frame);
+   {
+      u64 pi = 0, ni = 0, ti = 0, fi = 0;
+      for (u32 ci = 0; ci < numChunks; ++ci) {
+         ObjChunk* c = chunks + ci;
+         c->positions = positions + pi;
+         c->normals = normals + ni;
+         c->texcoords = texcoords + ti;
+         c->tris = tris + fi;
+         pi += c->numPositions;
+         ni += c->numNormals;
+         ti += c->numTexcoords;
+         fi += c->numTris;
       }
    }
 
+   runJobs(plat, objParseChunk, chunks, sizeof(ObjChunk), numChunks);
 
-   pushApiLifetime(Lifetime_Frame);
-   pushApiAlignment(16);  // u128 alignment...
-
-      struct UniqueVert
-      {
-         vec4 position;
-         vec2 texcoord;
-         vec3 normal;
-      };
-      struct VertHashmap
-      {
-         meow_u128 key;
-         UniqueVert value;
-      } *hmVerts = {};  // Same key and value... Just to get a quick and dirty set impl.
-
-      for (sz i = 0; i < arrlen(tris); ++i) {
-         Triangle tri = tris[i];
-
-         UniqueVert a = {};
-         a.position = positions[tri.av];
-         a.texcoord = texcoords[tri.at];
-         a.normal = normals[tri.an];
-         UniqueVert b = {};
-         b.position = positions[tri.bv];
-         b.texcoord = texcoords[tri.bt];
-         b.normal = normals[tri.bn];
-         UniqueVert c = {};
-         c.position = positions[tri.cv];
-         c.texcoord = texcoords[tri.ct];
-         c.normal = normals[tri.cn];
-
-         meow_u128 ah = MeowHash(MeowDefaultSeed, sizeof(UniqueVert), &a);
-         meow_u128 bh = MeowHash(MeowDefaultSeed, sizeof(UniqueVert), &b);
-         meow_u128 ch = MeowHash(MeowDefaultSeed, sizeof(UniqueVert), &c);
-
-         hmput(hmVerts, ah, a);
-         hmput(hmVerts, bh, b);
-         hmput(hmVerts, ch, c);
-
-         u32 ai = hmgeti(hmVerts, ah);
-         u32 bi = hmgeti(hmVerts, bh);
-         u32 ci = hmgeti(hmVerts, ch);
-
-         // Output a triangle!
-         arrput(mesh.sIndices, ai);
-         arrput(mesh.sIndices, bi);
-         arrput(mesh.sIndices, ci);
+   // Dedupe
+   u64 numCorners = numTris * 3;
+   u64 capacity = 16;
+   while (capacity < 2 * numCorners) {
+      capacity <<= 1;
+   }
+   u64 mask = capacity - 1;
+   ObjVertexSlot* slots = AllocateArray(ObjVertexSlot, capacity, Lifetime_Frame);
+
+   SBResize(mesh.sIndices, numCorners, life);
+
+   // Corners that introduced a new vertex, in order of first use.
+   u32* firstCorners = AllocateArray(u32, numCorners, Lifetime_Frame);
+   u64 numVerts = 0;
+
+   u32* corners = (u32*)tris;  // ObjTriangle is nine packed u32s: v, t, n per corner.
+   for (u64 corner = 0; corner < numCorners; ++corner) {
+      u32 v = corners[corner * 3 + 0];
+      u32 t = corners[corner * 3 + 1];
+      u32 n = corners[corner * 3 + 2];
+
+      u64 slotIdx = objHashTriplet(v, t, n) & mask;
+      while (true) {
+         ObjVertexSlot* slot = slots + slotIdx;
+         if (slot->vertexIdx == 0) {
+            slot->v = v;
+            slot->t = t;
+            slot->n = n;
+            slot->vertexIdx = ++numVerts;
+            firstCorners[numVerts - 1] = corner;
+            mesh.sIndices[corner] = numVerts - 1;
+            break;
+         }
+         if (slot->v == v && slot->t == t && slot->n == n) {
+            mesh.sIndices[corner] = slot->vertexIdx - 1;
+            break;
+         }
+         slotIdx = (slotIdx + 1) & mask;
       }
-   popApiLifetime(); // Frame
-   popApiAlignment();
+   }
 
    // Output the verts
-   for (sz i = 0; i < hmlen(hmVerts); ++i) {
-      arrput(mesh.sPositions, hmVerts[i].value.position);
-      arrput(mesh.sNormals, hmVerts[i].value.normal);
-      arrput(mesh.sTexcoords, hmVerts[i].value.texcoord);
-      arrput(mesh.sColors, Vec4(1,0,1,1));
+   SBResize(mesh.sPositions, numVerts, life);
+   SBResize(mesh.sNormals, numVerts, life);
+   SBResize(mesh.sTexcoords, numVerts, life);
+   SBResize(mesh.sColors, numVerts, life);
+
+   for (u64 vi = 0; vi < numVerts; ++vi) {
+      u32* c = corners + firstCorners[vi] * 3;
+      mesh.sPositions[vi] = positions[c[0]];
+      mesh.sTexcoords[vi] = texcoords[c[1]];
+      mesh.sNormals[vi] = normals[c[2]];
+      mesh.sColors[vi] = Vec4(1,0,1,1);
    }
 
-   mesh.numVerts = hmlen(hmVerts);
-   mesh.numIndices = arrlen(mesh.sIndices);
+   mesh.numVerts = numVerts;
+   mesh.numIndices = numCorners;
 
-   popApiLifetime();  // life
    return mesh;
-}
\ No newline at end of file
+}
+
+Mesh
+objLoad(Platform* plat, char* path, Lifetime life)
+{
+   u8* data = nullptr;
+   u64 numBytes = assetFileContents(plat, path, data, Lifetime_Frame);
+
+   Mesh mesh = objLoadFromBytes(plat, data, numBytes, life, plat->numWorkerThreads + 1);
+
+   return mesh;
+}
@@ -190,6 +190,96 @@ winFileContentsAscii(char* fname, u8*& data, Lifetime life)
    return bytes;
 }
 
+PlatformMapFileAsciiProcDef(winMapFileAscii)
+{
+   u8* data = nullptr;
+   *outBytes = 0;
+
+   HANDLE file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+   if (file != INVALID_HANDLE_VALUE) {
+      LARGE_INTEGER size = {};
+      if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+         HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+         if (mapping) {
+            data = (u8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (data) {
+               *outBytes = size.QuadPart;
+            }
+            // The view keeps the mapping alive.
+            CloseHandle(mapping);
+         }
+      }
+      CloseHandle(file);
+   }
+
+   return data;
+}
+
+PlatformUnmapFileProcDef(winUnmapFile)
+{
+   UnmapViewOfFile(data);
+}
+
+PlatformWriteFileAsciiProcDef(winWriteFileAscii)
+{
+   bool ok = false;
+   FILE* fd = fopen(fname, "wb");
+   if (fd) {
+      u64 written = 0;
+      while (written < numBytes) {
+         sz n = fwrite(data + written, 1, numBytes - written, fd);
+         if (n == 0) {
+            break;
+         }
+         written += n;
+      }
+      ok = (written == numBytes);
+      fclose(fd);
+   }
+   return ok;
+}
+
+PlatformEvictFileCacheAsciiProcDef(winEvictFileCacheAscii)
+{
+   // Opening an unbuffered handle makes the cache manager flush and purge the
+   // file's cached pages, unless a mapped view still holds them.
+   HANDLE file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, 0);
+   bool ok = (file != INVALID_HANDLE_VALUE);
+   if (ok) {
+      CloseHandle(file);
+   }
+   return ok;
+}
+
+PlatformDeleteFileAsciiProcDef(winDeleteFileAscii)
+{
+   return DeleteFileA(fname) != 0;
+}
+
+PlatformListFilesAsciiProcDef(winListFilesAscii)
+{
+   u64 numNames = 0;
+
+   char pattern[MaxPath] = {};
+   snprintf(pattern, ArrayCount(pattern), "%s/*", dir);
+
+   WIN32_FIND_DATAA found = {};
+   HANDLE find = FindFirstFileA(pattern, &found);
+   if (find != INVALID_HANDLE_VALUE) {
+      do {
+         if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+            if (numNames < maxNames) {
+               snprintf(outNames[numNames], MaxPath, "%s", found.cFileName);
+            }
+            numNames++;
+         }
+      } while (FindNextFileA(find, &found));
+      FindClose(find);
+   }
+
+   return numNames;
+}
+
 PlatformFnameAtExeAsciiProcDef(winFnameAtExeAscii)
 {
    // TODO: Lifetimes...
@@ -283,6 +373,117 @@ winGetInput()
    return &gInput;
 }
 
+// Work queue
+struct WorkQueueEntry
+{
+   PlatformWorkProc* proc;
+   void* data;
+};
+
+static struct WorkQueue
+{
+   u32 volatile completionGoal;
+   u32 volatile completionCount;
+
+   u32 volatile nextEntryToWrite;
+   u32 volatile nextEntryToRead;
+
+   HANDLE semaphore;
+
+   WorkQueueEntry entries[gKnobs.workQueueSize];
+} gWorkQueue;
+
+// Returns true if there was nothing to do.
+static bool
+winDoNextWorkEntry(WorkQueue* q)
+{
+   bool empty = false;
+
+   u32 originalNext = q->nextEntryToRead;
+   u32 newNext = (originalNext + 1) % ArrayCount(q->entries);
+   if (originalNext != q->nextEntryToWrite) {
+      u32 idx = InterlockedCompareExchange((LONG volatile*)&q->nextEntryToRead, newNext, originalNext);
+      if (idx == originalNext) {
+         WorkQueueEntry entry = q->entries[idx];
+         entry.proc(entry.data);
+         InterlockedIncrement((LONG volatile*)&q->completionCount);
+      }
+   }
+   else {
+      empty = true;
+   }
+   return empty;
+}
+
+DWORD WINAPI
+winWorkerThreadProc(LPVOID param)
+{
+   WorkQueue* q = (WorkQueue*)param;
+   while (true) {
+      if (winDoNextWorkEntry(q)) {
+         WaitForSingleObjectEx(q->semaphore, INFINITE, FALSE);
+      }
+   }
+}
+
+PlatformAddWorkProcDef(winAddWork)
+{
+   WorkQueue* q = &gWorkQueue;
+
+   u32 newNext = (q->nextEntryToWrite + 1) % ArrayCount(q->entries);
+   // Queue is full. Help out until there is room.
+   while (newNext == q->nextEntryToRead) {
+      winDoNextWorkEntry(q);
+   }
+
+   WorkQueueEntry* entry = q->entries + q->nextEntryToWrite;
+   entry->proc = proc;
+   entry->data = data;
+   ++q->completionGoal;
+
+   MemoryBarrier();  // Entry must be visible before we publish it.
+
+   q->nextEntryToWrite = newNext;
+   ReleaseSemaphore(q->semaphore, 1, 0);
+}
+
+PlatformCompleteAllWorkProcDef(winCompleteAllWork)
+{
+   WorkQueue* q = &gWorkQueue;
+
+   while (q->completionGoal != q->completionCount) {
+      winDoNextWorkEntry(q);
+   }
+
+   q->completionGoal = 0;
+   q->completionCount = 0;
+}
+
+PlatformHelpWithWorkProcDef(winHelpWithWork)
+{
+   return !winDoNextWorkEntry(&gWorkQueue);
+}
+
+int
+winInitWorkQueue()
+{
+   SYSTEM_INFO info = {};
+   GetSystemInfo(&info);
+
+   // Main thread also does work in completeAllWork.
+   int numThreads = Min((int)info.dwNumberOfProcessors - 1, (int)gKnobs.maxWorkerThreads);
+   numThreads = Max(numThreads, 0);
+
+   gWorkQueue.semaphore = CreateSemaphoreExA(0, 0, gKnobs.workQueueSize, 0, 0, SEMAPHORE_ALL_ACCESS);
+
+   for (int i = 0; i < numThreads; ++i) {
+      HANDLE thread = CreateThread(0, 0, winWorkerThreadProc, &gWorkQueue, 0, 0);
+      CloseHandle(thread);
+   }
+
+   return numThreads;
+}
+
 // Stub game code callbacks
 AppInitCallbackProcDef(appInitStub)
 {
@@ -458,6 +659,12 @@ WinMain(HINSTANCE hinst, HINSTANCE, LPSTR, int nShowCmd)
    plat->fnameAtExe = winFnameAtExe;
    plat->fileContentsAscii = winFileContentsAscii;
    plat->fileSizeAscii = winFileSizeAscii;
+   plat->mapFileAscii = winMapFileAscii;
+   plat->unmapFile = winUnmapFile;
+   plat->writeFileAscii = winWriteFileAscii;
+   plat->evictFileCacheAscii = winEvictFileCacheAscii;
+   plat->deleteFileAscii = winDeleteFileAscii;
+   plat->listFilesAscii = winListFilesAscii;
    plat->toPlatStr = winToPlatStr;
    plat->getPlatformError = winGetPlatformError;
    plat->getWindowHandle = winGetWindowHandle;
@@ -466,9 +673,14 @@ WinMain(HINSTANCE hinst, HINSTANCE, LPSTR, int nShowCmd)
    plat->getMicroseconds = winGetMicroseconds;
    plat->consoleLog = winConsoleLog;
    plat->getClientRect = winGetClientRect;
+   plat->addWork = winAddWork;
+   plat->completeAllWork = winCompleteAllWork;
+   plat->helpWithWork = winHelpWithWork;
 
    QueryPerformanceFrequency(&gPerfFrequency);
 
+   plat->numWorkerThreads = winInitWorkQueue();
+
    WNDCLASS wc;
    wc.style = 0;
    wc.lpfnWndProc = wndProc;
@@ -0,0 +1,367 @@
+// CPU profiler.
+//
+// profileBegin and profileEnd time a zone with the time stamp counter, and
+// ProfileZone puts them around the rest of a scope. Each thread keeps its open
+// zones, and writes them into its own ring buffer when they end, so there is
+// no locking: the owner writes and publishes its head, and the main thread
+// reads behind it. Once a frame, profileNewFrame nests the zones that ended
+// since the last frame into a tree per thread, adding up calls of the same
+// zone under the same parent.
+
+struct ProfileEvent
+{
+   char* name;
+   u64 beginTick;
+   u64 endTick;
+};
+
+struct ProfileThread
+{
+   u32 osId;
+   char name[32];
+   volatile u32 head;  // Events written. Only the owner writes.
+   u32 frameHead;  // Events the main thread has aggregated.
+   ProfileEvent events[gKnobs.profilerRingEvents];
+
+   // Zones begun and not yet ended. Deeper ones are counted but not kept.
+   ProfileEvent open[64];
+   u32 depth;
+};
+
+static struct Profiler
+{
+   Platform* plat;
+   u64 startTick;
+   u64 startUs;
+   double ticksPerUs;
+
+   volatile LONG numThreads;
+   ProfileThread threads[gKnobs.profilerMaxThreads];
+
+   // Last frame
+   ProfileNode nodes[gKnobs.profilerMaxNodes];
+   u32 numNodes;
+   u32 numDropped;
+
+   bool showSummary;
+} *gProfiler;
+
+// Reset when new code is loaded. The table in gProfiler is looked up again by thread id.
+static thread_local ProfileThread* tProfileThread;
+
+u64
+profileGlobalSize()
+{
+   return sizeof(*gProfiler);
+}
+
+void
+profileGlobalSet(u8* ptr)
+{
+   gProfiler = (Profiler*)ptr;
+}
+
+static ProfileThread*
+profileThisThread()
+{
+   if (tProfileThread) {
+      return tProfileThread;
+   }
+
+   u32 osId = GetCurrentThreadId();
+   u32 numThreads = Min((u32)gProfiler->numThreads, gKnobs.profilerMaxThreads);
+   for (u32 i = 0; i < numThreads; ++i) {
+      if (gProfiler->threads[i].osId == osId) {
+         tProfileThread = gProfiler->threads + i;
+         return tProfileThread;
+      }
+   }
+
+   // Threads past gKnobs.profilerMaxThreads are not profiled.
+   u32 idx = (u32)InterlockedIncrement(&gProfiler->numThreads) - 1;
+   if (idx < gKnobs.profilerMaxThreads) {
+      ProfileThread* t = gProfiler->threads + idx;
+      t->osId = osId;
+      snprintf(t->name, ArrayCount(t->name), idx == 0 ? "Main thread" : "Thread %u", idx);
+      tProfileThread = t;
+   }
+   return tProfileThread;
+}
+
+void
+profileInit(Platform* plat)
+{
+   gProfiler->plat = plat;
+   gProfiler->startTick = __rdtsc();
+   gProfiler->startUs = plat->getMicroseconds();
+
+   // The main thread comes first.
+   profileThisThread();
+}
+
+void
+profileBegin(char* name)
+{
+   u64 beginTick = __rdtsc();
+   if (!gProfiler) {
+      return;
+   }
+   ProfileThread* t = profileThisThread();
+   if (t) {
+      if (t->depth < ArrayCount(t->open)) {
+         t->open[t->depth] = { name, beginTick, 0 };
+      }
+      t->depth++;
+   }
+}
+
+void
+profileEnd()
+{
+   u64 endTick = __rdtsc();
+   if (!gProfiler) {
+      return;
+   }
+   ProfileThread* t = profileThisThread();
+   if (t && t->depth) {
+      t->depth--;
+      if (t->depth < ArrayCount(t->open)) {
+         ProfileEvent* e = t->events + t->head % gKnobs.profilerRingEvents;
+         *e = t->open[t->depth];
+         e->endTick = endTick;
+         storeRelease(&t->head, t->head + 1);
+      }
+   }
+}
+
+static void
+profileCalibrate()
+{
+   u64 us = gProfiler->plat->getMicroseconds() - gProfiler->startUs;
+   u64 ticks = __rdtsc() - gProfiler->startTick;
+   if (us) {
+      gProfiler->ticksPerUs = (double)ticks / us;
+   }
+}
+
+static double
+profileTicksToMs(u64 ticks)
+{
+   return gProfiler->ticksPerUs ? ticks / gProfiler->ticksPerUs / 1000.0 : 0.0;
+}
+
+// Parents come before their children: earlier first, then longer first.
+static int
+profileCompareEvents(const void* a, const void* b)
+{
+   const ProfileEvent* ea = (const ProfileEvent*)a;
+   const ProfileEvent* eb = (const ProfileEvent*)b;
+   if (ea->beginTick != eb->beginTick) {
+      return ea->beginTick < eb->beginTick ? -1 : 1;
+   }
+   if (ea->endTick != eb->endTick) {
+      return ea->endTick > eb->endTick ? -1 : 1;
+   }
+   return 0;
+}
+
+// The child of `parent` with this name, added if it isn't there. -1 when the tree is full.
+static i32
+profileChildNode(i32 parent, char* name)
+{
+   i32 last = -1;
+   i32 child = parent == -1 ? (gProfiler->numNodes ? 0 : -1) : gProfiler->nodes[parent].firstChild;
+   for (; child != -1; child = gProfiler->nodes[child].nextSibling) {
+      if (!strcmp(gProfiler->nodes[child].name, name)) {
+         return child;
+      }
+      last = child;
+   }
+
+   if (gProfiler->numNodes == gKnobs.profilerMaxNodes) {
+      return -1;
+   }
+   i32 idx = gProfiler->numNodes++;
+   ProfileNode* node = gProfiler->nodes + idx;
+   *node = {};
+   node->name = name;
+   node->parent = parent;
+   node->firstChild = -1;
+   node->nextSibling = -1;
+   if (last != -1) {
+      gProfiler->nodes[last].nextSibling = idx;
+   }
+   else if (parent != -1) {
+      gProfiler->nodes[parent].firstChild = idx;
+   }
+   return idx;
+}
+
+void
+profileNewFrame()
+{
+   profileCalibrate();
+
+   gProfiler->numNodes = 0;
+   gProfiler->numDropped = 0;
+
+   u32 numThreads = Min((u32)gProfiler->numThreads, gKnobs.profilerMaxThreads);
+   for (u32 ti = 0; ti < numThreads; ++ti) {
+      ProfileThread* t = gProfiler->threads + ti;
+
+      // The owner may be writing over the oldest half of the ring.
+      u32 head = loadAcquire(&t->head);
+      u32 count = Min(head - t->frameHead, gKnobs.profilerRingEvents / 2);
+      t->frameHead = head;
+      if (!count) {
+         continue;
+      }
+
+      ProfileEvent* events = AllocateArray(ProfileEvent, count, Lifetime_Frame);
+      for (u32 i = 0; i < count; ++i) {
+         events[i] = t->events[(head - count + i) % gKnobs.profilerRingEvents];
+      }
+      qsort(events, count, sizeof(*events), profileCompareEvents);
+
+      i32 root = profileChildNode(-1, t->name);
+      if (root == -1) {
+         gProfiler->numDropped += count;
+         continue;
+      }
+
+      // Zones this one may be nested in. A zone whose parent is still open
+      // goes under the closest enclosing zone that ended.
+      struct { i32 node; u64 endTick; } stack[64];
+      i32 depth = 0;
+      for (u32 i = 0; i < count; ++i) {
+         ProfileEvent* e = events + i;
+         while (depth && stack[depth - 1].endTick < e->endTick) {
+            depth--;
+         }
+         i32 parent = depth ? stack[depth - 1].node : root;
+         i32 node = profileChildNode(parent, e->name);
+         if (node == -1) {
+            gProfiler->numDropped++;
+            continue;
+         }
+         gProfiler->nodes[node].calls++;
+         gProfiler->nodes[node].ticks += e->endTick - e->beginTick;
+         if (parent == root) {
+            gProfiler->nodes[root].ticks += e->endTick - e->beginTick;
+         }
+         if (depth < ArrayCount(stack)) {
+            stack[depth++] = { node, e->endTick };
+         }
+      }
+      gProfiler->nodes[root].calls = 1;
+   }
+}
+
+ProfileNode*
+profileFindZone(ProfileNode* parent, char* name)
+{
+   i32 child = parent ? parent->firstChild : (gProfiler->numNodes ? 0 : -1);
+   for (; child != -1; child = gProfiler->nodes[child].nextSibling) {
+      if (!strcmp(gProfiler->nodes[child].name, name)) {
+         return gProfiler->nodes + child;
+      }
+   }
+   return NULL;
+}
+
+double
+profileZoneMs(ProfileNode* node)
+{
+   return profileTicksToMs(node->ticks);
+}
+
+void
+profileToggleSummary()
+{
+   gProfiler->showSummary = !gProfiler->showSummary;
+}
+
+static void
+profileDrawNode(i32 idx, i32 depth)
+{
+   ProfileNode* node = gProfiler->nodes + idx;
+   u64 childTicks = 0;
+   for (i32 c = node->firstChild; c != -1; c = gProfiler->nodes[c].nextSibling) {
+      childTicks += gProfiler->nodes[c].ticks;
+   }
+
+   char line[128] = {};
+   snprintf(line, ArrayCount(line), "%*s%s  %.2f ms  self %.2f ms  x%u",
+            depth * 3, "", node->name, profileTicksToMs(node->ticks), profileTicksToMs(node->ticks - childTicks), node->calls);
+   immText(line, FontSize_Small);
+
+   for (i32 c = node->firstChild; c != -1; c = gProfiler->nodes[c].nextSibling) {
+      profileDrawNode(c, depth + 1);
+   }
+}
+
+void
+profileDrawSummary()
+{
+   if (!gProfiler->showSummary || !gProfiler->numNodes) {
+      return;
+   }
+   immSetCursor(10, 10);
+   for (i32 root = 0; root != -1; root = gProfiler->nodes[root].nextSibling) {
+      profileDrawNode(root, 0);
+   }
+   if (gProfiler->numDropped) {
+      char line[64] = {};
+      snprintf(line, ArrayCount(line), "%u zones did not fit", gProfiler->numDropped);
+      immText(line, FontSize_Small);
+   }
+
+   // Since the start, so it covers the frames from before the summary was shown.
+   ImmStats ui = immStats();
+   if (ui.numFrames) {
+      char line[96] = {};
+      snprintf(line, ArrayCount(line), "UI: %.0f%% of frames reused, %.0f%% of quads written",
+               100.0 * ui.numFramesReused / ui.numFrames, 100.0 * ui.totalQuadsWritten / Max(ui.totalQuads, 1ull));
+      immText(line, FontSize_Small);
+   }
+}
+
+bool
+profileExportChromeTrace(Platform* plat, char* path)
+{
+   profileCalibrate();
+   if (!gProfiler->ticksPerUs) {
+      return false;
+   }
+
+   const u64 maxEventBytes = 160;  // Longer names are cut.
+   u32 numThreads = Min((u32)gProfiler->numThreads, gKnobs.profilerMaxThreads);
+   u64 maxBytes = 64 + numThreads * (gKnobs.profilerRingEvents / 2 + 1) * maxEventBytes;
+   char* json = AllocateArray(char, maxBytes, Lifetime_Frame);
+   u64 len = snprintf(json, maxBytes, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+   bool first = true;
+   for (u32 ti = 0; ti < numThreads; ++ti) {
+      ProfileThread* t = gProfiler->threads + ti;
+      len += snprintf(json + len, maxBytes - len, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                      first ? "" : ",\n", ti, t->name);
+      first = false;
+
+      // Same as profileNewFrame: the oldest half may be being written over.
+      u32 head = loadAcquire(&t->head);
+      u32 count = Min(head, gKnobs.profilerRingEvents / 2);
+      for (u32 i = 0; i < count; ++i) {
+         ProfileEvent e = t->events[(head - count + i) % gKnobs.profilerRingEvents];
+         double ts = (e.beginTick - gProfiler->startTick) / gProfiler->ticksPerUs;
+         double dur = (e.endTick - e.beginTick) / gProfiler->ticksPerUs;
+         char event[maxEventBytes] = {};
+         snprintf(event, ArrayCount(event), ",\n{\"name\":\"%.64s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                  e.name, ti, ts, dur);
+         len += snprintf(json + len, maxBytes - len, "%s", event);
+      }
+   }
+   len += snprintf(json + len, maxBytes - len, "\n]}\n");
+   Assert(len < maxBytes);
+
+   return plat->writeFileAscii(path, (u8*)json, len);
+}
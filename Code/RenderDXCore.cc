@@ -539,6 +539,18 @@ gpuSetResourceData(ResourceHandle resHnd, const void* data, size_t numBytes)
    res->Unmap(0, &D3D12_RANGE{0, numBytes});
 }
 
+u8*
+gpuMapResource(ResourceHandle resHnd)
+{
+   ID3D12Resource* res = getResource(resHnd);
+
+   // Upload heap resources can stay mapped for as long as they live.
+   u8* dataBegin = nullptr;
+   D3D12_RANGE readRange = {0, 0};
+   DX12(res->Map(0, &readRange, reinterpret_cast<void**>(&dataBegin)));
+   return dataBegin;
+}
+
 ResourceHandle
 gpuCreateResource(size_t numBytes, char* debugName, GPUHeapType heapType, ResourceState state, UINT alignment, CreateResourceFlags flags)
 {
@@ -1824,44 +1836,20 @@ gpuUploadBuffer(ResourceHandle destResource, const u8* data, const sz size)
    gpuUploadBufferAtOffset(destResource, data, size, 0);
 }
 
-Texture2D
-gpuUploadTexture2D(const int width, const int height, const int bytesPerPixel, const u8* data)
+// Textures are stored as rgba8, whatever the source.
+static void
+copyPixelsAsRGBA8(u8* dst, sz dstRowPitch, const u8* src, sz srcRowPitch, const int width, const int height, const int bytesPerPixel)
 {
-   Renderer* r = gRenderCore;
-
-   Texture2D result = gpuCreateTexture2D(width, height, /*uav*/false);
-
-   D3D12_SUBRESOURCE_FOOTPRINT footprint = {};
-
-   DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
-
-   footprint.Format = format;
-   footprint.Width = width;
-   footprint.Height = height;
-   footprint.Depth = 1;
-   footprint.RowPitch = AlignPow2(width * 4/*regardless of source, we're storing rgba*/, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
-
-   sz offset = gpuReserveUploadBuffer(
-      footprint.Height * footprint.RowPitch,
-      D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
-
-   D3D12_PLACED_SUBRESOURCE_FOOTPRINT placedTexture = {};
-   placedTexture.Offset = offset;
-   placedTexture.Footprint = footprint;
-
-   // Copy texture row by row to upload heap
-   u8* copyPointer = r->uploadHeapPtr + offset;
-   sz sourceRowSize = width * bytesPerPixel;
    if (bytesPerPixel == 4) {
       for (int j = 0; j < height; ++j) {
-         const u8* inRow = data + (j * sourceRowSize);
-         memcpy(copyPointer + (j * footprint.RowPitch), inRow, sourceRowSize);
+         const u8* inRow = src + (j * srcRowPitch);
+         memcpy(dst + (j * dstRowPitch), inRow, width * 4);
       }
    }
    else if (bytesPerPixel == 3) {
       for (int j = 0; j < height; ++j) {
-         const u8* inRow = data + (j * sourceRowSize);
-         u8* outRow = (copyPointer + (j * footprint.RowPitch));
+         const u8* inRow = src + (j * srcRowPitch);
+         u8* outRow = (dst + (j * dstRowPitch));
          for (int i = 0; i < width; ++i) {
             outRow[i*4 + 0] = inRow[i*3 + 0];
             outRow[i*4 + 1] = inRow[i*3 + 1];
@@ -1872,8 +1860,8 @@ gpuUploadTexture2D(const int width, const int height, const int bytesPerPixel, c
    }
    else if (bytesPerPixel == 1) {
       for (int j = 0; j < height; ++j) {
-         const u8* inRow = data + (j * sourceRowSize);
-         u8* outRow = (copyPointer + (j * footprint.RowPitch));
+         const u8* inRow = src + (j * srcRowPitch);
+         u8* outRow = (dst + (j * dstRowPitch));
          for (int i = 0; i < width; ++i) {
             outRow[i*4 + 0] = inRow[i];
             outRow[i*4 + 1] = inRow[i];
@@ -1885,11 +1873,35 @@ gpuUploadTexture2D(const int width, const int height, const int bytesPerPixel, c
    else {
       Assert(false);  // ???
    }
+}
+
+// Records a copy of width x height pixels to (x, y) in the texture, which must be in the CopyDest state.
+static void
+copyToTexture2D(ResourceHandle texture, const int x, const int y, const int width, const int height, const int bytesPerPixel, const u8* data, const sz dataRowPitch)
+{
+   Renderer* r = gRenderCore;
+
+   D3D12_SUBRESOURCE_FOOTPRINT footprint = {};
+
+   DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+   footprint.Format = format;
+   footprint.Width = width;
+   footprint.Height = height;
+   footprint.Depth = 1;
+   footprint.RowPitch = AlignPow2(width * 4/*regardless of source, we're storing rgba*/, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
+
+   sz offset = gpuReserveUploadBuffer(
+      footprint.Height * footprint.RowPitch,
+      D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+
+   // Copy texture row by row to upload heap
+   copyPixelsAsRGBA8(r->uploadHeapPtr + offset, footprint.RowPitch, data, dataRowPitch, width, height, bytesPerPixel);
 
    // Copy to texture
 
    D3D12_TEXTURE_COPY_LOCATION dstLoc = {};
-   dstLoc.pResource = getResource(result.resourceHandle);
+   dstLoc.pResource = getResource(texture);
    dstLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
    dstLoc.SubresourceIndex = 0;
 
@@ -1898,13 +1910,31 @@ gpuUploadTexture2D(const int width, const int height, const int bytesPerPixel, c
    srcLoc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
    srcLoc.PlacedFootprint = D3D12_PLACED_SUBRESOURCE_FOOTPRINT { offset, footprint };
 
-   r->commandList->CopyTextureRegion(&dstLoc, 0, 0, 0, &srcLoc, nullptr);
+   r->commandList->CopyTextureRegion(&dstLoc, x, y, 0, &srcLoc, nullptr);
+}
+
+Texture2D
+gpuUploadTexture2D(const int width, const int height, const int bytesPerPixel, const u8* data)
+{
+   Texture2D result = gpuCreateTexture2D(width, height, /*uav*/false);
+
+   copyToTexture2D(result.resourceHandle, 0, 0, width, height, bytesPerPixel, data, width * bytesPerPixel);
 
    gpuBarrierForResource(result.resourceHandle, ResourceState_CopyDest, ResourceState_PixelShaderResource);
 
    return result;
 }
 
+void
+gpuUpdateTexture2D(Texture2D tex, const int x, const int y, const int width, const int height, const int bytesPerPixel, const u8* data, const sz dataRowPitch)
+{
+   gpuBarrierForResource(tex.resourceHandle, ResourceState_PixelShaderResource, ResourceState_CopyDest);
+
+   copyToTexture2D(tex.resourceHandle, x, y, width, height, bytesPerPixel, data, dataRowPitch);
+
+   gpuBarrierForResource(tex.resourceHandle, ResourceState_CopyDest, ResourceState_PixelShaderResource);
+}
+
 Texture3D
 gpuCreateTexture3D(const int width, const int height, const int depth)
 {
@@ -1971,10 +2001,10 @@ gpuGraphicsPipelineState(u8* vertexByteCode, u64 szVertexByteCode, u8* pixelByte
 
    D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
    {
-       { "POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, OffsetOf(MeshRenderVertex, position), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-       { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, OffsetOf(MeshRenderVertex, normal), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-       { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, OffsetOf(MeshRenderVertex, texcoord), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-       { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, OffsetOf(MeshRenderVertex, color), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+       { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, OffsetOf(MeshRenderVertex, position), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+       { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, OffsetOf(MeshRenderVertex, normal), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+       { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, OffsetOf(MeshRenderVertex, texcoord), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+       { "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, OffsetOf(MeshRenderVertex, color), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
    };
 
    D3D12_RASTERIZER_DESC rasterizerDesc = {};
@@ -2096,7 +2126,7 @@ gpuComputePipelineState(u8* code, u64 sz)
 
 
 BLASHandle
-gpuMakeBLAS(ResourceHandle vertexBuffer, u64 numVerts, u64 vertexStride, ResourceHandle indexBuffer, u64 numIndices)
+gpuMakeBLAS(ResourceHandle vertexBuffer, u64 numVerts, u64 vertexStride, ResourceHandle indexBuffer, u64 numIndices, u32 indexSize)
 {
    Renderer* r = gRenderCore;
 
@@ -2108,7 +2138,7 @@ gpuMakeBLAS(ResourceHandle vertexBuffer, u64 numVerts, u64 vertexStride, Resourc
    geometryDesc->Triangles.VertexCount = numVerts;
    geometryDesc->Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
    geometryDesc->Triangles.IndexBuffer = getResource(indexBuffer)->GetGPUVirtualAddress();
-   geometryDesc->Triangles.IndexFormat = DXGI_FORMAT_R32_UINT;
+   geometryDesc->Triangles.IndexFormat = (indexSize == sizeof(u16)) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
    geometryDesc->Triangles.IndexCount = static_cast<UINT>(numIndices);
    geometryDesc->Triangles.Transform3x4 = 0;
    geometryDesc->Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
@@ -2566,7 +2596,7 @@ gpuSetPipelineState(PipelineStateHandle pso)
 }
 
 void
-gpuSetVertexAndIndexBuffers(ResourceHandle vertexBuffer, u64 vertexBytes, ResourceHandle indexBuffer, u64 indexBytes)
+gpuSetVertexAndIndexBuffers(ResourceHandle vertexBuffer, u64 vertexBytes, ResourceHandle indexBuffer, u64 indexBytes, u32 indexSize)
 {
    Renderer* r = gRenderCore;
 
@@ -2579,7 +2609,7 @@ gpuSetVertexAndIndexBuffers(ResourceHandle vertexBuffer, u64 vertexBytes, Resour
 
    ibv.BufferLocation = getResource(indexBuffer)->GetGPUVirtualAddress();
    ibv.SizeInBytes = indexBytes;
-   ibv.Format = DXGI_FORMAT_R32_UINT;
+   ibv.Format = (indexSize == sizeof(u16)) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
 
 
    r->commandList->IASetVertexBuffers(0, 1, &vbv);
@@ -2601,10 +2631,10 @@ gpuSetGraphicsConstantSlot(int slot, ResourceHandle resource)
 }
 
 void
-gpuDrawIndexed(u64 numIndices)
+gpuDrawIndexed(u64 numIndices, u64 firstIndex)
 {
    Renderer* r = gRenderCore;
-   r->commandList->DrawIndexedInstanced(numIndices, 1, 0, 0, 0);
+   r->commandList->DrawIndexedInstanced(numIndices, 1, firstIndex, 0, 0);
 }
 
 // For reference for when we re-introduce blobs..
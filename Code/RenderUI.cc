@@ -1,189 +1,543 @@
 
+// What the UI pixel shader does with a quad. Matches UI.hlsl.
+enum UISampleMode
+{
+   UISample_Flat,
+   UISample_Sdf,  // Font atlas
+   UISample_Image,
+};
+
 struct TextConstants
 {
    mat4 transform;
 
-   int atlasBindIdx;
-   int pad0[3];
+   int textureBindIdx;
+   int sampleMode;  // UISampleMode
+   int pad0[2];
 };
 
 
-void
-fontDeinit(Font* t)
+// Signed distance field font atlas.
+//
+// Glyphs are rasterized with stbtt_GetGlyphSDF at gKnobs.fontSdfPx and shelf
+// packed into an atlas kept on the CPU. Printable ASCII is rasterized at load,
+// spread over the worker threads when loading on the main thread; any other
+// code point the first time a string uses it. The pixels added since the last
+// frame are uploaded as one region before text is drawn. Every size draws from
+// the same glyph, scaled; the UI shader turns distance into coverage. The
+// atlas and glyph table are written to font_<hash>.sdfcache when the font is
+// deinitialized, keyed by a MeowHash of the font file, so later runs start
+// with the glyphs they already had.
+
+#define FontCacheMagic 0x41464453  // 'SDFA'
+#define FontCacheVersion 1
+
+struct FontCacheHeader
+{
+   u32 magic;
+   u32 version;
+   u64 fileHash[2];
+
+   u32 atlasSize;
+   u32 sdfPx;
+   u32 sdfPadding;
+   u32 numGlyphs;
+   i32 shelfX;
+   i32 shelfY;
+   i32 shelfHeight;
+
+   u64 glyphOffset;  // FontCacheGlyph array, from the start of the file
+   u64 atlasOffset;  // atlasSize * atlasSize pixels
+   u64 totalBytes;
+};
+
+struct FontCacheGlyph
+{
+   u32 codepoint;
+   FontGlyph glyph;
+};
+
+static bool
+fontCacheIsValid(u8* cache, u64 cacheBytes, Font* t)
+{
+   bool valid = false;
+   if (cache && cacheBytes >= sizeof(FontCacheHeader)) {
+      FontCacheHeader* h = (FontCacheHeader*)cache;
+      valid = h->magic == FontCacheMagic &&
+              h->version == FontCacheVersion &&
+              h->fileHash[0] == t->fileHash[0] &&
+              h->fileHash[1] == t->fileHash[1] &&
+              h->atlasSize == (u32)t->atlasSize &&
+              h->sdfPx == gKnobs.fontSdfPx &&
+              h->sdfPadding == gKnobs.fontSdfPadding &&
+              h->totalBytes == cacheBytes &&
+              h->glyphOffset + h->numGlyphs * sizeof(FontCacheGlyph) <= cacheBytes &&
+              h->atlasOffset + (u64)h->atlasSize * h->atlasSize <= cacheBytes;
+   }
+   return valid;
+}
+
+static void
+fontReadCache(Platform* plat, Font* t)
 {
-   gpuMarkFreeRenderMesh(&t->rmesh, gpu()->frameCount);
+   u64 cacheBytes = 0;
+   u8* cache = plat->mapFileAscii(t->cachePath, &cacheBytes);
+   if (fontCacheIsValid(cache, cacheBytes, t)) {
+      FontCacheHeader* h = (FontCacheHeader*)cache;
+      FontCacheGlyph* glyphs = (FontCacheGlyph*)(cache + h->glyphOffset);
+
+      pushApiLifetime(t->life);
+      for (u32 i = 0; i < h->numGlyphs; ++i) {
+         hmput(t->hmGlyphs, glyphs[i].codepoint, glyphs[i].glyph);
+      }
+      popApiLifetime();
+
+      memcpy(t->atlasPixels, cache + h->atlasOffset, h->atlasSize * h->atlasSize);
+      t->shelfX = h->shelfX;
+      t->shelfY = h->shelfY;
+      t->shelfHeight = h->shelfHeight;
+   }
+   if (cache) {
+      plat->unmapFile(cache);
+   }
+}
+
+static bool
+fontWriteCache(Platform* plat, Font* t)
+{
+   FontCacheHeader h = {};
+   h.magic = FontCacheMagic;
+   h.version = FontCacheVersion;
+   h.fileHash[0] = t->fileHash[0];
+   h.fileHash[1] = t->fileHash[1];
+   h.atlasSize = t->atlasSize;
+   h.sdfPx = gKnobs.fontSdfPx;
+   h.sdfPadding = gKnobs.fontSdfPadding;
+   h.numGlyphs = (u32)hmlen(t->hmGlyphs);
+   h.shelfX = t->shelfX;
+   h.shelfY = t->shelfY;
+   h.shelfHeight = t->shelfHeight;
+   h.glyphOffset = AlignPow2(sizeof(FontCacheHeader), 16);
+   h.atlasOffset = AlignPow2(h.glyphOffset + h.numGlyphs * sizeof(FontCacheGlyph), 16);
+   h.totalBytes = h.atlasOffset + (u64)t->atlasSize * t->atlasSize;
+
+   u8* bytes = allocateBytes(h.totalBytes, Lifetime_Frame);
+
+   memcpy(bytes, &h, sizeof(h));
+
+   FontCacheGlyph* glyphs = (FontCacheGlyph*)(bytes + h.glyphOffset);
+   for (u32 i = 0; i < h.numGlyphs; ++i) {
+      glyphs[i].codepoint = t->hmGlyphs[i].key;
+      glyphs[i].glyph = t->hmGlyphs[i].value;
+   }
+
+   memcpy(bytes + h.atlasOffset, t->atlasPixels, (u64)t->atlasSize * t->atlasSize);
+
+   return plat->writeFileAscii(t->cachePath, bytes, h.totalBytes);
 }
 
 void
-fontInit(Platform* plat, Font* t, char* fontPath, float* customSizes)
+fontDeinit(Platform* plat, Font* t)
 {
-   t->atlasSize = 2048; //gKnobs.height;
+   if (t->glyphsAdded && t->cachePath[0] && fontWriteCache(plat, t)) {
+      t->glyphsAdded = false;
+   }
+}
 
-   t->atlasMesh = makeQuad(2048, 0.0, Lifetime_Frame);
-   t->rmesh = uploadMeshToGPU(t->atlasMesh, /*material*/false, /*blas*/false);
+bool
+fontLoad(Platform* plat, Font* t, char* fontPath, float* customSizes, u32 numThreads, Lifetime life)
+{
+   bool loaded = false;
+
+   // A font loaded again, as on Restart, starts over. Glyphs kept from before
+   // would point into the old atlas. Its texture is the caller's to free.
+   hmfree(t->hmGlyphs);
+   *t = {};
+   t->atlasSize = gKnobs.fontAtlasSize;
+   t->life = life;
+
+   if (!customSizes) {
+      t->fontSizesPx[FontSize_Tiny] = 10;
+      t->fontSizesPx[FontSize_Small] = 12;
+      t->fontSizesPx[FontSize_Medium] = 14;
+      t->fontSizesPx[FontSize_Big] = 18;
+   }
+   else {
+      for (int i = 0; i < FontSize_Count; ++i) {
+         t->fontSizesPx[i] = customSizes[i];
+      }
+   }
 
-   // Load atlas
+   // Load font. Glyphs are rasterized from it as they are needed.
    u8* data = {};
-   u64 bytes = plat->fileContentsAscii(fontPath, data, Lifetime_App);
+   u64 bytes = assetFileContents(plat, fontPath, data, life);
 
    if (!bytes) {
       Assert(false);  // COuld not find font
    }
    else {
-      stbtt_fontinfo fontInfo = {};
-      int success = stbtt_InitFont(&fontInfo, data, 0);
+      stbtt_fontinfo* fontInfo = AllocateElem(stbtt_fontinfo, life);
+      int success = stbtt_InitFont(fontInfo, data, 0);
       if (!success) {
          Assert(false);  // Invalid font
       }
       else {
-         // Pack the font
-         stbtt_pack_context spc = {};
+         t->info = fontInfo;
+
+         meow_u128 hash = MeowHash(MeowDefaultSeed, bytes, data);
+         t->fileHash[0] = MeowU64From(hash, 0);
+         t->fileHash[1] = MeowU64From(hash, 1);
+
+         t->atlasPixels = allocateBytes(t->atlasSize * t->atlasSize, life);
+         if (life == Lifetime_App) {
+            char cacheName[MaxPath] = {};
+            snprintf(cacheName, ArrayCount(cacheName), "../font_%016llx%016llx.sdfcache", t->fileHash[1], t->fileHash[0]);
+            snprintf(t->cachePath, ArrayCount(t->cachePath), "%s", assetPathForFrame(plat, cacheName));
+            fontReadCache(plat, t);
+         }
+
+         // Printable ASCII up front, unless the cache had it. Other glyphs wait for their first use.
+         u32 ascii[127 - ' '] = {};
+         for (u32 i = 0; i < ArrayCount(ascii); ++i) {
+            ascii[i] = ' ' + i;
+         }
+         u64 beginUs = plat->getMicroseconds();
+         u32 numRasterized = fontPrepareGlyphs(plat, t, ascii, ArrayCount(ascii), numThreads);
+         if (numRasterized) {
+            logMsg("Rasterized %u glyphs of %s in %.2f ms, %u threads\n", numRasterized, fontPath, (plat->getMicroseconds() - beginUs) / 1000.0, numThreads);
+         }
+
+         loaded = true;
+      }
+   }
+
+   return loaded;
+}
+
+void
+fontUploadAtlas(Font* t)
+{
+   if (t->atlasPixels) {
+      t->atlasTexture = gpuUploadTexture2D(t->atlasSize, t->atlasSize, 1, t->atlasPixels);
+      t->dirtyX0 = t->dirtyY0 = t->dirtyX1 = t->dirtyY1 = 0;
+   }
+}
 
-         int width = t->atlasSize;
-         int height = t->atlasSize;
+void
+fontInit(Platform* plat, Font* t, char* fontPath, float* customSizes)
+{
+   fontLoad(plat, t, fontPath, customSizes, plat->numWorkerThreads + 1);
+   fontUploadAtlas(t);
+}
 
-         if (!customSizes) {
-            t->fontSizesPx[FontSize_Tiny] = 10;
-            t->fontSizesPx[FontSize_Small] = 12;
-            t->fontSizesPx[FontSize_Medium] = 14;
-            t->fontSizesPx[FontSize_Big] = 18;
+static bool
+fontAtlasPack(Font* t, int w, int h, int* x, int* y)
+{
+   int gap = 1;  // Keeps bilinear filtering from reaching the neighbors.
+   if (t->shelfX + w > t->atlasSize) {
+      t->shelfY += t->shelfHeight + gap;
+      t->shelfX = 0;
+      t->shelfHeight = 0;
+   }
+
+   bool fits = w <= t->atlasSize && t->shelfY + h <= t->atlasSize;
+   if (fits) {
+      *x = t->shelfX;
+      *y = t->shelfY;
+      t->shelfX += w + gap;
+      t->shelfHeight = Max(t->shelfHeight, h);
+   }
+   return fits;
+}
+
+// Metrics and a spot in the atlas. The distance field is written separately,
+// by fontRasterizeGlyph, so that many glyphs can be rasterized at once.
+static FontGlyph
+fontPlaceGlyph(Font* t, int glyphIdx, u32 codepoint)
+{
+   stbtt_fontinfo* info = (stbtt_fontinfo*)t->info;
+   f32 scale = stbtt_ScaleForMappingEmToPixels(info, gKnobs.fontSdfPx);
+
+   FontGlyph g = {};
+
+   int advance = 0;
+   int leftBearing = 0;
+   stbtt_GetGlyphHMetrics(info, glyphIdx, &advance, &leftBearing);
+   g.advance = advance * scale;
+
+   // The same box stbtt_GetGlyphSDF makes.
+   int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+   stbtt_GetGlyphBitmapBoxSubpixel(info, glyphIdx, scale, scale, 0, 0, &x0, &y0, &x1, &y1);
+   if (x0 != x1 && y0 != y1) {
+      int pad = gKnobs.fontSdfPadding;
+      int w = x1 - x0 + 2 * pad;
+      int h = y1 - y0 + 2 * pad;
+      int x = 0, y = 0;
+      if (!fontAtlasPack(t, w, h, &x, &y)) {
+         logMsg("Font atlas is full. Drawing code point %u empty.\n", codepoint);
+      }
+      else {
+         if (t->dirtyX1 <= t->dirtyX0) {
+            t->dirtyX0 = x;
+            t->dirtyY0 = y;
+            t->dirtyX1 = x + w;
+            t->dirtyY1 = y + h;
          }
          else {
-            for (int i = 0; i < FontSize_Count; ++i) {
-               t->fontSizesPx[i] = customSizes[i];
-            }
+            t->dirtyX0 = Min(t->dirtyX0, x);
+            t->dirtyY0 = Min(t->dirtyY0, y);
+            t->dirtyX1 = Max(t->dirtyX1, x + w);
+            t->dirtyY1 = Max(t->dirtyY1, y + h);
          }
 
-         t->numChars = 127;  // ASCII range for now.
+         g.x = (u16)x;
+         g.y = (u16)y;
+         g.w = (u16)w;
+         g.h = (u16)h;
+         g.xoff = (f32)(x0 - pad);
+         g.yoff = (f32)(y0 - pad);
+      }
+   }
+
+   return g;
+}
+
+// Glyphs have disjoint spots in the atlas, so any thread can write one.
+static void
+fontRasterizeGlyph(Font* t, int glyphIdx, const FontGlyph& g)
+{
+   if (g.w) {
+      stbtt_fontinfo* info = (stbtt_fontinfo*)t->info;
+      f32 scale = stbtt_ScaleForMappingEmToPixels(info, gKnobs.fontSdfPx);
+
+      // The edge is at 128; values change by 128 / padding per pixel away from it.
+      int w = 0, h = 0, xoff = 0, yoff = 0;
+      u8* sdf = stbtt_GetGlyphSDF(info, scale, glyphIdx, gKnobs.fontSdfPadding, 128, 128.0f / gKnobs.fontSdfPadding, &w, &h, &xoff, &yoff);
+      Assert(sdf && w == g.w && h == g.h);
+      if (sdf) {
+         for (int row = 0; row < h; ++row) {
+            memcpy(t->atlasPixels + (g.y + row) * t->atlasSize + g.x, sdf + row * w, w);
+         }
+         stbtt_FreeSDF(sdf, nullptr);
+      }
+   }
+}
+
+FontGlyph*
+fontGlyph(Font* t, u32 codepoint)
+{
+   i64 idx = hmgeti(t->hmGlyphs, codepoint);
+   if (idx == -1) {
+      int glyphIdx = stbtt_FindGlyphIndex((stbtt_fontinfo*)t->info, codepoint);
+      FontGlyph g = fontPlaceGlyph(t, glyphIdx, codepoint);
+      fontRasterizeGlyph(t, glyphIdx, g);
+
+      pushApiLifetime(t->life);
+      hmput(t->hmGlyphs, codepoint, g);
+      popApiLifetime();
+      t->glyphsAdded = true;
+      idx = hmgeti(t->hmGlyphs, codepoint);
+   }
+   return &t->hmGlyphs[idx].value;
+}
+
+struct FontRasterJob
+{
+   Font* font;
+   int* glyphIndices;
+   FontGlyph* glyphs;
+   u32 numGlyphs;
+};
 
-         t->packedData[FontSize_Tiny] = AllocateArray(stbtt_packedchar, t->numChars, Lifetime_App);
-         t->packedData[FontSize_Small] = AllocateArray(stbtt_packedchar, t->numChars, Lifetime_App);
-         t->packedData[FontSize_Medium] = AllocateArray(stbtt_packedchar, t->numChars, Lifetime_App);
-         t->packedData[FontSize_Big] = AllocateArray(stbtt_packedchar, t->numChars, Lifetime_App);
+PlatformWorkProcDef(fontRasterizeProc)
+{
+   // Doesn't allocate from the job; stbtt mallocs the distance fields.
+   FontRasterJob* job = (FontRasterJob*)data;
+   for (u32 i = 0; i < job->numGlyphs; ++i) {
+      fontRasterizeGlyph(job->font, job->glyphIndices[i], job->glyphs[i]);
+   }
+}
 
-         unsigned char* atlas = (unsigned char*)allocateBytes(width * height, Lifetime_App);
+u32
+fontPrepareGlyphs(Platform* plat, Font* t, u32* codepoints, u32 numCodepoints, u32 numThreads)
+{
+   int* glyphIndices = AllocateArray(int, numCodepoints, Lifetime_Frame);
+   FontGlyph* glyphs = AllocateArray(FontGlyph, numCodepoints, Lifetime_Frame);
+   u32 numNew = 0;
+
+   // Packing and the glyph table stay on this thread, in order.
+   pushApiLifetime(t->life);
+   for (u32 i = 0; i < numCodepoints; ++i) {
+      u32 codepoint = codepoints[i];
+      if (hmgeti(t->hmGlyphs, codepoint) == -1) {
+         int glyphIdx = stbtt_FindGlyphIndex((stbtt_fontinfo*)t->info, codepoint);
+         FontGlyph g = fontPlaceGlyph(t, glyphIdx, codepoint);
+         hmput(t->hmGlyphs, codepoint, g);
+         glyphIndices[numNew] = glyphIdx;
+         glyphs[numNew] = g;
+         numNew++;
+      }
+   }
+   popApiLifetime();
+
+   if (numNew) {
+      t->glyphsAdded = true;
+
+      // Glyph costs vary, so a few jobs per thread.
+      u32 numJobs = Min(numNew, numThreads > 1 ? numThreads * 4 : 1);
+      FontRasterJob* jobs = AllocateArray(FontRasterJob, numJobs, Lifetime_Frame);
+      u32 perJob = (numNew + numJobs - 1) / numJobs;
+      u32 first = 0;
+      for (u32 ji = 0; ji < numJobs && first < numNew; ++ji) {
+         FontRasterJob* job = jobs + ji;
+         job->font = t;
+         job->glyphIndices = glyphIndices + first;
+         job->glyphs = glyphs + first;
+         job->numGlyphs = Min(perJob, numNew - first);
+         first += job->numGlyphs;
+      }
+
+      runJobs(plat, fontRasterizeProc, jobs, sizeof(*jobs), numJobs);
+   }
 
-         int packOk = stbtt_PackBegin(&spc, atlas, width, height, 0, 1, {});
-         if (!packOk) {
-            Assert(false); // Packing failed
+   return numNew;
+}
+
+void
+fontFlushAtlas(Font* t)
+{
+   if (t->dirtyX1 > t->dirtyX0) {
+      gpuUpdateTexture2D(t->atlasTexture,
+                         t->dirtyX0, t->dirtyY0,
+                         t->dirtyX1 - t->dirtyX0, t->dirtyY1 - t->dirtyY0,
+                         /*bytesPerPixel*/1,
+                         t->atlasPixels + t->dirtyY0 * t->atlasSize + t->dirtyX0,
+                         t->atlasSize);
+      t->dirtyX0 = t->dirtyY0 = t->dirtyX1 = t->dirtyY1 = 0;
+   }
+}
+
+// Returns the code point at str and how many bytes it takes. Bytes that are
+// not valid UTF-8 decode to U+FFFD, one at a time.
+static u32
+utf8Decode(const char* str, u32 maxBytes, u32* outNumBytes)
+{
+   const u8* s = (const u8*)str;
+   u32 cp = 0xFFFD;
+   u32 n = 1;
+   if (s[0] < 0x80) {
+      cp = s[0];
+   }
+   else {
+      u32 len = (s[0] & 0xE0) == 0xC0 ? 2 : (s[0] & 0xF0) == 0xE0 ? 3 : (s[0] & 0xF8) == 0xF0 ? 4 : 0;
+      if (len && len <= maxBytes) {
+         u32 c = s[0] & (0x7F >> len);
+         bool ok = true;
+         for (u32 i = 1; i < len; ++i) {
+            ok &= (s[i] & 0xC0) == 0x80;
+            c = (c << 6) | (s[i] & 0x3F);
          }
-         else {
-            stbtt_PackSetOversampling(&spc, gKnobs.fontOversampling, gKnobs.fontOversampling);
-            for (int i = 0; i < FontSize_Count; ++i) {
-               packOk &= stbtt_PackFontRange(
-                  &spc,
-                  data,
-                  /*fontIndex*/0,
-                  STBTT_POINT_SIZE(t->fontSizesPx[i]),
-                  0, t->numChars /*ascii range*/,
-                  (stbtt_packedchar*)t->packedData[i]);
-            }
-
-            if (!packOk) {
-               Assert(false); // Failed to pack font range
-            }
-            else {
-               stbtt_PackEnd(&spc);
-               t->atlasTexture = gpuUploadTexture2D(width, height, 1, atlas);
-            }
+         if (ok) {
+            cp = c;
+            n = len;
          }
       }
    }
+   *outNumBytes = n;
+   return cp;
 }
 
+// Lays out chars [from, to) of UTF-8 contents as glyph quads on a line
+// starting at 0,0, one quad per byte. A code point's quad is at its first
+// byte; the rest get empty quads. penX[i] is where the pen is after byte i.
+// There is no kerning, so glyphs before `from` stay as they are and only
+// their pen position is read.
 void
-buildLineOfText(Font& t, FontSize size, char* contents, MeshRenderHandle& outMesh, ResourceHandle& outResHnd)
-{
-   Assert(contents && strlen(contents));
-   sz szContents = strlen(contents);
-
-   MeshRenderVertex* sRenderVerts = NULL;
-   u32* sIndices = NULL;
-
-   auto* quads = AllocateArray(stbtt_aligned_quad, szContents, Lifetime_Frame);
-
-   // Building at 0,0. We can translate on draw.
-   float cursorX = 0;
-   float cursorY = 0;
-
-   outResHnd = gpuCreateResource(sizeof(TextConstants), "Text constants");
-
-   for (sz i = 0; i < szContents; ++i) {
-      stbtt_GetPackedQuad((stbtt_packedchar*)t.packedData[size],
-                           t.atlasSize, t.atlasSize,
-                           contents[i],
-                           &cursorX, &cursorY,
-                           quads + i,
-                           /*int align_to_integer*/ 0);
-      // TODO: If we wrap it would probably be here?
-
-      // Add quad to mesh
-      vec3 n = vec3{0, 0, -1};
-      /**
-         s0,t1         s1,t1
-         *-------------*
-         v3            v2
-         |             |
-         |             |
-         | s0,t0       |
-         *-------------*  s1, t0
-         v0            v1
-      **/
-      MeshRenderVertex v0 = {};
-      MeshRenderVertex v1 = {};
-      MeshRenderVertex v2 = {};
-      MeshRenderVertex v3 = {};
-
-      v0.position.x = quads[i].x0;
-      v0.position.y = quads[i].y0;
-      v0.texcoord.u = quads[i].s0;
-      v0.texcoord.v = quads[i].t0;
-
-      v1.position.x = quads[i].x1;
-      v1.position.y = quads[i].y0;
-      v1.texcoord.u = quads[i].s1;
-      v1.texcoord.v = quads[i].t0;
-
-      v2.position.x = quads[i].x1;
-      v2.position.y = quads[i].y1;
-      v2.texcoord.u = quads[i].s1;
-      v2.texcoord.v = quads[i].t1;
-
-      v3.position.x = quads[i].x0;
-      v3.position.y = quads[i].y1;
-      v3.texcoord.u = quads[i].s0;
-      v3.texcoord.v = quads[i].t1;
-
-      // Set all the normals, z and w
-      v0.normal = v1.normal = v2.normal = v3.normal = n;
-      v0.position.z = v1.position.z = v2.position.z = v3.position.z = 0;
-      v0.position.w = v1.position.w = v2.position.w = v3.position.w = 1;
-
-      u32 v0i = SBCount(sRenderVerts); SBPush(sRenderVerts, v0, Lifetime_Frame);
-      u32 v1i = SBCount(sRenderVerts); SBPush(sRenderVerts, v1, Lifetime_Frame);
-      u32 v2i = SBCount(sRenderVerts); SBPush(sRenderVerts, v2, Lifetime_Frame);
-      u32 v3i = SBCount(sRenderVerts); SBPush(sRenderVerts, v3, Lifetime_Frame);
-
-      // Rects passed as CCW because coordinates will get flipped by the UI shader, reversing the winding order.
-      SBPush(sIndices, v0i, Lifetime_Frame);
-      SBPush(sIndices, v1i, Lifetime_Frame);
-      SBPush(sIndices, v2i, Lifetime_Frame);
-
-      SBPush(sIndices, v2i, Lifetime_Frame);
-      SBPush(sIndices, v3i, Lifetime_Frame);
-      SBPush(sIndices, v0i, Lifetime_Frame);
-   }
-
-   outMesh = uploadMeshToGPU(sRenderVerts, sIndices, /*withMaterial*/false, /*blas*/false);
+layoutLineOfText(Font& t, FontSize size, char* contents, u32 from, u32 to, stbtt_aligned_quad* outQuads, f32* penX)
+{
+   Assert(contents && to <= strlen(contents));
+
+   // Start at a code point.
+   while (from > 0 && ((u8)contents[from] & 0xC0) == 0x80) {
+      from--;
+   }
+
+   f32 scale = t.fontSizesPx[size] / gKnobs.fontSdfPx;
+   f32 texelSize = 1.0f / t.atlasSize;
+   f32 pen = from ? penX[from - 1] : 0;
+
+   for (u32 i = from; i < to; ) {
+      u32 numBytes = 0;
+      u32 codepoint = utf8Decode(contents + i, to - i, &numBytes);
+      FontGlyph* g = fontGlyph(&t, codepoint);
+
+      stbtt_aligned_quad q = {};
+      if (g->w) {
+         q.x0 = pen + g->xoff * scale;
+         q.y0 = g->yoff * scale;
+         q.x1 = q.x0 + g->w * scale;
+         q.y1 = q.y0 + g->h * scale;
+         q.s0 = g->x * texelSize;
+         q.t0 = g->y * texelSize;
+         q.s1 = (g->x + g->w) * texelSize;
+         q.t1 = (g->y + g->h) * texelSize;
+      }
+      pen += g->advance * scale;
+
+      for (u32 b = 0; b < numBytes; ++b) {
+         outQuads[i + b] = b ? stbtt_aligned_quad{} : q;
+         penX[i + b] = pen;
+      }
+      i += numBytes;
+   }
 }
 
+// The four vertices of a glyph quad placed at `at`, in the order UI quad indices expect.
 void
-renderUIElem(Font& t, const MeshRenderHandle& rmesh, ResourceHandle resHnd, const mat4& transform = mat4Identity(), bool flatColor = false)
+glyphQuadVertices(const stbtt_aligned_quad& q, vec2 at, u32 color, MeshRenderVertex* out)
 {
-   gpuSetPipelineState(gWorldRender->uiPSO);  // TODO: uiPSO should not live in worldrender
+   /**
+      s0,t1         s1,t1
+      *-------------*
+      v3            v2
+      |             |
+      |             |
+      | s0,t0       |
+      *-------------*  s1, t0
+      v0            v1
+   **/
+   MeshRenderVertex v[4] = {};
+
+   v[0].position = Vec3(at.x + q.x0, at.y + q.y0, 0);
+   v[0].texcoord[0] = floatToHalf(q.s0);
+   v[0].texcoord[1] = floatToHalf(q.t0);
+
+   v[1].position = Vec3(at.x + q.x1, at.y + q.y0, 0);
+   v[1].texcoord[0] = floatToHalf(q.s1);
+   v[1].texcoord[1] = floatToHalf(q.t0);
+
+   v[2].position = Vec3(at.x + q.x1, at.y + q.y1, 0);
+   v[2].texcoord[0] = floatToHalf(q.s1);
+   v[2].texcoord[1] = floatToHalf(q.t1);
+
+   v[3].position = Vec3(at.x + q.x0, at.y + q.y1, 0);
+   v[3].texcoord[0] = floatToHalf(q.s0);
+   v[3].texcoord[1] = floatToHalf(q.t1);
+
+   // Texel corners of the atlas are exact in half precision.
+   u32 normal = octEncodeNormal(Vec3(0, 0, -1));
+   for (int i = 0; i < 4; ++i) {
+      v[i].normal = normal;
+      v[i].color = color;
+   }
 
-   u64 numIndices = setMeshForDraw(rmesh);
+   memcpy(out, v, sizeof(v));
+}
 
+// Constants of a UI draw. The buffer must not be in use by a frame in flight.
+void
+renderUIWriteConstants(ResourceHandle resHnd, UISampleMode mode, i32 textureIdx)
+{
    TextConstants consts = {};
 
    mat4 textOrtho = mat4Identity();
@@ -193,28 +547,26 @@ renderUIElem(Font& t, const MeshRenderHandle& rmesh, ResourceHandle resHnd, cons
    textOrtho[3][0] = -1;
    textOrtho[3][1] = 1;
 
-   if (!flatColor) {
-      consts.atlasBindIdx = t.atlasTexture.srvBindIndex;
-   }
-   else {
-      consts.atlasBindIdx = -1;
-   }
-   consts.transform = textOrtho * transform;
+   consts.textureBindIdx = textureIdx;
+   consts.sampleMode = mode;
+   consts.transform = textOrtho;
 
    gpuSetResourceData(resHnd, &consts, sizeof(consts));
-   gpuSetGraphicsConstantSlot(0, resHnd);
-   gpuDrawIndexed(numIndices);
 }
 
+// UI quads come from buffers the caller wrote this frame or earlier. The
+// pipeline and buffers are set once, and each draw only changes the constants.
 void
-renderText(Font& t, const MeshRenderHandle& rmesh, ResourceHandle resHnd, const mat4& transform = mat4Identity())
+renderUIBegin(ResourceHandle vertexBuffer, ResourceHandle indexBuffer, u32 numQuads)
 {
-   renderUIElem(t, rmesh, resHnd, transform, false);
+   gpuSetPipelineState(gWorldRender->uiPSO);  // TODO: uiPSO should not live in worldrender
+
+   gpuSetVertexAndIndexBuffers(vertexBuffer, numQuads * 4 * sizeof(MeshRenderVertex), indexBuffer, numQuads * 6 * sizeof(u16), sizeof(u16));
 }
 
 void
-renderWidgets(Font& t, const MeshRenderHandle& rmesh, ResourceHandle resHnd, const mat4& transform = mat4Identity())
+renderUIDraw(ResourceHandle resHnd, u32 firstQuad, u32 numQuads)
 {
-   renderUIElem(t, rmesh, resHnd, transform, true);
+   gpuSetGraphicsConstantSlot(0, resHnd);
+   gpuDrawIndexed(numQuads * 6, firstQuad * 6);
 }
-
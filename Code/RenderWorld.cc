@@ -56,6 +56,7 @@ struct WorldRender
    Platform* plat;
 
    RenderMesh* sRenderMeshes;
+   Meshlet* sMeshlets;  // Lifetime_World. Ranges are in sRenderMeshes.
    Material* sMaterials;
    mat4* sObjectTransforms;
 
@@ -205,15 +206,27 @@ packRenderVerts(const Mesh* m, Lifetime life)
    auto* verts = AllocateArray(MeshRenderVertex, numVerts, life);
 
    for (size_t i = 0; i < numVerts; ++i) {
-      verts[i].position = m->sPositions[i];
-      verts[i].normal = m->sNormals[i];
-      verts[i].texcoord = m->sTexcoords[i];
-      verts[i].color = m->sColors[i];
+      verts[i].position = m->sPositions[i].xyz;
+      verts[i].normal = octEncodeNormal(m->sNormals[i]);
+      verts[i].texcoord[0] = floatToHalf(m->sTexcoords[i].u);
+      verts[i].texcoord[1] = floatToHalf(m->sTexcoords[i].v);
+      verts[i].color = packColorRGBA8(m->sColors[i]);
    }
 
    return verts;
 }
 
+static u16*
+packIndices16(const u32* indices, u64 numIndices, u32 offset, Lifetime life)
+{
+   u16* packed = AllocateArray(u16, numIndices, life);
+   for (u64 i = 0; i < numIndices; ++i) {
+      Assert(indices[i] + offset <= 0xFFFF);
+      packed[i] = (u16)(indices[i] + offset);
+   }
+   return packed;
+}
+
 MeshRenderHandle
 uploadMeshToGPU(MeshRenderVertex* sVerts, u32* sIndices, bool withMaterial, bool withBLAS)
 {
@@ -222,13 +235,19 @@ uploadMeshToGPU(MeshRenderVertex* sVerts, u32* sIndices, bool withMaterial, bool
    RenderMesh res = {};  // TODO: Store verts in intermediate heap
    res.numIndices = SBCount(sIndices);
    res.vertexBytes = SBCount(sVerts) * sizeof(MeshRenderVertex);
-   res.indexBytes = res.numIndices * sizeof(u32);
+   res.indexSize = (SBCount(sVerts) <= 0xFFFF) ? sizeof(u16) : sizeof(u32);
+   res.indexBytes = res.numIndices * res.indexSize;
 
    res.vertexBuffer = gpuCreateResource(res.vertexBytes, "Vertex Buffer", GPUHeapType_Default, ResourceState_CopyDest);
    res.indexBuffer = gpuCreateResource(res.indexBytes, "Index Buffer", GPUHeapType_Default, ResourceState_CopyDest);
 
+   u8* indices = (u8*)sIndices;
+   if (res.indexSize == sizeof(u16)) {
+      indices = packIndices16(sIndices, res.numIndices, 0, Lifetime_Frame);
+   }
+
    gpuUploadBuffer(res.vertexBuffer, (u8*)sVerts, res.vertexBytes);
-   gpuUploadBuffer(res.indexBuffer, (u8*)sIndices, res.indexBytes);
+   gpuUploadBuffer(res.indexBuffer, indices, res.indexBytes);
 
    gpuBarrierForResource(
       res.vertexBuffer,
@@ -247,17 +266,21 @@ uploadMeshToGPU(MeshRenderVertex* sVerts, u32* sIndices, bool withMaterial, bool
    h.renderMeshIdx = arrlen(r.sRenderMeshes);
    h.transformIdx = arrlen(r.sObjectTransforms);
    if (gKnobs.withRtx && withBLAS) {
-      h.blasHandle = gpuMakeBLAS(res.vertexBuffer, res.vertexBytes, sizeof(MeshRenderVertex), res.indexBuffer, res.indexBytes);
+      h.blasHandle = gpuMakeBLAS(res.vertexBuffer, res.vertexBytes, sizeof(MeshRenderVertex), res.indexBuffer, res.indexBytes, res.indexSize);
    }
+   h.numLods = 1;
+   h.lods[0] = MeshLod{ 0, res.numIndices, 0.0f };
 
+   res.refCount = 1;
    SBPush(r.sRenderMeshes, res, Lifetime_App);
    SBPush(r.sObjectTransforms, mat4Identity(), Lifetime_App);
 
    return h;
 }
 
-MeshRenderHandle
-uploadMeshesToGPU(const Mesh* meshes, sz nMeshes, bool withMaterial, bool withBLAS)
+// Buffers, BLAS, LODs and meshlets. Nothing references the buffers yet.
+static MeshRenderHandle
+uploadMeshBuffers(const Mesh* meshes, sz nMeshes, bool withBLAS)
 {
    WorldRender& r = *gWorldRender;
 
@@ -277,8 +300,20 @@ uploadMeshesToGPU(const Mesh* meshes, sz nMeshes, bool withMaterial, bool withBL
 
    res.numIndices = totalNumIndices;
 
+   // Single meshes keep their LOD chain, which follows LOD 0 in the index buffer.
+   bool withLods = (nMeshes == 1 && meshes[0].numLods > 1);
+   u64 numBufferIndices = totalNumIndices;
+   if (withLods) {
+      MeshLod last = meshes[0].lods[meshes[0].numLods - 1];
+      numBufferIndices = last.firstIndex + last.numIndices;
+   }
+
+   // 16 bit indices when the vertices fit.
+   res.indexSize = (totalNumVerts <= 0xFFFF) ? sizeof(u16) : sizeof(u32);
+   bool cookedIndices = (nMeshes == 1 && meshes[0].cookedIndices && meshes[0].cookedIndexSize == res.indexSize);
+
    res.vertexBytes = totalNumVerts * sizeof(MeshRenderVertex);
-   res.indexBytes = totalNumIndices * sizeof(u32);
+   res.indexBytes = numBufferIndices * res.indexSize;
 
    res.vertexBuffer = gpuCreateResource(res.vertexBytes, "Vertex Buffer", GPUHeapType_Default, ResourceState_CopyDest);
 
@@ -286,7 +321,7 @@ uploadMeshesToGPU(const Mesh* meshes, sz nMeshes, bool withMaterial, bool withBL
       sz offsetBytes = 0;
       for (sz mi = 0; mi < nMeshes; ++mi) {
          const Mesh* m = meshes + mi;
-         MeshRenderVertex* renderVerts = packRenderVerts(m, Lifetime_Frame);
+         MeshRenderVertex* renderVerts = m->cookedVerts ? m->cookedVerts : packRenderVerts(m, Lifetime_Frame);
          sz nBytes = m->numVerts * sizeof(MeshRenderVertex);
          gpuUploadBufferAtOffset(res.vertexBuffer, (u8*)renderVerts, nBytes, offsetBytes);
          offsetBytes += nBytes;
@@ -300,25 +335,38 @@ uploadMeshesToGPU(const Mesh* meshes, sz nMeshes, bool withMaterial, bool withBL
 
    res.indexBuffer = gpuCreateResource(res.indexBytes, "Index Buffer", GPUHeapType_Default, ResourceState_CopyDest);
 
-   u32* indices = {};
-   if (nMeshes == 1) {
-      indices = meshes[0].sIndices;
+   u8* indices = {};
+   if (cookedIndices) {
+      indices = (u8*)meshes[0].cookedIndices;
+   }
+   else if (nMeshes == 1 && res.indexSize == sizeof(u32)) {
+      indices = (u8*)meshes[0].sIndices;
    }
    else {
-      indices = AllocateArray(u32, totalNumIndices, Lifetime_Frame);
+      indices = allocateBytes(res.indexBytes, Lifetime_Frame);
       // Copy, updating indices.
       u32 idxOffset = 0;
-      u32 idxi = 0;
+      u64 byteOffset = 0;
       for (sz mi = 0; mi < nMeshes; ++mi) {
-         for (sz ii = 0; ii < meshes[mi].numIndices; ++ii) {
-            indices[idxi++] = meshes[mi].sIndices[ii] + idxOffset;
+         u64 nIndices = withLods ? numBufferIndices : meshes[mi].numIndices;
+         u64 nBytes = nIndices * res.indexSize;
+         if (res.indexSize == sizeof(u16)) {
+            u16* packed = packIndices16(meshes[mi].sIndices, nIndices, idxOffset, Lifetime_Frame);
+            memcpy(indices + byteOffset, packed, nBytes);
          }
+         else {
+            u32* merged = (u32*)(indices + byteOffset);
+            for (sz ii = 0; ii < nIndices; ++ii) {
+               merged[ii] = meshes[mi].sIndices[ii] + idxOffset;
+            }
+         }
+         byteOffset += nBytes;
          idxOffset += meshes[mi].numVerts;
       }
-      Assert (idxi == totalNumIndices);
+      Assert (byteOffset == res.indexBytes);
    }
 
-   gpuUploadBuffer(res.indexBuffer, (u8*)indices, sizeof(u32) * totalNumIndices);
+   gpuUploadBuffer(res.indexBuffer, (u8*)indices, res.indexBytes);
 
    gpuBarrierForResource(
       res.indexBuffer,
@@ -326,17 +374,69 @@ uploadMeshesToGPU(const Mesh* meshes, sz nMeshes, bool withMaterial, bool withBL
       ResourceState_IndexBuffer);
 
    MeshRenderHandle h = {};
-   if (withMaterial) {
-      h.materialHandle = makeMaterial();
-   }
    h.renderMeshIdx = arrlen(r.sRenderMeshes);
-   h.transformIdx = arrlen(r.sObjectTransforms);
    if (gKnobs.withRtx && withBLAS) {
-      h.blasHandle = gpuMakeBLAS(res.vertexBuffer, totalNumVerts, sizeof(MeshRenderVertex), res.indexBuffer, totalNumIndices);
+      h.blasHandle = gpuMakeBLAS(res.vertexBuffer, totalNumVerts, sizeof(MeshRenderVertex), res.indexBuffer, totalNumIndices, res.indexSize);
+   }
+   if (withLods) {
+      h.numLods = meshes[0].numLods;
+      memcpy(h.lods, meshes[0].lods, sizeof(h.lods));
+   }
+   else {
+      h.numLods = 1;
+      h.lods[0] = MeshLod{ 0, totalNumIndices, 0.0f };
+   }
+   if (nMeshes == 1 && meshes[0].numMeshlets) {
+      // Bounds are recomputed since the positions may have changed after loading. See scaleToBounds.
+      res.firstMeshlet = SBCount(r.sMeshlets);
+      res.numMeshlets = meshes[0].numMeshlets;
+      SBResize(r.sMeshlets, res.firstMeshlet + res.numMeshlets, Lifetime_World);
+      for (u64 i = 0; i < res.numMeshlets; ++i) {
+         Meshlet* ml = r.sMeshlets + res.firstMeshlet + i;
+         *ml = meshes[0].sMeshlets[i];
+         meshletComputeBounds(meshes, ml);
+      }
    }
-
 
    SBPush(r.sRenderMeshes, res, Lifetime_App);
+
+   return h;
+}
+
+MeshRenderHandle
+uploadMeshesToGPU(const Mesh* meshes, sz nMeshes, bool withMaterial, bool withBLAS)
+{
+   MeshRenderHandle out = instanceMeshOnGPU(uploadMeshBuffers(meshes, nMeshes, withBLAS), withMaterial);
+
+   return out;
+}
+
+MeshRenderHandle
+uploadSharedMeshToGPU(const Mesh& m, bool withBLAS)
+{
+   WorldRender& r = *gWorldRender;
+
+   MeshRenderHandle h = uploadMeshBuffers(&m, 1, withBLAS);
+   r.sRenderMeshes[h.renderMeshIdx].refCount++;
+
+   return h;
+}
+
+MeshRenderHandle
+instanceMeshOnGPU(MeshRenderHandle shared, bool withMaterial)
+{
+   WorldRender& r = *gWorldRender;
+
+   MeshRenderHandle h = shared;
+   h.materialHandle = {};
+   h.sShadowResources = nullptr;
+
+   r.sRenderMeshes[h.renderMeshIdx].refCount++;
+
+   if (withMaterial) {
+      h.materialHandle = makeMaterial();
+   }
+   h.transformIdx = arrlen(r.sObjectTransforms);
    SBPush(r.sObjectTransforms, mat4Identity(), Lifetime_App);
 
    // Allocation is a bottleneck when recording commands for shadow maps.
@@ -377,11 +477,94 @@ setMeshForDraw(MeshRenderHandle rh)
 
    RenderMesh& rm = r.sRenderMeshes[rh.renderMeshIdx];
 
-   gpuSetVertexAndIndexBuffers(rm.vertexBuffer, rm.vertexBytes, rm.indexBuffer, rm.indexBytes);
+   gpuSetVertexAndIndexBuffers(rm.vertexBuffer, rm.vertexBytes, rm.indexBuffer, rm.indexBytes, rm.indexSize);
 
    return rm.numIndices;
 }
 
+// Picks the coarsest LOD whose error, projected at the object's distance,
+// stays under gKnobs.lodPixelError. The shadow pass calls it with the light
+// position and the shadow map resolution.
+MeshLod
+selectMeshLod(MeshRenderHandle rh, ObjectHandle h, vec3 eye, float fov, float viewportHeight)
+{
+   WorldRender& r = *gWorldRender;
+
+   AABB bounds = getWorld()->boundingBoxes[h.idx];
+   mat4 transform = r.sObjectTransforms[rh.transformIdx];
+
+   vec3 center = 0.5f * (bounds.min + bounds.max);
+   vec3 worldCenter = (transform * Vec4(center.x, center.y, center.z, 1.0f)).xyz;
+   float scale = Max(length(transform[0].xyz), Max(length(transform[1].xyz), length(transform[2].xyz)));
+   float extent = length(bounds.max - bounds.min) * scale;
+
+   u32 lodIdx = 0;
+   float distance = length(worldCenter - eye) - 0.5f * extent;
+   if (distance > 0) {
+      float pixelsPerUnit = viewportHeight / (2.0f * tan(fov / 2.0f) * distance);
+      for (u32 i = 1; i < rh.numLods; ++i) {
+         if (rh.lods[i].error * extent * pixelsPerUnit <= gKnobs.lodPixelError) {
+            lodIdx = i;
+         }
+      }
+   }
+
+   return rh.lods[lodIdx];
+}
+
+// Draws the meshlets of an object that pass frustum and backface cone
+// culling. Neighbors that are both visible go in the same draw. Coarser LODs
+// have no meshlets, so they are drawn whole if any meshlet is in the frustum.
+static void
+drawMeshCulled(MeshRenderHandle rh, MeshLod lod, const mat4& viewProjection, vec3 eye, bool cullBackfaces)
+{
+   WorldRender& r = *gWorldRender;
+
+   RenderMesh& rm = r.sRenderMeshes[rh.renderMeshIdx];
+   Meshlet* meshlets = r.sMeshlets + rm.firstMeshlet;
+
+   if (!gKnobs.useMeshletCulling || !rm.numMeshlets) {
+      gpuDrawIndexed(lod.numIndices, lod.firstIndex);
+   }
+   else {
+      mat4 transform = r.sObjectTransforms[rh.transformIdx];
+      Frustum frustum = frustumFromMatrix(viewProjection * transform);
+      vec3 objectEye = (mat4Inverse(transform) * toVec4(eye, 1.0f)).xyz;
+
+      if (lod.firstIndex != 0) {
+         bool visible = false;
+         for (u64 i = 0; !visible && i < rm.numMeshlets; ++i) {
+            visible = meshletIsVisible(meshlets + i, &frustum, objectEye, false);
+         }
+         if (visible) {
+            gpuDrawIndexed(lod.numIndices, lod.firstIndex);
+         }
+      }
+      else {
+         u64 runFirst = 0;
+         u64 runCount = 0;
+         for (u64 i = 0; i < rm.numMeshlets; ++i) {
+            Meshlet* ml = meshlets + i;
+            if (meshletIsVisible(ml, &frustum, objectEye, cullBackfaces)) {
+               if (runCount && runFirst + runCount == ml->firstIndex) {
+                  runCount += ml->numTris * 3;
+               }
+               else {
+                  if (runCount) {
+                     gpuDrawIndexed(runCount, runFirst);
+                  }
+                  runFirst = ml->firstIndex;
+                  runCount = ml->numTris * 3;
+               }
+            }
+         }
+         if (runCount) {
+            gpuDrawIndexed(runCount, runFirst);
+         }
+      }
+   }
+}
+
 BlobRenderHandle
 uploadBlobToGPU(const Blob& b)
 {
@@ -431,16 +614,20 @@ gpuMarkFreeRenderMesh(MeshRenderHandle* h, u64 atFrame)
 
    RenderMesh& m = r.sRenderMeshes[h->renderMeshIdx];
 
-   if (h->blasHandle.idx) {
-      gpuMarkFreeBLAS(h->blasHandle, atFrame);
-   }
    for (int i = 0; i < arrlen(h->sShadowResources); ++i) {
       ResourceHandle shadowRes = h->sShadowResources[i];
       gpuMarkFreeResource(shadowRes, atFrame);
    }
 
-   gpuMarkFreeResource(m.vertexBuffer, atFrame);
-   gpuMarkFreeResource(m.indexBuffer, atFrame);
+   // The buffers and the BLAS go with the last handle that shares them.
+   Assert(m.refCount > 0);
+   if (--m.refCount == 0) {
+      if (h->blasHandle.idx) {
+         gpuMarkFreeBLAS(h->blasHandle, atFrame);
+      }
+      gpuMarkFreeResource(m.vertexBuffer, atFrame);
+      gpuMarkFreeResource(m.indexBuffer, atFrame);
+   }
 }
 
 void
@@ -599,6 +786,13 @@ wrDispose()
    gpuMarkFreeDepthTarget(wr->shadowDepth, gpu()->frameCount);
 }
 
+void
+wrDisposeWorld()
+{
+   // The render meshes that point into them were released with the world's objects.
+   gWorldRender->sMeshlets = NULL;
+}
+
 Material*
 materialForObject(ObjectHandle h)
 {
@@ -634,6 +828,8 @@ shouldDoRaytracing()
 void
 renderWorld()
 {
+   ProfileZone("renderWorld");
+
    WorldRender* wr = gWorldRender;
 
    if (gKnobs.useMultisampling) {
@@ -767,8 +963,10 @@ renderWorld()
                   gpuSetResourceData(cbRes, &cb, sizeof(cb));
                   gpuSetGraphicsConstantSlot(0, cbRes);
 
-                  u64 numIndices = setMeshForDraw(rh);
-                  gpuDrawIndexed(numIndices);
+                  setMeshForDraw(rh);
+                  MeshLod lod = selectMeshLod(rh, h, lc.eye, lc.fov, gKnobs.shadowResolution);
+                  // The shadow PSO doesn't cull, so neither do we.
+                  drawMeshCulled(rh, lod, viewProj, lc.eye, /*cullBackfaces*/false);
                }
                objectIterateEnd(iter);
                gpuEndMarker();  // Face marker
@@ -819,7 +1017,8 @@ renderWorld()
             }
 
             // Set-up mesh.
-            u64 numIndices = setMeshForDraw(rh);
+            setMeshForDraw(rh);
+            MeshLod lod = selectMeshLod(rh, h, cam->eye, cam->fov, gpu()->fbHeight);
 
             // Set constant buffer
             MaterialConstantsCB& buffer = m->constants;
@@ -839,7 +1038,8 @@ renderWorld()
 
             gpuSetGraphicsConstantSlot(1, m->gpuResource);
 
-            gpuDrawIndexed(numIndices);
+            bool cullBackfaces = !(m->psoFlags & PSOFlags_NoCull);
+            drawMeshCulled(rh, lod, viewProjection, cam->eye, cullBackfaces);
          }
       }
       objectIterateEnd(iter);
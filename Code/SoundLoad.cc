@@ -1,47 +1,156 @@
 
-LoadedSound
-mp3Load(Platform* plat, char* pathToMp3, Lifetime life)
+// Sounds that decode to more than gKnobs.streamSoundsAboveBytes keep the mp3
+// instead, and are decoded a chunk at a time while they play. See playSound.
+//
+// mp3LoadBatch decodes the others on the worker threads, one job per segment.
+// Segments start at a sample offset through minimp3_ex seeking, which decodes
+// a couple of frames before the offset to fill the bit reservoir and the
+// overlap, so the samples are the same as a decode from the start.
+
+struct Mp3Source
+{
+   LoadedSound sound;  // samples is allocated but not decoded yet.
+   u8* bytes;
+   u64 numBytes;
+   u64 numSamples;  // Every channel
+};
+
+static Mp3Source
+mp3Prepare(Platform* plat, char* pathToMp3, Lifetime life)
 {
    mp3dec_ex_t dec = {};
 
-   LoadedSound sound = {};
+   Mp3Source src = {};
+   LoadedSound& sound = src.sound;
 
-   u8* bytes = {};
-   u64 numBytes = plat->fileContentsAscii(pathToMp3, bytes, Lifetime_Frame);
+   src.numBytes = assetFileContents(plat, pathToMp3, src.bytes, Lifetime_Frame);
 
-   if (!bytes) {
+   if (!src.bytes) {
       logMsg("Could not load mp3!\n");
    }
+   else if (mp3dec_ex_open_buf(&dec, src.bytes, src.numBytes, MP3D_SEEK_TO_SAMPLE))
+   {
+      logMsg("Could not open mp3 file %s\n", pathToMp3);
+   }
    else {
+      sound.hz = dec.info.hz;
+      sound.channels = dec.info.channels;
+      sound.numBytes = dec.samples * sizeof(i16);  // dec.samples counts every channel.
 
+      if (sound.numBytes > gKnobs.streamSoundsAboveBytes) {
+         // A packed mp3 is used in place. Otherwise it needs to outlive the frame.
+         u64 packedBytes = 0;
+         sound.mp3 = assetPackView(pathToMp3, &packedBytes);
+         sound.mp3Bytes = src.numBytes;
+         if (!sound.mp3) {
+            sound.mp3 = allocateBytes(src.numBytes, life);
+            memcpy(sound.mp3, src.bytes, src.numBytes);
+         }
+         logMsg("Streaming %s: keeping %lld bytes of mp3 instead of %d bytes of samples\n", pathToMp3, src.numBytes, sound.numBytes);
+      }
+      else {
+         src.numSamples = dec.samples;
+         sound.samples = AllocateArray(i16, src.numSamples, life);
+      }
    }
-   if (mp3dec_ex_open_buf(&dec, bytes, numBytes, MP3D_SEEK_TO_SAMPLE))
-   {
-      logMsg("Could not open mp3 file %s\n", pathToMp3);
+   mp3dec_ex_close(&dec);
+
+   return src;
+}
+
+// Returns the number of samples decoded.
+static u64
+mp3DecodeRange(u8* mp3, u64 mp3Bytes, i16* out, u64 firstSample, u64 numSamples)
+{
+   mp3dec_ex_t dec = {};
+
+   u64 decoded = 0;
+   if (mp3dec_ex_open_buf(&dec, mp3, mp3Bytes, MP3D_SEEK_TO_SAMPLE) || mp3dec_ex_seek(&dec, firstSample)) {
+      logMsg("Error seeking to sample %lld of mp3\n", firstSample);
+   }
+   else {
+      while (decoded < numSamples) {
+         size_t read = mp3dec_ex_read(&dec, out + decoded, numSamples - decoded);
+         if (!read) {
+            break;
+         }
+         decoded += read;
+      }
    }
+   mp3dec_ex_close(&dec);
 
-   if (mp3dec_ex_seek(&dec, 0))
-   {
-      logMsg("Error seeking to start of mp3 %s\n", pathToMp3);
+   return decoded;
+}
+
+LoadedSound
+mp3Load(Platform* plat, char* pathToMp3, Lifetime life)
+{
+   ProfileZone("mp3Load");
+
+   Mp3Source src = mp3Prepare(plat, pathToMp3, life);
+
+   if (src.sound.samples) {
+      u64 decoded = mp3DecodeRange(src.bytes, src.numBytes, src.sound.samples, 0, src.numSamples);
+      src.sound.numBytes = decoded * sizeof(i16);
    }
 
-   sound.hz = dec.info.hz;
-   sound.channels = dec.info.channels;
-   sound.numBytes = sound.channels * dec.samples * sizeof(i16);
+   return src.sound;
+}
 
-   pushApiLifetime(life);
-   {
-      arrsetcap(sound.samples, dec.samples);
+struct Mp3Segment
+{
+   Mp3Source* src;
+   u64 firstSample;
+   u64 numSamples;
+   u64 decoded;
+};
 
-      size_t remaining = dec.samples;
-      while (true) {
-          remaining -= mp3dec_ex_read(&dec, sound.samples, remaining);
-          if (!remaining) { break; }
+PlatformWorkProcDef(mp3DecodeSegmentProc)
+{
+   // Doesn't allocate; the samples go into the sound's buffer.
+   Mp3Segment* seg = (Mp3Segment*)data;
+   seg->decoded = mp3DecodeRange(seg->src->bytes, seg->src->numBytes, seg->src->sound.samples + seg->firstSample, seg->firstSample, seg->numSamples);
+}
+
+void
+mp3LoadBatch(Platform* plat, char** paths, LoadedSound* outSounds, u64 numSounds, Lifetime life, u64 segmentSamples)
+{
+   Mp3Source* sources = AllocateArray(Mp3Source, numSounds, Lifetime_Frame);
+   Mp3Segment* sSegments = nullptr;
+
+   // Reading and allocating stays on this thread.
+   for (u64 si = 0; si < numSounds; ++si) {
+      Mp3Source* src = sources + si;
+      *src = mp3Prepare(plat, paths[si], life);
+
+      if (src->sound.samples) {
+         // Whole frames of every channel per segment, and no more segments than threads.
+         u64 channels = Max(src->sound.channels, 1);
+         u64 numSegments = Min(Max(src->numSamples / segmentSamples, 1), plat->numWorkerThreads + 1);
+         u64 perSegment = (src->numSamples + numSegments - 1) / numSegments;
+         perSegment += (channels - perSegment % channels) % channels;
+
+         for (u64 first = 0; first < src->numSamples; first += perSegment) {
+            Mp3Segment seg = {};
+            seg.src = src;
+            seg.firstSample = first;
+            seg.numSamples = Min(perSegment, src->numSamples - first);
+            SBPush(sSegments, seg, Lifetime_Frame);
+         }
       }
-      logMsg("Done reading\n");
    }
-   popApiLifetime();
 
+   runJobs(plat, mp3DecodeSegmentProc, sSegments, sizeof(*sSegments), SBCount(sSegments));
 
-   return sound;
-}
\ No newline at end of file
+   // A segment that comes up short ends the sound there.
+   for (u64 si = 0; si < numSounds; ++si) {
+      outSounds[si] = sources[si].sound;
+   }
+   for (u64 segIdx = 0; segIdx < SBCount(sSegments); ++segIdx) {
+      Mp3Segment* seg = sSegments + segIdx;
+      if (seg->decoded < seg->numSamples) {
+         u64 si = seg->src - sources;
+         outSounds[si].numBytes = Min(outSounds[si].numBytes, (seg->firstSample + seg->decoded) * sizeof(i16));
+      }
+   }
+}
@@ -50,6 +50,7 @@ defaultTestLightingAndCam()
 #include "Tests/SingleText.cc"
 #include "Tests/Bunny.cc"
 #include "Tests/PointLight.cc"
+#include "Tests/AudioStress.cc"
 
 #include "Tests/UnitTests.cc"
 
@@ -85,7 +86,7 @@ testsInit(Platform* plat)
    Tests->plat = plat;
 
    // TODO: Init argument to run unit tests?
-   runUnitTests();
+   runUnitTests(plat);
 
    runTestRegistration();
 }
@@ -0,0 +1,70 @@
+// Game thread and mixing thread hammering the audio queues at once.
+// testAudioThreads runs it on the work queue and AudioThreadsTSan.cc on
+// pthreads under ThreadSanitizer, so both run the same code.
+
+struct AudioStressTest
+{
+   AudioMixer* mixer;
+   LoadedSound* sound;
+   LoadedSound gameSound;  // Reassigned while its plays are queued, as gameInit does.
+   AudioRing ring;
+   u32 numFrames;  // Through the ring
+
+   volatile u32 producerDone;
+   bool ringInOrder;
+   u32 numCommands;
+};
+
+// Game thread side: commands into the mixer, numbered frames into the ring.
+PlatformWorkProcDef(audioStressProducer)
+{
+   AudioStressTest* t = (AudioStressTest*)data;
+
+   i16 frames[2 * 333];
+   u32 written = 0;
+   while (written < t->numFrames) {
+      u32 n = Min((u32)ArrayCount(frames) / 2, t->numFrames - written);
+      for (u32 i = 0; i < n; ++i) {
+         frames[i * 2 + 0] = (i16)(written + i);
+         frames[i * 2 + 1] = (i16)~(written + i);
+      }
+      written += audioRingWrite(&t->ring, frames, n);
+
+      t->gameSound = *t->sound;
+      SoundId id = audioMixerPlay(t->mixer, &t->gameSound, 0.5f, 0.0f);
+      audioMixerSetParams(t->mixer, id, 0.25f, -0.5f);
+      audioMixerStop(t->mixer, id);
+      audioMixerPlay(t->mixer, &t->gameSound, 0.5f, 0.0f);
+      t->numCommands += 4;
+   }
+
+   // As before freeing world memory. The consumer mixes until producerDone.
+   while (!audioMixerStopAll(t->mixer)) {}
+   while (!audioMixerStoppedAll(t->mixer)) {}
+   t->numCommands++;
+   storeRelease(&t->producerDone, 1);
+}
+
+// Mixing thread side.
+PlatformWorkProcDef(audioStressConsumer)
+{
+   AudioStressTest* t = (AudioStressTest*)data;
+
+   i16 frames[2 * 257];
+   u32 read = 0;
+   t->ringInOrder = true;
+   while (read < t->numFrames) {
+      u32 n = audioRingRead(&t->ring, frames, ArrayCount(frames) / 2);
+      for (u32 i = 0; i < n; ++i) {
+         t->ringInOrder &= frames[i * 2 + 0] == (i16)(read + i) && frames[i * 2 + 1] == (i16)~(read + i);
+      }
+      read += n;
+
+      i16 block[2 * 64];
+      audioMixerRender(t->mixer, block, ArrayCount(block) / 2);
+   }
+   while (!loadAcquire(&t->producerDone)) {
+      i16 block[2 * 64];
+      audioMixerRender(t->mixer, block, ArrayCount(block) / 2);
+   }
+}
@@ -0,0 +1,151 @@
+// testAudioThreads under ThreadSanitizer.
+//
+// The engine only builds with MSVC, which has no TSan, so this runs the real
+// AudioMixer.cc and AudioStress.cc on pthreads, with just enough of Engine.h
+// for them. From the repository root:
+//
+//    g++ -std=c++17 -O1 -g -fsanitize=thread Code/Tests/AudioThreadsTSan.cc -o audio_tsan -lpthread && ./audio_tsan
+//
+// It should print no warnings. Add -DPlainAudioHelpers to turn loadAcquire
+// and storeRelease into plain accesses; TSan then reports the races on the
+// ring and command queue cursors.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <xmmintrin.h>
+
+#define MINIMP3_IMPLEMENTATION
+#include "../../3rd/minimp3.h"
+#include "../../3rd/minimp3_ex.h"
+
+// Engine.h, the parts the mixer uses.
+
+typedef uint8_t u8;
+typedef int16_t i16;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef int64_t i64;
+typedef uint64_t u64;
+
+#define Min(a, b) ((a) < (b) ? (a) : (b))
+#define Max(a, b) ((a) > (b) ? (a) : (b))
+#define ArrayCount(arr) (sizeof(arr) / sizeof(*(arr)))
+#define Pi 3.14159265358979f
+#define Assert(expr) if (!(expr)) { printf("Assert failed: " #expr "\n"); abort(); }
+#define logMsg printf
+
+#if defined(PlainAudioHelpers)
+   inline u32 loadAcquire(volatile u32* p) { return *p; }
+   inline void storeRelease(volatile u32* p, u32 v) { *p = v; }
+#else
+   inline u32 loadAcquire(volatile u32* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+   inline void storeRelease(volatile u32* p, u32 v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+#endif
+
+enum Lifetime { Lifetime_App, Lifetime_Frame };
+
+static struct EngineKnobs
+{
+   static const u32 mixerChannels = 32;
+   static const int mixerRate = 44100;
+   static const u32 mixerBlockFrames = 1024;
+   static const u32 audioCommandQueueSize = 256;
+   static const u32 mixerMaxAudible = 16;
+   static constexpr float audioMinGain = 0.001f;
+   static constexpr float audioRefDistance = 6.0f;
+} gKnobs;
+
+u8* allocateBytes(u64 numBytes, Lifetime) { return (u8*)calloc(1, numBytes); }
+#define AllocateArray(type, count, life) (type*)allocateBytes(sizeof(type) * (count), life)
+#define AllocateElem(type, life) (type*)allocateBytes(sizeof(type), life)
+
+struct vec3 { float x, y, z; };
+vec3 operator-(vec3 a, vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+vec3 operator*(vec3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+float dot(vec3 a, vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+float length(vec3 a) { return sqrtf(dot(a, a)); }
+vec3 cross(vec3 a, vec3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+vec3 normalizedOrZero(vec3 a) { float l = length(a); return l > 0 ? a * (1 / l) : vec3{}; }
+float clamp(float v, float lo, float hi) { return v < lo ? lo : (v > hi ? hi : v); }
+
+struct Camera { float near, far, fov; vec3 lookat, eye, up; };
+
+typedef u32 SoundId;
+
+struct LoadedSound
+{
+   i16* samples;
+   int hz;
+   int channels;
+   int numBytes;
+   u8* mp3;
+   u64 mp3Bytes;
+};
+
+struct AudioRing
+{
+   i16* frames;
+   u32 numFrames;
+   volatile u32 writeCursor;
+   volatile u32 readCursor;
+};
+
+struct Platform
+{
+   bool (*writeFileAscii)(char* fname, u8* data, u64 numBytes);
+};
+
+#define PlatformWorkProcDef(name) void name(void* data)
+
+#include "../AudioMixer.cc"
+#include "AudioStress.cc"
+
+static void*
+threadProc(void* arg)
+{
+   void** job = (void**)arg;
+   ((void (*)(void*))job[0])(job[1]);
+   return NULL;
+}
+
+int
+main()
+{
+   LoadedSound swing = {};
+   {
+      mp3dec_t mp3d;
+      mp3dec_file_info_t info = {};
+      if (mp3dec_load(&mp3d, "JamAssets/Swing.mp3", &info, NULL, NULL)) {
+         printf("Run from the repository root; JamAssets/Swing.mp3 not found.\n");
+         return 1;
+      }
+      swing.samples = info.buffer;
+      swing.hz = info.hz;
+      swing.channels = info.channels;
+      swing.numBytes = (int)(info.samples * sizeof(i16));
+   }
+
+   // Same setup as testAudioThreads.
+   AudioStressTest* t = AllocateElem(AudioStressTest, Lifetime_Frame);
+   t->mixer = audioMixerCreate(Lifetime_Frame);
+   t->ring = audioRingCreate(1024, Lifetime_Frame);
+   t->numFrames = 1 << 20;
+   t->sound = &swing;
+
+   void* producer[] = { (void*)audioStressProducer, t };
+   void* consumer[] = { (void*)audioStressConsumer, t };
+   pthread_t threads[2];
+   pthread_create(threads + 0, NULL, threadProc, producer);
+   pthread_create(threads + 1, NULL, threadProc, consumer);
+   pthread_join(threads[0], NULL);
+   pthread_join(threads[1], NULL);
+
+   bool ok = t->ringInOrder && t->numCommands > 0;
+   printf("%s: %u frames through the ring, %u commands\n", ok ? "Passed" : "FAILED", t->numFrames, t->numCommands);
+   return ok ? 0 : 1;
+}
@@ -48,9 +48,1074 @@ testAlignOpts()
    // MSVC from VS 2019 on /O2 does emit better code with the first one.
 }
 
+static bool
+meshesAreEqual(Mesh& a, Mesh& b)
+{
+   bool equal = a.numVerts == b.numVerts && a.numIndices == b.numIndices;
+   if (equal) {
+      equal = !memcmp(a.sPositions, b.sPositions, sizeof(*a.sPositions) * a.numVerts) &&
+              !memcmp(a.sNormals, b.sNormals, sizeof(*a.sNormals) * a.numVerts) &&
+              !memcmp(a.sTexcoords, b.sTexcoords, sizeof(*a.sTexcoords) * a.numVerts) &&
+              !memcmp(a.sColors, b.sColors, sizeof(*a.sColors) * a.numVerts) &&
+              !memcmp(a.sIndices, b.sIndices, sizeof(*a.sIndices) * a.numIndices);
+   }
+   return equal;
+}
+
+void
+testObjLoadThreads(Platform* plat)
+{
+   // Loading with any number of threads must give exactly the same mesh as the single-threaded load.
+   char* paths[] = {
+      AssetPath(plat, "UnitCube.obj"),
+      AssetPath(plat, "Hound.obj"),
+      AssetPath(plat, "UnitSphere.obj"),
+   };
+
+   for (int pathIdx = 0; pathIdx < ArrayCount(paths); ++pathIdx) {
+      u8* data = nullptr;
+      u64 numBytes = plat->fileContentsAscii(paths[pathIdx], data, Lifetime_Frame);
+
+      u64 begin = plat->getMicroseconds();
+      Mesh reference = objLoadFromBytes(plat, data, numBytes, Lifetime_Frame, 1);
+      u64 referenceUs = plat->getMicroseconds() - begin;
+
+      IsTrue (reference.numVerts > 0 && reference.numIndices > 0);
+
+      for (u32 numThreads = 2; numThreads <= plat->numWorkerThreads + 1; ++numThreads) {
+         begin = plat->getMicroseconds();
+         Mesh mesh = objLoadFromBytes(plat, data, numBytes, Lifetime_Frame, numThreads);
+         u64 us = plat->getMicroseconds() - begin;
+
+         IsTrue (meshesAreEqual(reference, mesh));
+
+         logMsg("objLoad %s: %d threads %llu us (1 thread %llu us)\n", paths[pathIdx], numThreads, us, referenceUs);
+      }
+   }
+}
+
+// Cooked meshes come back through MeshRenderVertex, so only positions and indices are exact.
+static bool
+meshesAreClose(Mesh& a, Mesh& b)
+{
+   bool close = a.numVerts == b.numVerts && a.numIndices == b.numIndices;
+   if (close) {
+      close = !memcmp(a.sPositions, b.sPositions, sizeof(*a.sPositions) * a.numVerts) &&
+              !memcmp(a.sIndices, b.sIndices, sizeof(*a.sIndices) * a.numIndices);
+   }
+   for (u64 i = 0; close && i < a.numVerts; ++i) {
+      vec3 n = normalizedOrZero(a.sNormals[i]);
+      close = (length(n) == 0 || dot(n, b.sNormals[i]) > 0.9999f) &&
+              Abs(a.sTexcoords[i].u - b.sTexcoords[i].u) <= Abs(a.sTexcoords[i].u) / 2048.0f + 1e-7f &&
+              Abs(a.sTexcoords[i].v - b.sTexcoords[i].v) <= Abs(a.sTexcoords[i].v) / 2048.0f + 1e-7f;
+      for (int c = 0; close && c < 4; ++c) {
+         close = Abs(a.sColors[i][c] - b.sColors[i][c]) <= 1.0f / 500.0f;
+      }
+   }
+   return close;
+}
+
+void
+testVertexCompression()
+{
+   // Octahedral normals: axes are exact, everything else within ~0.004 degrees.
+   {
+      vec3 axes[] = { {1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1} };
+      for (int i = 0; i < ArrayCount(axes); ++i) {
+         vec3 n = octDecodeNormal(octEncodeNormal(axes[i]));
+         IsTrue (n.x == axes[i].x && n.y == axes[i].y && n.z == axes[i].z);
+      }
+
+      float minDot = 1.0f;
+      u32 seed = 1;
+      for (int i = 0; i < 100000; ++i) {
+         vec3 r = {};
+         for (int c = 0; c < 3; ++c) {
+            seed = seed * 1664525u + 1013904223u;
+            r[c] = (seed >> 8) / float(1 << 24) * 2.0f - 1.0f;
+         }
+         vec3 n = normalizedOrZero(r);
+         if (length(n) > 0) {
+            minDot = Min(minDot, dot(n, octDecodeNormal(octEncodeNormal(n))));
+         }
+      }
+      IsTrue (minDot > 0.99999f);
+   }
+
+   // Halves round trip within 2^-11 and keep texel corners of a 2048 atlas exact.
+   {
+      IsTrue (floatToHalf(1.0f) == 0x3c00);
+      IsTrue (floatToHalf(-2.0f) == 0xc000);
+      IsTrue (floatToHalf(65504.0f) == 0x7bff);
+      IsTrue (floatToHalf(1e6f) == 0x7c00);
+      for (int t = 0; t <= 2048; ++t) {
+         float f = t / 2048.0f;
+         IsTrue (halfToFloat(floatToHalf(f)) == f);
+      }
+      for (float f = 0.001f; f < 1000.0f; f *= 1.37f) {
+         IsTrue (Abs(halfToFloat(floatToHalf(f)) - f) <= f / 2048.0f);
+      }
+   }
+
+   // RGBA8
+   {
+      vec4 c = { 1.0f, 0.5f, 0.0f, 0.25f };
+      u32 packed = packColorRGBA8(c);
+      IsTrue ((packed & 0xff) == 0xff && (packed >> 24) == 64);
+      vec4 d = unpackColorRGBA8(packed);
+      for (int i = 0; i < 4; ++i) {
+         IsTrue (Abs(c[i] - d[i]) <= 1.0f / 510.0f);
+      }
+   }
+}
+
+void
+testMeshCache(Platform* plat)
+{
+   // The first load may cook the mesh, the second must come from the cache. Both must match a plain load.
+   char* path = AssetPath(plat, "Hound.obj");
+
+   Mesh reference = objLoad(plat, path, Lifetime_Frame);
+   if (gKnobs.useMeshCache && gKnobs.optimizeMeshes) {
+      meshOptimize(&reference);
+   }
+   if (gKnobs.useMeshCache && gKnobs.buildMeshlets) {
+      meshBuildMeshlets(&reference, Lifetime_Frame);
+   }
+   Mesh first = objLoadCached(plat, path, Lifetime_Frame);
+   Mesh second = objLoadCached(plat, path, Lifetime_Frame);
+
+   IsTrue (meshesAreClose(reference, first));
+   IsTrue (meshesAreClose(reference, second));
+   IsTrue (second.numMeshlets == reference.numMeshlets);
+   IsTrue (!gKnobs.useMeshCache || second.cookedVerts != nullptr);
+   if (second.cookedVerts) {
+      MeshRenderVertex* packed = packRenderVerts(&reference, Lifetime_Frame);
+      IsTrue (!memcmp(packed, second.cookedVerts, sizeof(MeshRenderVertex) * reference.numVerts));
+   }
+
+   // Once unmapped, the loose cooked file can be rewritten, as when its source changes.
+   meshUnmapCooked(plat, &first);
+   meshUnmapCooked(plat, &second);
+   IsTrue (!second.cookedMapping);
+   if (gKnobs.useMeshCache) {
+      char cookedPath[MaxPath] = {};
+      snprintf(cookedPath, ArrayCount(cookedPath), "%s.cooked", path);
+      u8* cooked = nullptr;
+      u64 cookedBytes = plat->fileContentsAscii(cookedPath, cooked, Lifetime_Frame);
+      IsTrue (!cookedBytes || plat->writeFileAscii(cookedPath, cooked, cookedBytes));  // None when the pack has it.
+   }
+}
+
+void
+testVertexCacheOptimization(Platform* plat)
+{
+   // FIFO simulation on known cases.
+   {
+      u32 tri[] = { 0,1,2 };
+      VertexCacheStats s = meshVertexCacheStats(tri, 3, 3, 16);
+      IsTrue (s.acmr == 3.0f && s.atvr == 1.0f);
+
+      u32 quad[] = { 0,1,2, 2,3,0 };
+      s = meshVertexCacheStats(quad, 6, 4, 16);
+      IsTrue (s.acmr == 2.0f && s.atvr == 1.0f);
+
+      // Cache of 3. Vertex 3 evicts 0, then 0 evicts 1 and 1 evicts 2.
+      u32 evict[] = { 0,1,2, 1,2,3, 0,1,2 };
+      s = meshVertexCacheStats(evict, 9, 4, 3);
+      IsTrue (s.acmr == 7.0f / 3.0f);
+   }
+
+   char* paths[] = {
+      AssetPath(plat, "Tree.obj"),
+      AssetPath(plat, "Hound.obj"),
+      AssetPath(plat, "UnitSphere.obj"),
+   };
+
+   for (int pathIdx = 0; pathIdx < ArrayCount(paths); ++pathIdx) {
+      Mesh m = objLoad(plat, paths[pathIdx], Lifetime_Frame);
+      u64 numTris = m.numIndices / 3;
+
+      VertexCacheStats before = meshVertexCacheStats(m.sIndices, m.numIndices, m.numVerts, gKnobs.vertexCacheSize);
+      meshOptimize(&m);
+      VertexCacheStats after = meshVertexCacheStats(m.sIndices, m.numIndices, m.numVerts, gKnobs.vertexCacheSize);
+
+      IsTrue (m.numIndices == numTris * 3);
+      IsTrue (after.acmr <= before.acmr);
+
+      // Vertices are in order of first use.
+      u32 maxSeen = 0;
+      bool inOrder = true;
+      for (u64 i = 0; i < m.numIndices; ++i) {
+         if (m.sIndices[i] > maxSeen + (i > 0)) {
+            inOrder = false;
+         }
+         maxSeen = Max(maxSeen, m.sIndices[i]);
+      }
+      IsTrue (inOrder && maxSeen + 1 == m.numVerts);
+
+      logMsg("meshOptimize %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", paths[pathIdx], before.acmr, after.acmr, before.atvr, after.atvr);
+   }
+}
+
+void
+testMeshSimplify(Platform* plat)
+{
+   // A flat grid goes down to two triangles without error. Borders and corners stay.
+   {
+      const int n = 5;
+      Mesh grid = {};
+      for (int y = 0; y < n; ++y) {
+         for (int x = 0; x < n; ++x) {
+            SBPush(grid.sPositions, Vec4(x, y, 0, 1), Lifetime_Frame);
+            SBPush(grid.sNormals, Vec3(0, 0, -1), Lifetime_Frame);
+            SBPush(grid.sTexcoords, Vec2(x / float(n - 1), y / float(n - 1)), Lifetime_Frame);
+            SBPush(grid.sColors, Vec4(1, 1, 1, 1), Lifetime_Frame);
+         }
+      }
+      for (int y = 0; y < n - 1; ++y) {
+         for (int x = 0; x < n - 1; ++x) {
+            u32 a = y * n + x;
+            u32 quad[] = { a, a + n, a + 1, a + 1, a + n, a + n + 1 };
+            for (u32 i : quad) {
+               SBPush(grid.sIndices, i, Lifetime_Frame);
+            }
+         }
+      }
+      grid.numVerts = SBCount(grid.sPositions);
+      grid.numIndices = SBCount(grid.sIndices);
+
+      u32* out = AllocateArray(u32, grid.numIndices, Lifetime_Frame);
+      float error = -1;
+      u64 numIndices = meshSimplify(&grid, grid.sIndices, grid.numIndices, 0, 0.001f, out, &error);
+      IsTrue (numIndices == 6 && error == 0);
+   }
+
+   char* paths[] = {
+      AssetPath(plat, "Tree.obj"),
+      AssetPath(plat, "Hound.obj"),
+      AssetPath(plat, "UnitSphere.obj"),
+   };
+
+   for (int pathIdx = 0; pathIdx < ArrayCount(paths); ++pathIdx) {
+      Mesh m = objLoad(plat, paths[pathIdx], Lifetime_Frame);
+      meshOptimize(&m);
+      meshBuildLods(&m, Lifetime_Frame);
+
+      IsTrue (m.numLods > 1);
+      IsTrue (m.lods[0].firstIndex == 0 && m.lods[0].numIndices == m.numIndices);
+      for (u32 li = 0; li < m.numLods; ++li) {
+         MeshLod lod = m.lods[li];
+         if (li > 0) {
+            MeshLod prev = m.lods[li - 1];
+            IsTrue (lod.firstIndex == prev.firstIndex + prev.numIndices);
+            IsTrue (lod.numIndices < prev.numIndices && lod.error >= prev.error);
+         }
+         IsTrue (lod.numIndices % 3 == 0 && lod.error <= gKnobs.lodMaxError);
+
+         bool valid = true;
+         for (u64 i = 0; i < lod.numIndices; ++i) {
+            valid = valid && m.sIndices[lod.firstIndex + i] < m.numVerts;
+         }
+         IsTrue (valid);
+
+         logMsg("LOD %d of %s: %lld triangles, error %.4f\n", li, paths[pathIdx], lod.numIndices / 3, lod.error);
+      }
+   }
+}
+
+void
+testMeshletCulling(Platform* plat)
+{
+   Mesh m = objLoad(plat, AssetPath(plat, "UnitSphere.obj"), Lifetime_Frame);
+   meshOptimize(&m);
+   meshBuildMeshlets(&m, Lifetime_Frame);
+
+   // The meshlets cover LOD 0 in order and stay within the limits and their bounds.
+   IsTrue (m.numMeshlets > 1);
+   bool valid = true;
+   u64 covered = 0;
+   for (u64 mi = 0; mi < m.numMeshlets; ++mi) {
+      Meshlet* ml = m.sMeshlets + mi;
+      valid = valid && ml->firstIndex == covered &&
+              ml->numTris <= gKnobs.meshletMaxTris && ml->numVerts <= gKnobs.meshletMaxVerts;
+      for (u64 i = 0; i < ml->numTris * 3; ++i) {
+         vec3 p = m.sPositions[m.sIndices[ml->firstIndex + i]].xyz;
+         valid = valid && norm(p - ml->center) <= ml->radius * 1.0001f;
+      }
+      covered += ml->numTris * 3;
+   }
+   IsTrue (valid && covered == m.numIndices);
+
+   Camera cam = {};
+   cam.near = 0.1f;
+   cam.far = 100.0f;
+   cam.fov = Pi / 4;
+   cam.up = Vec3(0, 1, 0);
+   cam.eye = Vec3(0, 0, -5);
+
+   // Looking at the sphere: culling is conservative and takes out most of the back half.
+   {
+      Frustum f = frustumFromMatrix(mat4Persp(&cam, 1) * mat4Lookat(cam.eye, Vec3(0, 0, 0), cam.up));
+      u64 numBackfacing = 0;
+      u64 numCulled = 0;
+      bool conservative = true;
+      for (u64 mi = 0; mi < m.numMeshlets; ++mi) {
+         Meshlet* ml = m.sMeshlets + mi;
+         bool visible = meshletIsVisible(ml, &f, cam.eye, true);
+         for (u64 t = 0; t < ml->numTris; ++t) {
+            u32* tri = m.sIndices + ml->firstIndex + t * 3;
+            vec3 a = m.sPositions[tri[0]].xyz;
+            vec3 n = cross(m.sPositions[tri[1]].xyz - a, m.sPositions[tri[2]].xyz - a);
+            if (dot(n, m.sNormals[tri[0]] + m.sNormals[tri[1]] + m.sNormals[tri[2]]) < 0) {
+               n = -n;
+            }
+            bool backfacing = dot(n, a - cam.eye) >= 0;
+            numBackfacing += backfacing;
+            if (!visible) {
+               numCulled++;
+               conservative = conservative && backfacing;
+            }
+         }
+      }
+      IsTrue (conservative);
+      IsTrue (numCulled > numBackfacing / 2);
+      logMsg("Meshlet culling: %lld meshlets, %lld of %lld backfacing triangles culled\n", m.numMeshlets, numCulled, numBackfacing);
+   }
+
+   // Looking away: nothing is in the frustum.
+   {
+      Frustum f = frustumFromMatrix(mat4Persp(&cam, 1) * mat4Lookat(cam.eye, Vec3(0, 0, -10), cam.up));
+      bool anyVisible = false;
+      for (u64 mi = 0; mi < m.numMeshlets; ++mi) {
+         anyVisible = anyVisible || meshletIsVisible(m.sMeshlets + mi, &f, cam.eye, false);
+      }
+      IsFalse (anyVisible);
+   }
+}
+
+void
+testMeshAssets(Platform* plat)
+{
+   // A second acquire of the same file shares the mesh and its GPU buffers.
+   MeshAssetHandle a = acquireMeshAsset(plat, AssetPath(plat, "UnitCube.obj"));
+   MeshAssetHandle b = acquireMeshAsset(plat, AssetPath(plat, "UnitCube.obj"));
+   MeshAssetHandle c = acquireMeshAsset(plat, AssetPath(plat, "Flame.obj"));
+
+   IsTrue (a.idx && a.idx == b.idx && meshAsset(a) == meshAsset(b));
+   IsTrue (meshAssetRenderHandle(a).renderMeshIdx == meshAssetRenderHandle(b).renderMeshIdx);
+   IsTrue (c.idx != a.idx && meshAssetRenderHandle(c).renderMeshIdx != meshAssetRenderHandle(a).renderMeshIdx);
+
+   AABB bounds = meshAssetBounds(a);
+   IsTrue (bounds.max.x > bounds.min.x && bounds.max.y > bounds.min.y && bounds.max.z > bounds.min.z);
+
+   // Once the last reference is gone, the next acquire loads it again.
+   releaseMeshAsset(a);
+   releaseMeshAsset(b);
+   MeshAssetHandle d = acquireMeshAsset(plat, AssetPath(plat, "UnitCube.obj"));
+   IsTrue (d.idx != a.idx);
+
+   releaseMeshAsset(c);
+   releaseMeshAsset(d);
+}
+
+void
+testAssetLoadAsync(Platform* plat)
+{
+   AssetLoadHandle meshLoad = assetLoadAsync(plat, AssetPath(plat, "Hound.obj"), AssetType_Mesh);
+   AssetLoadHandle soundLoad = assetLoadAsync(plat, AssetPath(plat, "Swing.mp3"), AssetType_Sound);
+
+   assetWait(meshLoad);
+   IsTrue (assetPoll(meshLoad));
+
+   // Same results as loading on this thread.
+   MeshAssetHandle asyncMesh = assetTakeMesh(meshLoad);
+   MeshAssetHandle syncMesh = acquireMeshAsset(plat, AssetPath(plat, "Hound.obj"));
+   IsTrue (asyncMesh.idx == syncMesh.idx);
+   Mesh m = objLoadCached(plat, AssetPath(plat, "Hound.obj"), Lifetime_Frame);
+   IsTrue (meshAsset(asyncMesh)->numVerts == m.numVerts && meshAsset(asyncMesh)->numIndices == m.numIndices);
+   IsTrue (!memcmp(meshAsset(asyncMesh)->sIndices, m.sIndices, m.numIndices * sizeof(u32)));
+   meshUnmapCooked(plat, &m);
+
+   LoadedSound asyncSound = assetTakeSound(soundLoad);
+   LoadedSound syncSound = mp3Load(plat, AssetPath(plat, "Swing.mp3"), Lifetime_Frame);
+   IsTrue (asyncSound.numBytes && asyncSound.numBytes == syncSound.numBytes);
+   IsTrue (!memcmp(asyncSound.samples, syncSound.samples, syncSound.numBytes));
+
+   releaseMeshAsset(asyncMesh);
+   releaseMeshAsset(syncMesh);
+}
+
+void
+testAssetPack(Platform* plat)
+{
+   // Needs the pack slot; the game's pack can't be closed under loaded meshes.
+   if (assetPackIsOpen()) {
+      logMsg("Skipping testAssetPack: " AssetPackName " is open.\n");
+      return;
+   }
+
+   char* packPath = assetPathForFrame(plat, "../unittests.pack");
+   char* dirs[] = { "JamAssets" };
+   IsTrue (assetPackBuild(plat, packPath, dirs, ArrayCount(dirs)));
+
+   char* paths[] = {
+      AssetPath(plat, "UnitCube.obj"),
+      AssetPath(plat, "Hound.obj"),
+      AssetPath(plat, "Tree.obj"),
+      AssetPath(plat, "Swing.mp3"),
+      AssetPath(plat, "DancingScript-VariableFont_wght.ttf"),
+   };
+
+   // Cold cache, like the first start after a reboot. Opening the pack counts.
+   bool evicted = plat->evictFileCacheAscii(packPath);
+   for (int pathIdx = 0; pathIdx < ArrayCount(paths); ++pathIdx) {
+      evicted = plat->evictFileCacheAscii(paths[pathIdx]) && evicted;
+   }
+   u64 packColdUs = plat->getMicroseconds();
+   IsTrue (assetPackOpen(plat, packPath));
+   for (int pathIdx = 0; pathIdx < ArrayCount(paths); ++pathIdx) {
+      u8* packed = nullptr;
+      assetFileContents(plat, paths[pathIdx], packed, Lifetime_Frame);
+   }
+   packColdUs = plat->getMicroseconds() - packColdUs;
+
+   u64 looseColdUs = plat->getMicroseconds();
+   for (int pathIdx = 0; pathIdx < ArrayCount(paths); ++pathIdx) {
+      u8* loose = nullptr;
+      plat->fileContentsAscii(paths[pathIdx], loose, Lifetime_Frame);
+   }
+   looseColdUs = plat->getMicroseconds() - looseColdUs;
+
+   // Warm cache for both, since the files were all just read.
+   u64 looseUs = 0;
+   u64 packUs = 0;
+   for (int pathIdx = 0; pathIdx < ArrayCount(paths); ++pathIdx) {
+      u64 begin = plat->getMicroseconds();
+      u8* loose = nullptr;
+      u64 looseBytes = plat->fileContentsAscii(paths[pathIdx], loose, Lifetime_Frame);
+      looseUs += plat->getMicroseconds() - begin;
+
+      begin = plat->getMicroseconds();
+      u8* packed = nullptr;
+      u64 packedBytes = assetFileContents(plat, paths[pathIdx], packed, Lifetime_Frame);
+      packUs += plat->getMicroseconds() - begin;
+
+      IsTrue (looseBytes && packedBytes == looseBytes && !memcmp(loose, packed, looseBytes));
+      IsTrue (packed[packedBytes] == '\0');
+   }
+   logMsg("Asset pack: %d files cold in %llu us, loose files in %llu us%s\n",
+          (int)ArrayCount(paths), packColdUs, looseColdUs, evicted ? "" : " (file cache not flushed)");
+   logMsg("Asset pack: %d files warm in %llu us, loose files in %llu us\n", (int)ArrayCount(paths), packUs, looseUs);
+
+   // Files that aren't packed come from disk.
+   u64 bytes = 0;
+   IsTrue (assetPackView(AssetPath(plat, "Hound.blend"), &bytes) == nullptr);
+
+   assetPackClose(plat);
+   IsTrue (plat->deleteFileAscii(packPath));
+}
+
+void
+testSoundStreaming(Platform* plat)
+{
+   // EnemyDying decodes to more than gKnobs.streamSoundsAboveBytes, Swing doesn't.
+   LoadedSound streamed = mp3Load(plat, AssetPath(plat, "EnemyDying.mp3"), Lifetime_Frame);
+   LoadedSound decoded = mp3Load(plat, AssetPath(plat, "Swing.mp3"), Lifetime_Frame);
+   IsTrue (streamed.mp3 && !streamed.samples && streamed.numBytes > gKnobs.streamSoundsAboveBytes);
+   IsTrue (decoded.samples && !decoded.mp3 && decoded.numBytes > 0);
+
+   // Block by block, like the mixer, gives every sample.
+   mp3dec_ex_t dec = {};
+   IsTrue (!mp3dec_ex_open_buf(&dec, streamed.mp3, streamed.mp3Bytes, MP3D_SEEK_TO_SAMPLE));
+   mp3dec_ex_seek(&dec, 0);
+
+   i16 chunk[MixerDecodeSamples];
+   u64 numSamples = 0;
+   size_t read = 0;
+   while ((read = mp3dec_ex_read(&dec, chunk, ArrayCount(chunk))) > 0) {
+      numSamples += read;
+   }
+   mp3dec_ex_close(&dec);
+
+   IsTrue (numSamples * sizeof(i16) == streamed.numBytes);
+}
+
+void
+testMp3LoadBatch(Platform* plat)
+{
+   char* paths[] = {
+      AssetPath(plat, "PlayerHit.mp3"),
+      AssetPath(plat, "Swing.mp3"),
+      AssetPath(plat, "TreeHit.mp3"),
+      AssetPath(plat, "TreeFall.mp3"),
+      AssetPath(plat, "EnemyDying.mp3"),  // Streamed
+   };
+   LoadedSound serial[ArrayCount(paths)] = {};
+   LoadedSound batch[ArrayCount(paths)] = {};
+
+   u64 begin = plat->getMicroseconds();
+   for (int i = 0; i < ArrayCount(paths); ++i) {
+      serial[i] = mp3Load(plat, paths[i], Lifetime_Frame);
+   }
+   u64 serialUs = plat->getMicroseconds() - begin;
+
+   // Short segments, so that every sound is split.
+   begin = plat->getMicroseconds();
+   mp3LoadBatch(plat, paths, batch, ArrayCount(paths), Lifetime_Frame, 1024);
+   u64 batchUs = plat->getMicroseconds() - begin;
+
+   for (int i = 0; i < ArrayCount(paths); ++i) {
+      IsTrue (batch[i].numBytes == serial[i].numBytes && batch[i].hz == serial[i].hz && batch[i].channels == serial[i].channels);
+      IsTrue ((batch[i].samples != nullptr) == (serial[i].samples != nullptr));
+      if (serial[i].samples) {
+         IsTrue (!memcmp(batch[i].samples, serial[i].samples, serial[i].numBytes));
+      }
+   }
+
+   logMsg("mp3 decode: serial %llu us, batch %llu us on %d threads\n", serialUs, batchUs, plat->numWorkerThreads + 1);
+}
+
+void
+testAudioMixer(Platform* plat)
+{
+   AudioMixer* m = audioMixerCreate(Lifetime_Frame);
+   LoadedSound swing = mp3Load(plat, AssetPath(plat, "Swing.mp3"), Lifetime_Frame);
+   LoadedSound dying = mp3Load(plat, AssetPath(plat, "EnemyDying.mp3"), Lifetime_Frame);  // Streamed
+   IsTrue (swing.samples && swing.channels == 1 && dying.mp3);
+
+   const u32 blockFrames = 1000;  // Not a multiple of the SIMD width.
+   i16 out[blockFrames * 2];
+
+   // Centered, each side gets the sample at -3 dB.
+   IsTrue (audioMixerPlay(m, &swing, 1.0f, 0.0f));
+   audioMixerRender(m, out, blockFrames);
+   bool centered = true;
+   for (u32 i = 0; i < blockFrames; ++i) {
+      float expected = swing.samples[i] * 0.70710678f;
+      centered &= fabsf(out[i * 2] - expected) <= 1.0f && out[i * 2] == out[i * 2 + 1];
+   }
+   IsTrue (centered);
+
+   // Hard left, loud enough to clip.
+   m = audioMixerCreate(Lifetime_Frame);
+   IsTrue (audioMixerPlay(m, &swing, 64.0f, -1.0f));
+   audioMixerRender(m, out, blockFrames);
+   bool clipped = true;
+   for (u32 i = 0; i < blockFrames; ++i) {
+      float expected = clamp(swing.samples[i] * 64.0f, -32768.0f, 32767.0f);
+      clipped &= fabsf(out[i * 2] - expected) <= 1.0f && abs(out[i * 2 + 1]) <= 1;
+   }
+   IsTrue (clipped);
+
+   // Streamed and decoded sounds both run to their end and free their channel.
+   // Commands take effect at the next render.
+   m = audioMixerCreate(Lifetime_Frame);
+   IsTrue (audioMixerPlay(m, &swing, 1.0f, 0.0f));
+   IsTrue (audioMixerPlay(m, &dying, 1.0f, 0.0f));
+   IsTrue (audioMixerNumPlaying(m) == 0);
+   u64 dyingFrames = dying.numBytes / sizeof(i16);
+   u64 rendered = 0;
+   do {
+      audioMixerRender(m, out, blockFrames);
+      rendered += blockFrames;
+      if (rendered == blockFrames) {
+         IsTrue (audioMixerNumPlaying(m) == 2);
+      }
+   } while (audioMixerNumPlaying(m) && rendered < dyingFrames * 2);
+   IsTrue (audioMixerNumPlaying(m) == 0);
+   IsTrue (rendered >= dyingFrames && rendered < dyingFrames + 2 * blockFrames);
+
+   // Stopped and silenced sounds.
+   SoundId stopped = audioMixerPlay(m, &swing, 1.0f, 0.0f);
+   SoundId silenced = audioMixerPlay(m, &swing, 1.0f, 0.0f);
+   IsTrue (stopped && silenced && stopped != silenced);
+   audioMixerRender(m, out, blockFrames);
+   IsTrue (audioMixerStop(m, stopped));
+   IsTrue (audioMixerSetParams(m, silenced, 0.0f, 0.0f));
+   audioMixerRender(m, out, blockFrames);
+   IsTrue (audioMixerNumPlaying(m) == 1);
+   bool silent = true;
+   for (u32 i = 0; i < blockFrames * 2; ++i) {
+      silent &= out[i] == 0;
+   }
+   IsTrue (silent);
+   IsTrue (audioMixerStop(m, silenced));
+
+   // Every channel busy drops the sound.
+   for (u32 i = 0; i < gKnobs.mixerChannels + 1; ++i) {
+      IsTrue (audioMixerPlay(m, &swing, 1.0f, 0.0f));
+   }
+   audioMixerRender(m, out, blockFrames);
+   IsTrue (audioMixerNumPlaying(m) == gKnobs.mixerChannels);
+
+   IsTrue (audioMixerWriteWav(plat, m, assetPathForFrame(plat, "../unittests_mix.wav"), gKnobs.mixerRate / 4));
+}
+
+void
+testAudioMixerPositional(Platform* plat)
+{
+   const u32 blockFrames = 1000;
+   i16 out[blockFrames * 2];
+
+   // Cubic interpolation is exact on a ramp. At half the mixer rate, every
+   // other output frame falls between two samples.
+   LoadedSound ramp = {};
+   const u32 rampFrames = 4000;
+   ramp.samples = AllocateArray(i16, rampFrames, Lifetime_Frame);
+   for (u32 i = 0; i < rampFrames; ++i) {
+      ramp.samples[i] = (i16)(i * 8);
+   }
+   ramp.hz = gKnobs.mixerRate / 2;
+   ramp.channels = 1;
+   ramp.numBytes = rampFrames * sizeof(i16);
+
+   AudioMixer* m = audioMixerCreate(Lifetime_Frame);
+   IsTrue (audioMixerPlay(m, &ramp, 1.0f, -1.0f));
+   u32 rendered = 0;
+   bool exact = true;
+   while (audioMixerNumPlaying(m) || rendered == 0) {
+      audioMixerRender(m, out, blockFrames);
+      for (u32 i = 0; i < blockFrames; ++i) {
+         u32 frame = rendered + i;
+         if (frame >= 2 && frame < 2 * (rampFrames - 2)) {
+            exact &= out[i * 2] == frame * 4 && out[i * 2 + 1] == 0;
+         }
+      }
+      rendered += blockFrames;
+   }
+   IsTrue (exact);
+   IsTrue (rendered >= 2 * rampFrames && rendered < 2 * rampFrames + 2 * blockFrames);
+
+   // A flat sound, to read gains off the output.
+   LoadedSound flat = ramp;
+   flat.samples = AllocateArray(i16, rampFrames, Lifetime_Frame);
+   for (u32 i = 0; i < rampFrames; ++i) {
+      flat.samples[i] = 1000;
+   }
+   flat.hz = gKnobs.mixerRate;
+
+   Camera cam = {};
+   cam.eye = { 0, 0, 0 };
+   cam.lookat = { 0, 0, -1 };
+   cam.up = { 0, 1, 0 };
+   vec3 right = normalizedOrZero(cross(cam.up, cam.lookat - cam.eye));
+
+   // Twice the reference distance to the right: half the gain, all of it on the right.
+   m = audioMixerCreate(Lifetime_Frame);
+   IsTrue (audioMixerSetListener(m, &cam));
+   IsTrue (audioMixerPlayAt(m, &flat, right * (2 * gKnobs.audioRefDistance), 1.0f));
+   audioMixerRender(m, out, blockFrames);
+   IsTrue (abs(out[0]) <= 1 && abs(out[1] - 500) <= 1);
+
+   // The listener turns around: now it's on the left.
+   cam.lookat = { 0, 0, 1 };
+   IsTrue (audioMixerSetListener(m, &cam));
+   audioMixerRender(m, out, blockFrames);
+   IsTrue (abs(out[0] - 500) <= 1 && abs(out[1]) <= 1);
+
+   // Every channel busy, at 1, 2, ... reference distances ahead. Only the loudest are mixed.
+   m = audioMixerCreate(Lifetime_Frame);
+   IsTrue (audioMixerSetListener(m, &cam));
+   vec3 ahead = cam.lookat - cam.eye;
+   for (u32 i = 0; i < gKnobs.mixerChannels; ++i) {
+      IsTrue (audioMixerPlayAt(m, &flat, ahead * ((i + 1) * gKnobs.audioRefDistance), 1.0f));
+   }
+   audioMixerRender(m, out, blockFrames);
+   IsTrue (audioMixerNumPlaying(m) == gKnobs.mixerChannels);
+   IsTrue (audioMixerNumAudible(m) == gKnobs.mixerMaxAudible);
+   float expected = 0;
+   for (u32 i = 0; i < gKnobs.mixerMaxAudible; ++i) {
+      expected += 1000.0f * 0.70710678f / (i + 1);
+   }
+   IsTrue (fabsf(out[0] - expected) <= gKnobs.mixerMaxAudible && out[0] == out[1]);
+
+   // A louder sound takes the quietest channel.
+   IsTrue (audioMixerPlayAt(m, &flat, cam.eye, 1.0f));
+   audioMixerRender(m, out, blockFrames);
+   IsTrue (audioMixerNumPlaying(m) == gKnobs.mixerChannels);
+   expected += 1000.0f * 0.70710678f * (1.0f - 1.0f / gKnobs.mixerMaxAudible);
+   IsTrue (fabsf(out[0] - expected) <= gKnobs.mixerMaxAudible);
+}
+
+// The queues between the game and mixing threads. See AudioThreadsTSan.cc for the same stress run under -fsanitize=thread.
+void
+testAudioThreads(Platform* plat)
+{
+   if (plat->numWorkerThreads == 0) {
+      // The producer would wait on a full ring forever.
+      logMsg("testAudioThreads needs a worker thread. Skipping.\n");
+      return;
+   }
+
+   AudioStressTest* t = AllocateElem(AudioStressTest, Lifetime_Frame);
+   t->mixer = audioMixerCreate(Lifetime_Frame);
+   t->ring = audioRingCreate(1024, Lifetime_Frame);
+   t->numFrames = 1 << 20;  // Wraps the cursors' low bits many times.
+
+   LoadedSound swing = mp3Load(plat, AssetPath(plat, "Swing.mp3"), Lifetime_Frame);
+   t->sound = &swing;
+
+   plat->addWork(audioStressProducer, t);
+   plat->addWork(audioStressConsumer, t);
+   plat->completeAllWork();
+
+   IsTrue (t->ringInOrder);
+   IsTrue (t->numCommands > 0);
+
+   // Every sound ends, even if its stop was dropped.
+   u32 maxBlocks = swing.numBytes / sizeof(i16) / 64 + 2;
+   for (u32 blockIdx = 0; blockIdx < maxBlocks; ++blockIdx) {
+      i16 block[2 * 64];
+      audioMixerRender(t->mixer, block, ArrayCount(block) / 2);
+   }
+   IsTrue (audioMixerNumPlaying(t->mixer) == 0);
+}
+
+// Uses the font immInit got.
+void
+testTextMeasure()
+{
+   IsTrue (immMeasureText("").x == 0);
+
+   f32 whole = immMeasureText("Wood: 10").x;
+   f32 parts = immMeasureText("Wood: ").x + immMeasureText("10").x;
+   IsTrue (whole > 0);
+   IsTrue (Abs(whole - parts) < 0.01f);
+
+   // Enough strings to evict the first from the cache. It measures the same when laid out again.
+   char str[16] = {};
+   for (u32 i = 0; i <= gKnobs.uiTextCacheSize; ++i) {
+      snprintf(str, ArrayCount(str), "%u", i);
+      immMeasureText(str);
+   }
+   IsTrue (immMeasureText("Wood: 10").x == whole);
+}
+
+// Glyphs come from one distance field, for any code point and size.
+void
+testFontGlyphs(Platform* plat)
+{
+   // A scratch copy of the editor font. New glyphs in the real one would end up in its disk cache.
+   Font* font = AllocateElem(Font, Lifetime_Frame);
+   IsTrue (fontLoad(plat, font, "C:/windows/fonts/arial.ttf", NULL, plat->numWorkerThreads + 1, Lifetime_Frame));
+   IsTrue (font->cachePath[0] == '\0');
+   immInit(font);
+
+   FontGlyph* a = fontGlyph(font, 'A');
+   IsTrue (a->w > 0 && a->h > 0 && a->advance > 0);
+   IsTrue (a->x + a->w <= font->atlasSize && a->y + a->h <= font->atlasSize);
+   IsTrue (fontGlyph(font, 'A') == a);
+   IsTrue (fontGlyph(font, ' ')->w == 0);
+
+   IsTrue (immMeasureText("\xc3\xa9").x > 0);  // U+00E9
+   f32 tiny = immMeasureText("A", FontSize_Tiny).x;
+   f32 big = immMeasureText("A", FontSize_Big).x;
+   IsTrue (Abs(big / tiny - font->fontSizesPx[FontSize_Big] / font->fontSizesPx[FontSize_Tiny]) < 0.001f);
+
+   // A batch only rasterizes the glyphs the font doesn't have yet.
+   u32 latin1[64] = {};
+   for (u32 i = 0; i < ArrayCount(latin1); ++i) {
+      latin1[i] = 0xC0 + i;
+   }
+   fontPrepareGlyphs(plat, font, latin1, ArrayCount(latin1), plat->numWorkerThreads + 1);
+   IsTrue (fontPrepareGlyphs(plat, font, latin1, ArrayCount(latin1), plat->numWorkerThreads + 1) == 0);
+   IsTrue (fontGlyph(font, 0xC9)->w > 0);  // E with acute
+
+   immInit(&editor()->defaultFont);
+}
+
+// Serial and parallel rasterization give the same atlas. Each fontLoad logs
+// its time and thread count, which is the comparison for the game's fonts.
+// Every size scales the same distance fields, so a font is rasterized once.
+void
+testFontLoadThreads(Platform* plat)
+{
+   char* paths[] = {
+      "C:/windows/fonts/arial.ttf",
+      AssetPath(plat, "DancingScript-VariableFont_wght.ttf"),
+   };
+   for (int pathIdx = 0; pathIdx < ArrayCount(paths); ++pathIdx) {
+      // No disk cache for scratch fonts, so both rasterize all of ASCII.
+      Font* serial = AllocateElem(Font, Lifetime_Frame);
+      Font* parallel = AllocateElem(Font, Lifetime_Frame);
+      IsTrue (fontLoad(plat, serial, paths[pathIdx], NULL, 1, Lifetime_Frame));
+      IsTrue (fontLoad(plat, parallel, paths[pathIdx], NULL, plat->numWorkerThreads + 1, Lifetime_Frame));
+
+      IsTrue (hmlen(serial->hmGlyphs) == hmlen(parallel->hmGlyphs));
+      IsTrue (!memcmp(serial->atlasPixels, parallel->atlasPixels, (u64)serial->atlasSize * serial->atlasSize));
+   }
+}
+
+// Loading a font again, as Restart does, rasterizes all of it again into a new atlas.
+void
+testFontReload(Platform* plat)
+{
+   Font* font = AllocateElem(Font, Lifetime_Frame);
+   IsTrue (fontLoad(plat, font, "C:/windows/fonts/arial.ttf", NULL, 1, Lifetime_Frame));
+   u8* firstAtlas = font->atlasPixels;
+   u64 numGlyphs = hmlen(font->hmGlyphs);
+
+   IsTrue (fontLoad(plat, font, "C:/windows/fonts/arial.ttf", NULL, 1, Lifetime_Frame));
+   IsTrue (font->atlasPixels != firstAtlas);
+   IsTrue (hmlen(font->hmGlyphs) == numGlyphs);
+   IsTrue (!memcmp(font->atlasPixels, firstAtlas, (u64)font->atlasSize * font->atlasSize));
+}
+
+// Widgets that don't overlap share draws. What overlaps is drawn in order, and clipping drops what is outside.
+void
+testUIDrawList()
+{
+   Texture2D* tex = &editor()->defaultFont.atlasTexture;
+
+   immNewFrame();
+   for (int i = 0; i < 8; ++i) {
+      immSetCursor(10, 50 + 40 * i);
+      immText("label");
+      immSetCursor(300, 50 + 40 * i);
+      immImage(tex, 100, 20);
+   }
+   IsTrue (immCountDraws() == 2);
+
+   immSetCursor(0, 400);
+   immImage(tex, 500, 400);  // Over all of it
+   IsTrue (immCountDraws() == 2);
+   immSetCursor(10, 50);
+   immText("on top");
+   IsTrue (immCountDraws() == 3);
+
+   immNewFrame();
+   immPushClip(0, 0, 500, 1);
+   immSetCursor(10, 50);
+   immText("hidden");
+   immPopClip();
+   IsTrue (immCountDraws() == 0);
+   immText("shown");
+   IsTrue (immCountDraws() == 1);
+
+   immNewFrame();
+}
+
+static void
+uiReuseTestFrame(Texture2D* tex, int redRow)
+{
+   immNewFrame();
+   for (int i = 0; i < 8; ++i) {
+      immSetCursor(10, 50 + 40 * i);
+      immText("label", FontSize_Small, i == redRow ? vec4{ 1, 0, 0, 1 } : vec4{ 1, 1, 1, 1 });
+      immSetCursor(300, 50 + 40 * i);
+      immImage(tex, 100, 20);
+   }
+}
+
+// The same draw list as the last frame writes nothing, and changing one widget only writes its quads.
+void
+testUIBufferReuse()
+{
+   Texture2D* tex = &editor()->defaultFont.atlasTexture;
+
+   // immFillBuffer has buffers of its own, so these frames don't count towards immStats.
+   // The last frame is far enough back that its buffer is no longer in flight, so the changed
+   // list is written over it.
+   u64 frame = gpu()->frameCount;
+   uiReuseTestFrame(tex, -1);
+   ImmStats first = immFillBuffer(frame);
+   IsTrue (!first.reusedFrame && first.numQuads > 8 && first.numQuadsWritten == first.numQuads);
+
+   uiReuseTestFrame(tex, -1);
+   ImmStats same = immFillBuffer(frame + 1);
+   IsTrue (same.reusedFrame && same.numQuadsWritten == 0 && same.numQuads == first.numQuads);
+
+   uiReuseTestFrame(tex, 3);
+   ImmStats changed = immFillBuffer(frame + 1 + gKnobs.swapChainBufferCount);
+   IsTrue (!changed.reusedFrame && changed.numQuads == first.numQuads);
+   IsTrue (changed.numQuadsWritten == 5);  // The glyphs of the red label
+
+   IsTrue (changed.numFrames == first.numFrames + 2 && changed.numFramesReused == first.numFramesReused + 1);
+   IsTrue (changed.totalQuadsWritten == first.totalQuadsWritten + 5);
+
+   immNewFrame();
+}
+
+// Typing a query one character at a time finds the same entries as matching it all at once,
+// and entries added or removed while typing show up right away.
+void
+testFuzzyFinder(Platform* plat)
+{
+   char* kinds[] = { "Crate", "Barrel", "Lamp post", "Wooden crate" };
+   u32 numNames = 10000;
+   Finder typed = {};
+   Finder whole = {};
+   for (u32 i = 0; i < numNames; ++i) {
+      char name[32] = {};
+      snprintf(name, ArrayCount(name), "%s %u", kinds[i % ArrayCount(kinds)], i);
+      finderAddCandidate(&typed, name, i);
+      finderAddCandidate(&whole, name, i);
+   }
+
+   u64 begin = plat->getMicroseconds();
+   char* query = "crate12";
+   char** sTyped = NULL;
+   for (char* c = query; *c; ++c) {
+      SBPush(typed.sSearchString, *c, Lifetime_Frame);
+      sTyped = finderComputeResults(&typed, Lifetime_Frame);
+   }
+   logMsg("Finder: %u entries, typed \"%s\" in %llu us\n", numNames, query, plat->getMicroseconds() - begin);
+
+   for (char* c = query; *c; ++c) {
+      SBPush(whole.sSearchString, *c, Lifetime_Frame);
+   }
+   u64 selected = 0;
+   char** sWhole = finderComputeResults(&whole, Lifetime_Frame, &selected);
+
+   IsTrue (arrlen(sTyped) == gKnobs.finderMaxResults);
+   IsTrue (arrlen(sWhole) == arrlen(sTyped));
+   for (sz i = 0; i < arrlen(sWhole); ++i) {
+      IsTrue (!strcmp(sWhole[i], sTyped[i]));
+   }
+   IsTrue (!strcmp(sWhole[0], "Crate 12"));
+   IsTrue (selected == 12);
+
+   finderAddCandidate(&typed, "Crate12", numNames);
+   finderComputeResults(&typed, Lifetime_Frame, &selected);
+   IsTrue (selected == numNames);
+   finderRemoveCandidatesFrom(&typed, numNames);
+   finderComputeResults(&typed, Lifetime_Frame, &selected);
+   IsTrue (selected == 12);
+
+   SBPush(whole.sSearchString, 'x', Lifetime_Frame);
+   IsTrue (arrlen(finderComputeResults(&whole, Lifetime_Frame)) == 0);
+}
+
+static u64
+finderTestQuery(Finder* f, char* query, u32* numResults)
+{
+   finderExit(f);
+   for (char* c = query; *c; ++c) {
+      SBPush(f->sSearchString, *c, Lifetime_Frame);
+   }
+   u64 selected = 0;
+   *numResults = (u32)arrlen(finderComputeResults(f, Lifetime_Frame, &selected));
+   return selected;
+}
+
+// The finder picks up objects as they are added, and a new world replaces the old world's
+// entries, even when it is made in the old world's memory and has as many objects.
+void
+testFinderWorld(Platform* plat)
+{
+   Finder f = {};
+   Mode mode = editor()->mode;
+
+   disposeWorld();
+   makeAndSetWorld();
+   for (int i = 0; i < 3; ++i) {
+      addMeshToWorld(makeQuad(1.0, 0, Lifetime_Frame), "Finder test old");
+   }
+   finderUpdateIndex(plat, &f);
+   IsTrue (f.index.numEntries == f.numFixedEntries + 3 * 2);  // Object and material.
+
+   addMeshToWorld(makeQuad(1.0, 0, Lifetime_Frame), "Finder test old");
+   finderUpdateIndex(plat, &f);
+   IsTrue (f.index.numEntries == f.numFixedEntries + 4 * 2);
+
+   disposeWorld();
+   makeAndSetWorld();
+   ObjectHandle last = {};
+   for (int i = 0; i < 5; ++i) {
+      last = addMeshToWorld(makeQuad(1.0, 0, Lifetime_Frame), "Finder test new");
+   }
+   setTransformForObject(last, mat4Translate(10, 0, 0));
+   finderUpdateIndex(plat, &f);
+   IsTrue (f.index.numEntries == f.numFixedEntries + 5 * 2);
+
+   u32 numResults = 0;
+   finderTestQuery(&f, "finder test old", &numResults);
+   IsTrue (numResults == 0);
+
+   char query[32] = {};
+   snprintf(query, ArrayCount(query), "object #%llu", last.idx);
+   u64 selected = finderTestQuery(&f, query, &numResults);
+   IsTrue (selected == FinderId(FinderKind_Object, last.idx));
+   finderPerform(plat, selected);
+   IsTrue (length(getWorld()->cam.lookat - vec3{ 10, 0, 0 }) < 0.01f);
+
+   finderExit(&f);
+   modeEnable(mode);
+}
+
+PlatformWorkProcDef(profileTestJob)
+{
+   ProfileZone("testJob");
+}
+
+// Zones nest under the zone they ran in and calls of the same zone add up. Other threads get their own tree.
+void
+testProfiler(Platform* plat)
+{
+   u32 numJobs = 16;
+
+   profileNewFrame();  // Drops what ran before.
+   profileBegin("testOuter");
+   for (int i = 0; i < 3; ++i) {
+      ProfileZone("testInner");
+   }
+   for (u32 i = 0; i < numJobs; ++i) {
+      plat->addWork(profileTestJob, NULL);
+   }
+   plat->completeAllWork();
+   profileEnd();
+   profileNewFrame();
+
+   ProfileNode* mainThread = profileFindZone(NULL, "Main thread");
+   ProfileNode* outer = profileFindZone(mainThread, "testOuter");
+   IsTrue (outer && outer->calls == 1);
+   ProfileNode* inner = profileFindZone(outer, "testInner");
+   IsTrue (inner && inner->calls == 3 && inner->ticks <= outer->ticks);
+   IsTrue (!profileFindZone(mainThread, "testInner"));
+
+   // The main thread helps with the jobs while it waits.
+   ProfileNode* mainJobs = profileFindZone(outer, "testJob");
+   u32 jobsRun = mainJobs ? mainJobs->calls : 0;
+   for (u32 i = 1; i < gKnobs.profilerMaxThreads; ++i) {
+      char name[32] = {};
+      snprintf(name, ArrayCount(name), "Thread %u", i);
+      ProfileNode* thread = profileFindZone(NULL, name);
+      ProfileNode* threadJobs = thread ? profileFindZone(thread, "testJob") : NULL;
+      jobsRun += threadJobs ? threadJobs->calls : 0;
+   }
+   IsTrue (jobsRun == numJobs);
+
+   profileNewFrame();
+   IsTrue (!profileFindZone(NULL, "Main thread"));
+}
+
 void
-runUnitTests()
+runUnitTests(Platform* plat)
 {
    testRayTriangleIntersection();
    testAlignOpts();
+   testObjLoadThreads(plat);
+   testVertexCompression();
+   testMeshCache(plat);
+   testVertexCacheOptimization(plat);
+   testMeshSimplify(plat);
+   testMeshletCulling(plat);
+   testMeshAssets(plat);
+   testAssetLoadAsync(plat);
+   testAssetPack(plat);
+   testSoundStreaming(plat);
+   testMp3LoadBatch(plat);
+   testAudioMixer(plat);
+   testAudioMixerPositional(plat);
+   testAudioThreads(plat);
+   testTextMeasure();
+   testFontGlyphs(plat);
+   testFontLoadThreads(plat);
+   testFontReload(plat);
+   testUIDrawList();
+   testUIBufferReuse();
+   testFuzzyFinder(plat);
+   testFinderWorld(plat);
+   testProfiler(plat);
 }
@@ -12,15 +12,125 @@ namespace Imm
    static int lineSpacing = 10;
 };
 
-struct UIRenderElem
+using UIId = u64;
+
+struct UIRect
 {
-   bool toRender;
-   MeshRenderHandle mesh;
-   ResourceHandle cstHnd;
-   mat4 transform;
+   f32 x0, y0, x1, y1;
 };
 
-using UIId = u64;
+enum UIDrawCmdType
+{
+   UIDraw_Quads,  // A rect, an image or a run of glyphs.
+   UIDraw_ClipPush,
+   UIDraw_ClipPop,
+};
+
+// Recorded by the widgets during the frame. immRender clips the quads and
+// merges commands into as few draws as it can without changing what is drawn
+// over what.
+struct UIDrawCmd
+{
+   UIDrawCmdType type;
+   UISampleMode mode;
+   i32 textureIdx;  // SRV bind index. -1 for flat color.
+   u32 color;
+   u32 firstQuad;  // In sQuads
+   u32 numQuads;
+   UIRect bounds;  // Of the quads, or the clip rect.
+
+   // Set by immRender
+   UIRect clip;
+   i32 nextInDraw;
+};
+
+struct UIDraw
+{
+   UISampleMode mode;
+   i32 textureIdx;
+   UIRect bounds;  // Of what it draws, clipped.
+   i32 firstCmd;
+   i32 lastCmd;
+   u32 firstQuad;  // In the stream
+   u32 numQuads;
+};
+
+// Quads are written into upload heap vertex buffers that stay mapped, one per
+// frame in flight. Every quad uses the same six indices, so the index buffer
+// is written once. Each draw gets its own constants.
+//
+// Each buffer remembers what it holds. A frame that records the same draw
+// list as the one last drawn draws that buffer again without writing
+// anything, and a frame that changed only writes the commands that are not
+// already at the same place in the buffer it fills.
+struct UIWrittenCmd
+{
+   u64 hash;  // See immiCmdHash
+   u32 firstQuad;  // In the vertex buffer
+   u32 numQuads;  // After clipping
+};
+
+struct UIConstantKey
+{
+   UISampleMode mode;
+   i32 textureIdx;
+   i32 fbWidth;
+   i32 fbHeight;
+};
+
+struct UIBufferContents
+{
+   u64 hash;  // Of the draw list it was written for. Zero when never written.
+   u64 lastDrawnFrame;  // Zero when never drawn.
+   u32 numQuads;
+   u32 numDraws;
+   UIDraw draws[gKnobs.uiMaxDraws];
+   UIConstantKey constantKeys[gKnobs.uiMaxDraws];
+   UIWrittenCmd* cmds;  // In the order they were written. gKnobs.uiMaxQuads of them at most.
+   u32 numCmds;
+};
+
+struct UIQuadStream
+{
+   u32 maxQuads;  // Zero until created.
+   ResourceHandle indexBuffer;
+   ResourceHandle vertexBuffers[gKnobs.swapChainBufferCount];
+   ResourceHandle constants[gKnobs.swapChainBufferCount][gKnobs.uiMaxDraws];
+   MeshRenderVertex* verts[gKnobs.swapChainBufferCount];
+   UIBufferContents contents[gKnobs.swapChainBufferCount];
+   i32 lastDrawn;  // Buffer drawn by the last immRender. -1 before the first.
+
+   u32 numDropped;
+   ImmStats stats;
+};
+
+// Glyph quads of a string, laid out at 0,0.
+struct UITextLayout
+{
+   meow_u128 key;  // Font, size and string
+   Font* font;
+   FontSize size;
+   i32 next;  // In its bucket. -1 ends the chain.
+
+   u64 lastUsedFrame;
+   vec2 lastCursor;  // Where immText last drew it.
+
+   u32 numGlyphs;  // One per byte of text. See layoutLineOfText.
+   char* text;  // numGlyphs chars, not terminated.
+   stbtt_aligned_quad* quads;
+   f32* penX;  // After each glyph. The last one is the width.
+};
+
+// Bounded: gKnobs.uiTextCacheSize layouts of up to gKnobs.uiTextCacheGlyphs
+// glyphs each, in memory taken once. When it is full, the least recently used
+// layout is replaced.
+struct UITextCache
+{
+   UITextLayout* layouts;  // Null until the first string.
+   u32 numLayouts;
+   i32 buckets[gKnobs.uiTextCacheSize * 2];  // First layout of each chain.
+   u64 frame;
+};
 
 struct UIElem
 {
@@ -38,11 +148,7 @@ static struct ImmUI
 
    vec2 cursor;  // Maybe rename?
 
-   struct TextHM
-   {
-      meow_u128 key;
-      UIRenderElem value;
-   } *hmTexts;
+   UITextCache textCache;
 
    struct UIIdHM
    {
@@ -56,9 +162,13 @@ static struct ImmUI
 
    u64 nextGUIId;
 
-   u32 numRects;
-   Mesh* sRects;
-   UIRenderElem rects;
+   // This frame's draw list, in Lifetime_Frame.
+   UIDrawCmd* sCmds;
+   stbtt_aligned_quad* sQuads;  // In window pixels. Glyph quads are placed at their cursor.
+   i32 clipDepth;
+
+   UIQuadStream stream;  // Created by the first frame that draws anything.
+   UIQuadStream testStream;  // immFillBuffer's, so tests leave the one above alone.
 
    // Layout
    bool sameLine;
@@ -81,17 +191,74 @@ immGlobalSet(u8* ptr)
    gUI = (ImmUI*)ptr;
 }
 
-void
-immiPushRect(f32 cx, f32 cy, f32 w, f32 h, vec4 color)
+static void
+immiStreamCreate(UIQuadStream* s, u32 maxQuads, char* name)
 {
-   Mesh q = makeQuad(cx, cy, w, h, 0, color, Lifetime_Frame, Winding_CCW /* Will be reversed by UI shader*/);
-   if (gUI->numRects >= arrlen(gUI->sRects)) {
-      arrpush(gUI->sRects, q);
-      gUI->numRects++;
+   Assert(maxQuads * 4 <= 65536);  // u16 indices
+
+   s->maxQuads = maxQuads;
+   s->indexBuffer = gpuCreateResource(maxQuads * 6 * sizeof(u16), name);
+   u16* indices = (u16*)gpuMapResource(s->indexBuffer);
+   for (u32 q = 0; q < maxQuads; ++q) {
+      // Counter-clockwise; the UI shader flips y.
+      u16 base = (u16)(q * 4);
+      u16 quad[6] = { base, (u16)(base + 1), (u16)(base + 2), (u16)(base + 2), (u16)(base + 3), base };
+      memcpy(indices + q * 6, quad, sizeof(quad));
    }
-   else {
-      gUI->sRects[gUI->numRects++] = q;
+
+   for (int i = 0; i < gKnobs.swapChainBufferCount; ++i) {
+      s->vertexBuffers[i] = gpuCreateResource(maxQuads * 4 * sizeof(MeshRenderVertex), name);
+      for (u32 d = 0; d < gKnobs.uiMaxDraws; ++d) {
+         s->constants[i][d] = gpuCreateResource(sizeof(TextConstants), "UI constants");
+      }
+      s->verts[i] = (MeshRenderVertex*)gpuMapResource(s->vertexBuffers[i]);
+      s->contents[i] = {};
+      s->contents[i].cmds = AllocateArray(UIWrittenCmd, maxQuads, Lifetime_App);
    }
+   s->lastDrawn = -1;
+}
+
+// Quads are placed at `at`.
+static void
+immiPushQuads(UISampleMode mode, i32 textureIdx, vec4 color, const stbtt_aligned_quad* quads, u32 numQuads, vec2 at)
+{
+   UIDrawCmd cmd = {};
+   cmd.type = UIDraw_Quads;
+   cmd.mode = mode;
+   cmd.textureIdx = textureIdx;
+   cmd.color = packColorRGBA8(color);
+   cmd.firstQuad = (u32)arrlen(gUI->sQuads);
+   cmd.bounds = { MaxFloat, MaxFloat, -MaxFloat, -MaxFloat };
+   for (u32 i = 0; i < numQuads; ++i) {
+      stbtt_aligned_quad q = quads[i];
+      if (q.x1 == q.x0) {
+         continue;  // Space, or not the first byte of a code point.
+      }
+      q.x0 += at.x;
+      q.x1 += at.x;
+      q.y0 += at.y;
+      q.y1 += at.y;
+      cmd.bounds.x0 = Min(cmd.bounds.x0, q.x0);
+      cmd.bounds.y0 = Min(cmd.bounds.y0, q.y0);
+      cmd.bounds.x1 = Max(cmd.bounds.x1, q.x1);
+      cmd.bounds.y1 = Max(cmd.bounds.y1, q.y1);
+      SBPush(gUI->sQuads, q, Lifetime_Frame);
+      cmd.numQuads++;
+   }
+   if (cmd.numQuads) {
+      SBPush(gUI->sCmds, cmd, Lifetime_Frame);
+   }
+}
+
+void
+immiPushRect(f32 cx, f32 cy, f32 w, f32 h, vec4 color)
+{
+   stbtt_aligned_quad q = {};
+   q.x0 = cx;
+   q.y0 = cy;
+   q.x1 = cx + w;
+   q.y1 = cy + h;
+   immiPushQuads(UISample_Flat, -1, color, &q, 1, vec2{});
 }
 
 void
@@ -147,35 +314,206 @@ immSameLine()
 void
 immNewFrame()
 {
+   // In case the last frame wasn't rendered. The memory is gone.
+   gUI->sCmds = NULL;
+   gUI->sQuads = NULL;
+   gUI->clipDepth = 0;
+
    gUI->newHotUI = static_cast<UIId>(-1);
    immSetCursor(0, 0);
    immSameLine();
 }
 
+static void
+immiTextCacheCreate(UITextCache* c)
+{
+   u32 n = gKnobs.uiTextCacheSize;
+   u32 g = gKnobs.uiTextCacheGlyphs;
+
+   c->layouts = AllocateArray(UITextLayout, n, Lifetime_App);
+   char* text = AllocateArray(char, n * g, Lifetime_App);
+   stbtt_aligned_quad* quads = AllocateArray(stbtt_aligned_quad, n * g, Lifetime_App);
+   f32* penX = AllocateArray(f32, n * g, Lifetime_App);
+   for (u32 i = 0; i < n; ++i) {
+      c->layouts[i].text = text + i * g;
+      c->layouts[i].quads = quads + i * g;
+      c->layouts[i].penX = penX + i * g;
+   }
+   for (u32 i = 0; i < ArrayCount(c->buckets); ++i) {
+      c->buckets[i] = -1;
+   }
+}
+
+static i32*
+immiTextCacheBucket(UITextCache* c, meow_u128 key)
+{
+   return &c->buckets[MeowU32From(key, 0) % ArrayCount(c->buckets)];
+}
+
+static void
+immiTextCacheUnlink(UITextCache* c, i32 idx)
+{
+   i32* link = immiTextCacheBucket(c, c->layouts[idx].key);
+   while (*link != idx) {
+      link = &c->layouts[*link].next;
+   }
+   *link = c->layouts[idx].next;
+}
+
+// Layout of text, from the cache when it has it. Pass the cursor when drawing:
+// a string that replaces the one drawn there last frame, like a counter that
+// ticks, only lays out the glyphs after the prefix they share.
+static UITextLayout*
+immiTextLayout(Font* font, FontSize fsize, char* text, u32 len, vec2* cursor)
+{
+   Assert(len);
+
+   UITextCache* c = &gUI->textCache;
+   if (!c->layouts) {
+      immiTextCacheCreate(c);
+   }
+
+   meow_u128 key = MeowHash(MeowDefaultSeed, len, text);
+   key = _mm_xor_si128(key, MeowHash(MeowDefaultSeed, sizeof(fsize), &fsize));
+   key = _mm_xor_si128(key, MeowHash(MeowDefaultSeed, sizeof(font), &font));
+
+   UITextLayout* l = nullptr;
+   i32* bucket = immiTextCacheBucket(c, key);
+   for (i32 i = *bucket; i != -1; i = c->layouts[i].next) {
+      if (MeowHashesAreEqual(c->layouts[i].key, key)) {
+         l = &c->layouts[i];
+         break;
+      }
+   }
+
+   if (!l && len > gKnobs.uiTextCacheGlyphs) {
+      // Too long to keep.
+      l = AllocateElem(UITextLayout, Lifetime_Frame);
+      l->numGlyphs = len;
+      l->text = text;
+      l->quads = AllocateArray(stbtt_aligned_quad, len, Lifetime_Frame);
+      l->penX = AllocateArray(f32, len, Lifetime_Frame);
+      layoutLineOfText(*font, fsize, text, 0, len, l->quads, l->penX);
+      return l;
+   }
+
+   if (!l) {
+      i32 idx = -1;
+      u32 keep = 0;
+
+      if (cursor) {
+         for (u32 i = 0; i < c->numLayouts; ++i) {
+            UITextLayout* old = &c->layouts[i];
+            if (old->font == font && old->size == fsize &&
+                old->lastUsedFrame + 1 == c->frame &&
+                old->lastCursor.x == cursor->x && old->lastCursor.y == cursor->y) {
+               u32 shared = 0;
+               while (shared < Min(len, old->numGlyphs) && old->text[shared] == text[shared]) {
+                  shared++;
+               }
+               if (shared) {
+                  idx = i;
+                  keep = shared;
+               }
+               break;
+            }
+         }
+      }
+
+      if (idx == -1) {
+         if (c->numLayouts < gKnobs.uiTextCacheSize) {
+            idx = c->numLayouts++;
+         }
+         else {
+            idx = 0;
+            for (u32 i = 1; i < c->numLayouts; ++i) {
+               if (c->layouts[i].lastUsedFrame < c->layouts[idx].lastUsedFrame) {
+                  idx = i;
+               }
+            }
+         }
+      }
+
+      l = &c->layouts[idx];
+      if (l->numGlyphs) {
+         immiTextCacheUnlink(c, idx);
+      }
+
+      l->key = key;
+      l->font = font;
+      l->size = fsize;
+      l->numGlyphs = len;
+      memcpy(l->text, text, len);
+      layoutLineOfText(*font, fsize, text, keep, len, l->quads, l->penX);
+
+      l->next = *bucket;
+      *bucket = idx;
+   }
+
+   l->lastUsedFrame = c->frame;
+   if (cursor) {
+      l->lastCursor = *cursor;
+   }
+
+   return l;
+}
+
 // Draw text at cursor, then advance cursor Y down to the next line.
 void
-immText(char* text, FontSize fsize)
+immText(char* text, FontSize fsize, vec4 color)
 {
    immiWidgetBegin(gUI->t->fontSizesPx[fsize]);
-   if (strlen(text)) {
-      // Build hash
-      meow_u128 hash = MeowHash(MeowDefaultSeed, strlen(text), text);
-      hash = _mm_xor_si128(hash, MeowHash(MeowDefaultSeed, sizeof(fsize), &fsize));
+   u32 len = (u32)strlen(text);
+   if (len) {
+      UITextLayout* layout = immiTextLayout(gUI->t, fsize, text, len, &gUI->cursor);
+      immiPushQuads(UISample_Sdf, (i32)gUI->t->atlasTexture.srvBindIndex, color, layout->quads, layout->numGlyphs, gUI->cursor);
+   }
+}
 
-      i32 idx = hmgeti(gUI->hmTexts, hash);
-      if (idx == -1) {
-         UIRenderElem tr = {};
-         buildLineOfText(*gUI->t, fsize, text, tr.mesh, tr.cstHnd);
-         tr.toRender = true;
-         tr.transform = mat4Translate(gUI->cursor.x, gUI->cursor.y, 0);
-         hmput(gUI->hmTexts, hash, tr);
-      } else {
-         UIRenderElem* tr = &gUI->hmTexts[idx].value;
-         tr->toRender = 1;
-         tr->transform = mat4Translate(gUI->cursor.x, gUI->cursor.y, 0);
+void
+immImage(Texture2D* tex, f32 width, f32 height, vec4 color)
+{
+   immiWidgetBegin(height);
+   stbtt_aligned_quad q = {};
+   q.x0 = gUI->cursor.x;
+   q.y0 = gUI->cursor.y - height;
+   q.x1 = q.x0 + width;
+   q.y1 = gUI->cursor.y;
+   q.s1 = 1;
+   q.t1 = 1;
+   immiPushQuads(UISample_Image, (i32)tex->srvBindIndex, color, &q, 1, vec2{});
+}
 
-      }
+void
+immPushClip(f32 x, f32 y, f32 w, f32 h)
+{
+   UIDrawCmd cmd = {};
+   cmd.type = UIDraw_ClipPush;
+   cmd.bounds = { x, y, x + w, y + h };
+   SBPush(gUI->sCmds, cmd, Lifetime_Frame);
+   gUI->clipDepth++;
+}
+
+void
+immPopClip()
+{
+   Assert(gUI->clipDepth > 0);
+   UIDrawCmd cmd = {};
+   cmd.type = UIDraw_ClipPop;
+   SBPush(gUI->sCmds, cmd, Lifetime_Frame);
+   gUI->clipDepth--;
+}
+
+vec2
+immMeasureText(char* text, FontSize fsize)
+{
+   vec2 size = { 0, gUI->t->fontSizesPx[fsize] };
+   u32 len = (u32)strlen(text);
+   if (len) {
+      UITextLayout* layout = immiTextLayout(gUI->t, fsize, text, len, nullptr);
+      size.x = layout->penX[len - 1];
    }
+   return size;
 }
 
 void
@@ -198,13 +536,13 @@ immList(char** texts, sz numTexts, int highlightedIdx, FontSize fsize)
 {
    Assert(highlightedIdx == -1 || highlightedIdx < numTexts);
    for (sz i = 0; i < numTexts; ++i) {
-      int off = 0;
+      f32 off = 0;
       if (i == highlightedIdx) {
          immText("->");
          immSameLine();
-         off = 20;
+         off = immMeasureText("-> ").x;
       }
-      gUI->cursor.x += off;  // TODO: Get width and maybe change cursor with API?
+      gUI->cursor.x += off;
       immText(texts[i], fsize);
       gUI->cursor.x -= off;
    }
@@ -374,53 +712,345 @@ immObjectPick()
    return result;
 }
 
-void
-immRender()
+static UIRect
+immiIntersect(UIRect a, UIRect b)
 {
-   gpuBeginMarker("UI");
+   UIRect r = { Max(a.x0, b.x0), Max(a.y0, b.y0), Min(a.x1, b.x1), Min(a.y1, b.y1) };
+   return r;
+}
 
-   // TODO: Oh shit
-   gpuSetViewport(0,0, gpu()->fbWidth, gpu()->fbHeight);
-   gpuSetRenderTargets(gpuBackbuffer(), nullptr);
+static bool
+immiIsEmpty(UIRect r)
+{
+   return r.x1 <= r.x0 || r.y1 <= r.y0;
+}
 
-   static const int maxKeysToDel = 8;
-   int nDel = 0;
-   meow_u128 toDelete[maxKeysToDel] = {};
-
-   if (gUI->numRects) {
-      // TODO: Only re-upload when meshes have changed.
-      gUI->rects.mesh = uploadMeshesToGPU(gUI->sRects, gUI->numRects, /*withMaterial*/false, /*blas*/false);
-      gpuMarkFreeRenderMesh(&gUI->rects.mesh, gpu()->frameCount);
-      {
-         // TODO: Frame lifetime for constant resources
-         gUI->rects.cstHnd = gpuCreateResource(sizeof(TextConstants), "Widget constants");
-         gpuMarkFreeResource(gUI->rects.cstHnd, gpu()->frameCount);
+// Trims the quad to the clip rect, moving its texture coordinates with its
+// edges. False when nothing is left.
+static bool
+immiClipQuad(stbtt_aligned_quad* q, UIRect clip)
+{
+   if (q->x1 <= clip.x0 || q->x0 >= clip.x1 || q->y1 <= clip.y0 || q->y0 >= clip.y1) {
+      return false;
+   }
+   if (q->x0 < clip.x0) {
+      q->s0 = lerp(q->s0, q->s1, (clip.x0 - q->x0) / (q->x1 - q->x0));
+      q->x0 = clip.x0;
+   }
+   if (q->x1 > clip.x1) {
+      q->s1 = lerp(q->s1, q->s0, (q->x1 - clip.x1) / (q->x1 - q->x0));
+      q->x1 = clip.x1;
+   }
+   if (q->y0 < clip.y0) {
+      q->t0 = lerp(q->t0, q->t1, (clip.y0 - q->y0) / (q->y1 - q->y0));
+      q->y0 = clip.y0;
+   }
+   if (q->y1 > clip.y1) {
+      q->t1 = lerp(q->t1, q->t0, (q->y1 - clip.y1) / (q->y1 - q->y0));
+      q->y1 = clip.y1;
+   }
+   return true;
+}
+
+// Groups this frame's commands into draws. A command joins the latest draw
+// with its texture and sample mode, unless something drawn after that one
+// overlaps it. Commands that are clipped away entirely are skipped, and those
+// that would need more than gKnobs.uiMaxDraws draws are dropped.
+//
+// Only with `record` does it write each command's clip and draw chain, and
+// count the dropped quads. Without it, the commands are only counted.
+static u32
+immiBuildDraws(UIDraw* draws, UIRect screen, bool record)
+{
+   UIRect clipStack[16] = { screen };
+   i32 depth = 0;
+
+   u32 numDraws = 0;
+   for (i32 ci = 0; ci < arrlen(gUI->sCmds); ++ci) {
+      UIDrawCmd* cmd = gUI->sCmds + ci;
+      switch (cmd->type) {
+         case UIDraw_ClipPush: {
+            Assert(depth + 1 < ArrayCount(clipStack));
+            depth = Min(depth + 1, (i32)ArrayCount(clipStack) - 1);
+            clipStack[depth] = immiIntersect(clipStack[depth - 1], cmd->bounds);
+         } break;
+         case UIDraw_ClipPop: {
+            depth = Max(depth - 1, 0);
+         } break;
+         case UIDraw_Quads: {
+            if (record) {
+               cmd->clip = clipStack[depth];
+               cmd->nextInDraw = -1;
+            }
+            UIRect visible = immiIntersect(cmd->bounds, clipStack[depth]);
+            if (immiIsEmpty(visible)) {
+               break;
+            }
+
+            i32 target = -1;
+            for (i32 d = (i32)numDraws - 1; d >= 0; --d) {
+               if (draws[d].mode == cmd->mode && draws[d].textureIdx == cmd->textureIdx) {
+                  target = d;
+                  break;
+               }
+               if (!immiIsEmpty(immiIntersect(draws[d].bounds, visible))) {
+                  break;
+               }
+            }
+
+            if (target == -1) {
+               if (numDraws == gKnobs.uiMaxDraws) {
+                  if (record) {
+                     gUI->stream.numDropped += cmd->numQuads;
+                  }
+                  break;
+               }
+               target = numDraws++;
+               UIDraw* draw = draws + target;
+               *draw = {};
+               draw->mode = cmd->mode;
+               draw->textureIdx = cmd->textureIdx;
+               draw->bounds = visible;
+               draw->firstCmd = ci;
+            }
+            else {
+               UIDraw* draw = draws + target;
+               draw->bounds = { Min(draw->bounds.x0, visible.x0), Min(draw->bounds.y0, visible.y0),
+                                Max(draw->bounds.x1, visible.x1), Max(draw->bounds.y1, visible.y1) };
+               if (record) {
+                  gUI->sCmds[draw->lastCmd].nextInDraw = ci;
+               }
+            }
+            draws[target].lastCmd = ci;
+         } break;
       }
+   }
+   return numDraws;
+}
+
+// Of everything that goes into the command's vertices.
+static u64
+immiCmdHash(UIDrawCmd* cmd)
+{
+   struct
+   {
+      u64 quads;
+      u32 color;
+      u32 numQuads;
+      UIRect clip;
+   } key = {};
+   meow_u128 quads = MeowHash(MeowDefaultSeed, cmd->numQuads * sizeof(stbtt_aligned_quad), gUI->sQuads + cmd->firstQuad);
+   key.quads = MeowU64From(quads, 0);
+   key.color = cmd->color;
+   key.numQuads = cmd->numQuads;
+   key.clip = cmd->clip;
+   return MeowU64From(MeowHash(MeowDefaultSeed, sizeof(key), &key), 0);
+}
 
-      renderWidgets(*gUI->t, gUI->rects.mesh, gUI->rects.cstHnd);
+// Clipped quads of the command, from `firstQuad` in the buffer. Returns how many.
+static u32
+immiWriteCmd(UIQuadStream* s, UIDrawCmd* cmd, MeshRenderVertex* verts, u32 firstQuad)
+{
+   u32 numQuads = 0;
+   for (u32 qi = 0; qi < cmd->numQuads; ++qi) {
+      stbtt_aligned_quad q = gUI->sQuads[cmd->firstQuad + qi];
+      if (!immiClipQuad(&q, cmd->clip)) {
+         continue;
+      }
+      if (firstQuad + numQuads == s->maxQuads) {
+         s->numDropped++;
+         continue;
+      }
+      // Write combined memory: copy whole, never read back.
+      MeshRenderVertex v[4];
+      glyphQuadVertices(q, vec2{}, cmd->color, v);
+      memcpy(verts + (firstQuad + numQuads) * 4, v, sizeof(v));
+      numQuads++;
    }
+   return numQuads;
+}
 
-   // Render text
-   for (sz i = 0; i < hmlen(gUI->hmTexts); ++i) {
-      ImmUI::TextHM& entry = gUI->hmTexts[i];
-      if (entry.value.toRender) {
-         renderText(*gUI->t, entry.value.mesh, entry.value.cstHnd, entry.value.transform);
-         entry.value.toRender = false;
+// Clipped quads of each draw, one draw after the other. Commands that are
+// already in the buffer at the place they go are left alone.
+static void
+immiWriteDraws(UIQuadStream* s, UIDraw* draws, u32 numDraws, u64* cmdHashes, i32 bufferIdx)
+{
+   UIBufferContents* c = s->contents + bufferIdx;
+
+   u32 numQuads = 0;
+   u32 numCmds = 0;
+   for (u32 d = 0; d < numDraws; ++d) {
+      draws[d].firstQuad = numQuads;
+      for (i32 ci = draws[d].firstCmd; ci != -1; ci = gUI->sCmds[ci].nextInDraw) {
+         UIWrittenCmd* written = c->cmds + numCmds;
+         u64 hash = cmdHashes[numCmds];
+         if (numCmds >= c->numCmds || written->hash != hash || written->firstQuad != numQuads) {
+            written->hash = hash;
+            written->firstQuad = numQuads;
+            written->numQuads = immiWriteCmd(s, gUI->sCmds + ci, s->verts[bufferIdx], numQuads);
+            s->stats.numQuadsWritten += written->numQuads;
+         }
+         s->stats.numQuads += written->numQuads;
+         numQuads += written->numQuads;
+         numCmds++;
       }
-      else if (nDel < maxKeysToDel) {
-         toDelete[nDel++] = gUI->hmTexts[i].key;
+      draws[d].numQuads = numQuads - draws[d].firstQuad;
+
+      UIConstantKey key = { draws[d].mode, draws[d].textureIdx, gpu()->fbWidth, gpu()->fbHeight };
+      if (d >= c->numDraws || memcmp(&key, c->constantKeys + d, sizeof(key)) != 0) {
+         renderUIWriteConstants(s->constants[bufferIdx][d], draws[d].mode, draws[d].textureIdx);
+         c->constantKeys[d] = key;
+      }
+   }
+
+   c->numQuads = numQuads;
+   c->numCmds = numCmds;
+   c->numDraws = numDraws;
+   memcpy(c->draws, draws, numDraws * sizeof(*draws));
+}
+
+// A buffer no frame still in flight draws from. Of those, the one drawn last,
+// since it holds the most recent draw list.
+static i32
+immiBufferToWrite(UIQuadStream* s, u64 frame)
+{
+   i32 result = -1;
+   for (i32 i = 0; i < gKnobs.swapChainBufferCount; ++i) {
+      u64 drawn = s->contents[i].lastDrawnFrame;
+      if (drawn && drawn + gKnobs.swapChainBufferCount > frame) {
+         continue;
+      }
+      if (result == -1 || drawn > s->contents[result].lastDrawnFrame) {
+         result = i;
+      }
+   }
+   // One buffer is drawn per frame, so one of them was last drawn before the frames in flight.
+   Assert(result != -1);
+   return result;
+}
+
+static UIRect
+immiScreenRect()
+{
+   UIRect screen = { 0, 0, (f32)gpu()->fbWidth, (f32)gpu()->fbHeight };
+   return screen;
+}
+
+ImmStats
+immStats()
+{
+   return gUI->stream.stats;
+}
+
+u32
+immCountDraws()
+{
+   UIDraw draws[gKnobs.uiMaxDraws];
+   return immiBuildDraws(draws, immiScreenRect(), false);
+}
+
+// Groups this frame's commands and gets a buffer of the stream that holds
+// them: the one drawn last when nothing changed, otherwise one no frame in
+// flight draws from, with what changed written into it. `frame` is the frame
+// it is drawn in. -1 when there is nothing to draw.
+static i32
+immiFillBuffer(UIQuadStream* s, u64 frame)
+{
+   Assert(gUI->clipDepth == 0);
+
+   ImmStats* stats = &s->stats;
+   stats->numDraws = 0;
+   stats->numQuads = 0;
+   stats->numQuadsWritten = 0;
+   stats->reusedFrame = false;
+
+   UIDraw draws[gKnobs.uiMaxDraws];
+   u32 numDraws = immiBuildDraws(draws, immiScreenRect(), true);
+   if (!numDraws) {
+      return -1;
+   }
+
+   if (!s->maxQuads) {
+      immiStreamCreate(s, gKnobs.uiMaxQuads, "UI quads");
+   }
+
+   // Hash of the whole draw list, from the commands of each draw in the order they are written.
+   u64* sCmdHashes = NULL;
+   u64* sKeys = NULL;
+   SBPush(sKeys, (u64)gpu()->fbWidth << 32 | (u32)gpu()->fbHeight, Lifetime_Frame);
+   for (u32 d = 0; d < numDraws; ++d) {
+      SBPush(sKeys, (u64)draws[d].mode << 32 | (u32)draws[d].textureIdx, Lifetime_Frame);
+      for (i32 ci = draws[d].firstCmd; ci != -1; ci = gUI->sCmds[ci].nextInDraw) {
+         u64 hash = immiCmdHash(gUI->sCmds + ci);
+         SBPush(sCmdHashes, hash, Lifetime_Frame);
+         SBPush(sKeys, hash, Lifetime_Frame);
       }
    }
+   u64 frameHash = MeowU64From(MeowHash(MeowDefaultSeed, SBCount(sKeys) * sizeof(u64), sKeys), 0);
+   frameHash = Max(frameHash, 1ull);  // Zero is never written.
+
+   i32 bufferIdx = s->lastDrawn;
+   if (bufferIdx != -1 && s->contents[bufferIdx].hash == frameHash) {
+      // Drawing a buffer again doesn't change it, so frames in flight don't matter.
+      stats->reusedFrame = true;
+      stats->numQuads = s->contents[bufferIdx].numQuads;
+   }
+   else {
+      bufferIdx = immiBufferToWrite(s, frame);
+      immiWriteDraws(s, draws, numDraws, sCmdHashes, bufferIdx);
+      s->contents[bufferIdx].hash = frameHash;
+   }
+   UIBufferContents* c = s->contents + bufferIdx;
+   c->lastDrawnFrame = frame;
+   s->lastDrawn = bufferIdx;
 
-   for (int i = 0; i < nDel; ++i) {
-      auto key = toDelete[i];
-      gpuMarkFreeRenderMesh(&hmget(gUI->hmTexts, key).mesh, gpu()->frameCount);
-      gpuMarkFreeResource(hmget(gUI->hmTexts, key).cstHnd, gpu()->frameCount);
-      hmdel(gUI->hmTexts, key);
+   for (u32 d = 0; d < c->numDraws; ++d) {
+      if (c->draws[d].numQuads) {
+         stats->numDraws++;
+      }
    }
+   stats->numFrames++;
+   stats->numFramesReused += stats->reusedFrame;
+   stats->totalQuads += stats->numQuads;
+   stats->totalQuadsWritten += stats->numQuadsWritten;
+   return bufferIdx;
+}
+
+ImmStats
+immFillBuffer(u64 frame)
+{
+   immiFillBuffer(&gUI->testStream, frame);
+   return gUI->testStream.stats;
+}
+
+void
+immRender()
+{
+   ProfileZone("immRender");
+
+   gpuBeginMarker("UI");
+
+   // TODO: Oh shit
+   gpuSetViewport(0,0, gpu()->fbWidth, gpu()->fbHeight);
+   gpuSetRenderTargets(gpuBackbuffer(), nullptr);
+
+   UIQuadStream* s = &gUI->stream;
+   i32 bufferIdx = immiFillBuffer(s, gpu()->frameCount);
+   if (bufferIdx != -1) {
+      UIBufferContents* c = s->contents + bufferIdx;
+      fontFlushAtlas(gUI->t);
+      renderUIBegin(s->vertexBuffers[bufferIdx], s->indexBuffer, c->numQuads);
+      for (u32 d = 0; d < c->numDraws; ++d) {
+         if (c->draws[d].numQuads) {
+            renderUIDraw(s->constants[bufferIdx][d], c->draws[d].firstQuad, c->draws[d].numQuads);
+         }
+      }
+   }
+
+   gUI->sCmds = NULL;
+   gUI->sQuads = NULL;
 
-   // Rendered all rects. Mark all as unused.
-   gUI->numRects = 0;
+   gUI->textCache.frame++;
 
    // Restore event state
    gUI->wasClicked = false;
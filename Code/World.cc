@@ -1,5 +1,6 @@
 
 static World* gWorld;
+static u64 gNumWorldsMade;
 
 struct ObjectIterator
 {
@@ -101,8 +102,8 @@ rayTriangleIntersection(vec3 o, vec3 d, vec4* positions, u32* indices, size_t nu
    return false;
 }
 
-ObjectHandle
-addMeshToWorld(Mesh mesh, char* debugName)
+static ObjectHandle
+addMeshObject(const Mesh& mesh, MeshRenderHandle rh, AABB bounds, char* debugName)
 {
    World* w = getWorld();
    u64 idx = w->numObjects++;
@@ -110,8 +111,8 @@ addMeshToWorld(Mesh mesh, char* debugName)
    w->objects[idx].flags = flags;
    w->objects[idx].mesh = mesh;
    w->renderHandles[idx].flags = flags;
-   w->renderHandles[idx].mesh = uploadMeshToGPU(mesh);
-   w->boundingBoxes[idx] = computeBoundingBox(mesh);
+   w->renderHandles[idx].mesh = rh;
+   w->boundingBoxes[idx] = bounds;
 
    ObjectHandle h = {idx};
 
@@ -133,6 +134,59 @@ addMeshToWorld(Mesh mesh, char* debugName)
    return h;
 }
 
+ObjectHandle
+addMeshToWorld(Mesh mesh, char* debugName)
+{
+   AABB bounds = mesh.cookedVerts ? mesh.cookedBounds : computeBoundingBox(mesh);
+   return addMeshObject(mesh, uploadMeshToGPU(mesh), bounds, debugName);
+}
+
+ObjectHandle
+addMeshAssetToWorld(MeshAssetHandle asset, char* debugName)
+{
+   MeshRenderHandle rh = instanceMeshOnGPU(meshAssetRenderHandle(asset));
+   ObjectHandle h = addMeshObject(*meshAsset(asset), rh, meshAssetBounds(asset), debugName);
+   getWorld()->meshAssets[h.idx] = asset;
+   return h;
+}
+
+ObjectHandle
+findObjectWithMeshAsset(MeshAssetHandle asset)
+{
+   World* w = getWorld();
+   ObjectHandle h = {};
+   for (u64 idx = 1; asset.idx && idx < w->numObjects && !h.idx; ++idx) {
+      if (w->meshAssets[idx].idx == asset.idx) {
+         h.idx = idx;
+      }
+   }
+   return h;
+}
+
+// Looks at the object from where the camera is, backing off until its bounds fit in view.
+void
+focusCameraOnObject(ObjectHandle h)
+{
+   World* w = getWorld();
+   Camera* cam = &w->cam;
+
+   mat4 m = transformForObject(h);
+   AABB bb = w->boundingBoxes[h.idx];
+   vec3 lo = (m * toVec4(bb.min, 1)).xyz;
+   vec3 hi = (m * toVec4(bb.max, 1)).xyz;
+   vec3 center = (lo + hi) * 0.5f;
+   float radius = Max(length(hi - lo) * 0.5f, 0.1f);
+
+   vec3 dir = normalizedOrZero(cam->lookat - cam->eye);
+   if (length(dir) == 0) {
+      dir = vec3{ 0, 0, 1 };
+   }
+   float distance = radius / sin(cam->fov / 2.0f);
+
+   cam->lookat = center;
+   cam->eye = center - dir * distance;
+}
+
 Mesh*
 worldObjectMesh(ObjectHandle h)
 {
@@ -145,12 +199,17 @@ void
 setWorld(World* world)
 {
    gWorld = world;
+   // Statics start over when new code is loaded. Carry on from the world we are handed.
+   if (world) {
+      gNumWorldsMade = Max(gNumWorldsMade, world->generation);
+   }
 }
 
 World*
 makeAndSetWorld()
 {
    World* world = AllocateElem(World, Lifetime_World);
+   world->generation = ++gNumWorldsMade;
    setWorld(world);
    addMeshToWorld(makeQuad(0.0, 0, Lifetime_Frame));  // Sentinel object
    world->currentBlobEdit = ObjectHandle{0};
@@ -380,6 +439,10 @@ disposeWorld()
       // Dispose of sentinel render mesh
       gpuMarkFreeRenderMesh(&renderHandleForObject({})->mesh, gpu()->frameCount);
 
+      disposeMeshAssets();
+      wrDisposeWorld();
+      stopAllSounds();  // Game sounds are loaded into world memory.
+
       freePages(Lifetime_World);
 
       gWorld = NULL;
@@ -59,17 +59,22 @@
 #include "Math.cc"
 #include "Mesh.cc"
 #include "OBJLoad.cc"
+#include "MeshCache.cc"
 #include "SoundLoad.cc"
 #include "RenderWorld.cc"
 #include "RenderUI.cc"
 #include "RenderDXCore.cc"
 #include "World.cc"
+#include "Assets.cc"
+#include "AssetPack.cc"
 #include "UI.cc"
 #include "Commands.cc"
 #include "ModeFinder.cc"
 #include "ModeMaterialEditor.cc"
+#include "AudioMixer.cc"
 #include "AudioXAudio.cc"
 #include "Logging.cc"
+#include "Profiler.cc"
 
 #pragma warning(pop)  // pragma warning 4
 
@@ -7,13 +7,14 @@ ConstantBuffer<BlobCB> cbBlob : register(b0);
 ConstantBuffer<MaterialConstantsCB> cbMaterial : register(b1);
 
 PSInput
-vertexMain(float4 position : POSITION, float2 texcoord : TEXCOORD, float3 normal : NORMAL)
+vertexMain(float4 position : POSITION, float2 texcoord : TEXCOORD, float2 normalOct : NORMAL)
 {
    PSInput result;
 
    result.worldPos = mul(cbMaterial.objectTransform, position);
    result.screenPos = mul(cbMaterial.viewProjection, result.worldPos);
    result.uv = texcoord;
+   float3 normal = octDecode(normalOct);
    result.normal = mul(cbMaterial.objectTransform, float4(normal, 1)).rgb;
    result.normal /= length(normal);
 
@@ -63,6 +63,17 @@ iqhash( float2 p )
   return frac(sin(q)*1242.192);
 }
 
+// Octahedral normal decode. Matches octDecodeNormal() in Math.cc.
+// The input assembler already converted R16G16_SNORM to [-1, 1].
+float3
+octDecode(float2 e)
+{
+   float3 n = float3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+   float t = saturate(-n.z);
+   n.xy += (n.xy >= 0.0) ? -t : t;
+   return normalize(n);
+}
+
 // http://alex.vlachos.com/graphics/Alex_Vlachos_Advanced_VR_Rendering_GDC2015.pdf
 float3
 valveDither( float2 pos )
@@ -4,13 +4,14 @@
 // ConstantBuffer<MaterialConstantsCB> cbShader : register(b1);
 
 PSInput
-vertexMain(float4 position : POSITION, float2 texcoord : TEXCOORD, float3 normal : NORMAL)
+vertexMain(float4 position : POSITION, float2 texcoord : TEXCOORD, float2 normalOct : NORMAL)
 {
    PSInput result;
 
    result.worldPos = mul(cbShader.objectTransform, position);
    result.screenPos = mul(cbShader.viewProjection, result.worldPos);
    result.uv = texcoord;
+   float3 normal = octDecode(normalOct);
    result.normal = mul(cbShader.objectTransform, float4(normal, 0)).rgb;
 
    return result;
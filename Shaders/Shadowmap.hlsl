@@ -12,7 +12,7 @@ struct ShadowCB
 ConstantBuffer<ShadowCB> cbShadow : register(b0);
 
 PSInput
-vertexMain(float4 position : POSITION, float2 texcoord : TEXCOORD, float3 normal : NORMAL)
+vertexMain(float4 position : POSITION, float2 texcoord : TEXCOORD, float2 normalOct : NORMAL)
 {
    PSInput result;
 
@@ -4,12 +4,13 @@ struct TextConstants
 {
    matrix<float, 4, 4> transform;
 
-   int atlasBindIdx;
+   int textureBindIdx;
+   int sampleMode;  // UISampleMode: 0 flat, 1 font atlas, 2 image
 };
 
 ConstantBuffer<TextConstants> cbText : register(b0);
 
-PSInputScreen vertexMain(float4 position : POSITION, float2 texcoord : TEXCOORD, float3 normal : NORMAL, float4 color : COLOR)
+PSInputScreen vertexMain(float4 position : POSITION, float2 texcoord : TEXCOORD, float2 normalOct : NORMAL, float4 color : COLOR)
 {
    PSInputScreen result;
 
@@ -23,11 +24,19 @@ PSOutput pixelMain(PSInputScreen input)
 {
    PSOutput psout;
 
-   if (cbText.atlasBindIdx >= 0)
-      // From some manual testing, taking screenshots and comparing, point sampling with an oversampled atlas seems to work best.
-      psout.color = gTextures[cbText.atlasBindIdx].Sample(pointSampler, input.uv);
-   else
+   if (cbText.sampleMode == 1) {
+      // Signed distance, with the glyph edge at 0.5. Antialiased over about a pixel at any size.
+      float d = gTextures[cbText.textureBindIdx].Sample(linearSampler, input.uv).a;
+      float w = fwidth(d);
+      float coverage = smoothstep(0.5 - w, 0.5 + w, d);
+      psout.color = float4(input.color.rgb, input.color.a * coverage);
+   }
+   else if (cbText.sampleMode == 2) {
+      psout.color = input.color * gTextures[cbText.textureBindIdx].Sample(linearSampler, input.uv);
+   }
+   else {
       psout.color = input.color;
+   }
 
    return psout;
 }